@@ -0,0 +1,156 @@
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include "AsyncLog.h"
+
+using namespace std;
+
+static const char * logLevelNames[4] = { "[debug] ", "", "[warning] ", "[error] " };
+
+AsyncLog & AsyncLog::instance()
+{
+	static AsyncLog theLog;
+	return theLog;
+}
+
+AsyncLog::AsyncLog(int capacity)
+{
+	this->ring.resize(capacity > 0 ? capacity : 1);
+	this->head = 0;
+	this->count = 0;
+	this->writing = 0;
+	this->minLevel = ALOG_DEBUG;
+	this->maxPerSecond = 100;
+	this->nFlushing = 0;
+	this->stopping = false;
+	this->worker = std::thread(&AsyncLog::run, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		this->stopping = true;
+	}
+	cvWork.notify_one();
+	if (this->worker.joinable())
+		this->worker.join();
+}
+
+int AsyncLog::write(const std::string & file, const std::string & msg, int level)
+{
+	// format time stamp out of the lock (same format as former log() functions)
+	std::time_t t = std::time(0);
+	std::tm now;
+#ifdef _WIN32
+	localtime_s(&now, &t);
+#else
+	localtime_r(&t, &now);
+#endif
+	char logTime[100];
+	snprintf(logTime, 100, " (%4d-%02d-%02d %02d:%02d:%02d)",
+		now.tm_year + 1900, now.tm_mon + 1, now.tm_mday,
+		now.tm_hour, now.tm_min, now.tm_sec);
+	level = std::min(std::max(level, ALOG_DEBUG), ALOG_ERROR);
+
+	std::unique_lock<std::mutex> lock(mtx);
+	if (level < this->minLevel)
+		return 1;
+	FileCount & fc = this->counts[file];
+	if (fc.second != (long long) t) {
+		fc.second = (long long) t;
+		fc.nInWindow = 0;
+	}
+	if (level < ALOG_WARN && fc.nInWindow >= this->maxPerSecond) {
+		fc.nSuppressed++;
+		return 1;
+	}
+	if (this->count + this->writing >= (int) this->ring.size()) {
+		fc.nDropped++;
+		return -1;
+	}
+	fc.nInWindow++;
+	Entry & e = this->ring[(this->head + this->count) % this->ring.size()];
+	e.file = file;
+	e.line = string(logLevelNames[level]) + msg + logTime;
+	this->count++;
+	lock.unlock();
+	cvWork.notify_one();
+	return 0;
+}
+
+void AsyncLog::flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	this->nFlushing++;
+	cvWork.notify_one();
+	cvDone.wait(lock, [this] { return this->count == 0 && this->writing == 0; });
+	this->nFlushing--;
+}
+
+void AsyncLog::setMinLevel(int level)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	this->minLevel = level;
+}
+
+void AsyncLog::setMaxPerSecond(int n)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	this->maxPerSecond = std::max(n, 1);
+}
+
+void AsyncLog::run()
+{
+	vector<Entry> batch;
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		// wait for messages, or let more messages come (batch up to 0.2 sec.)
+		cvWork.wait_for(lock, std::chrono::milliseconds(200),
+			[this] { return this->stopping || this->nFlushing > 0 || this->count >= (int) this->ring.size() / 2; });
+		// take all buffered messages, and reports of suppressed/dropped messages
+		batch.clear();
+		for (int i = 0; i < this->count; i++) {
+			Entry & e = this->ring[(this->head + i) % this->ring.size()];
+			batch.push_back(Entry());
+			batch.back().file.swap(e.file);
+			batch.back().line.swap(e.line);
+		}
+		this->head = (this->head + this->count) % this->ring.size();
+		this->writing = this->count;
+		this->count = 0;
+		for (map<string, FileCount>::iterator it = this->counts.begin(); it != this->counts.end(); ++it) {
+			if (it->second.nSuppressed <= 0 && it->second.nDropped <= 0) continue;
+			char buf[200];
+			snprintf(buf, 200, "[warning] AsyncLog: %d messages suppressed (rate limit), %d dropped (buffer full).",
+				it->second.nSuppressed, it->second.nDropped);
+			batch.push_back(Entry());
+			batch.back().file = it->first;
+			batch.back().line = buf;
+			it->second.nSuppressed = it->second.nDropped = 0;
+		}
+		bool stop = this->stopping;
+		lock.unlock();
+
+		// write the batch, opening each file once (files of the batch in order of first message)
+		vector<char> done(batch.size(), 0);
+		for (size_t i = 0; i < batch.size(); i++) {
+			if (done[i]) continue;
+			ofstream logFile(batch[i].file, std::ios_base::app);
+			for (size_t j = i; j < batch.size(); j++) {
+				if (done[j] || batch[j].file != batch[i].file) continue;
+				if (logFile.is_open())
+					logFile << batch[j].line << '\n';
+				done[j] = 1;
+			}
+		}
+
+		lock.lock();
+		this->writing = 0;
+		cvDone.notify_all();
+		if (stop && this->count == 0)
+			break;
+	}
+}
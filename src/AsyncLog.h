@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#define ALOG_DEBUG 0
+#define ALOG_INFO  1
+#define ALOG_WARN  2
+#define ALOG_ERROR 3
+
+// AsyncLog is the shared log writer of log() functions (FileSeq, IntrinsicCalibrator).
+// write() only puts the (time-stamped) message into an in-memory ring buffer and
+// returns. A background thread appends buffered messages to their files in batches,
+// opening each file once per batch instead of once per message.
+// If the buffer is full, messages are dropped (never blocks the caller). Messages
+// below ALOG_WARN are rate limited per file (maxPerSecond); the number of dropped and
+// suppressed messages is written to the file afterwards.
+// Everything buffered is written at flush() and at program exit.
+//
+// AsyncLog::instance().write("c:/test/log.log", "Started.");
+// AsyncLog::instance().write("c:/test/log.log", "Cannot read file.", ALOG_ERROR);
+// AsyncLog::instance().setMinLevel(ALOG_WARN);  // ignore debug and info messages
+
+class AsyncLog
+{
+public:
+	//! Returns the shared logger (the background thread starts at first use)
+	static AsyncLog & instance();
+
+	//! Buffers a message (time is appended) to be written to a file. Never blocks on file I/O.
+	/*!
+	\param file full path of the log file
+	\param msg message
+	\param level ALOG_DEBUG, ALOG_INFO, ALOG_WARN, or ALOG_ERROR
+	\return 0: buffered. 1: ignored (level or rate limit). -1: dropped (buffer full)
+	*/
+	int write(const std::string & file, const std::string & msg, int level = ALOG_INFO);
+
+	//! Blocks until all buffered messages are written
+	void flush();
+
+	void setMinLevel(int level);        // messages below level are ignored (default ALOG_DEBUG)
+	void setMaxPerSecond(int n);        // rate limit of messages below ALOG_WARN per file (default 100)
+
+	~AsyncLog();
+
+private:
+	AsyncLog(int capacity = 4096);
+	AsyncLog(const AsyncLog &) = delete;
+	AsyncLog & operator=(const AsyncLog &) = delete;
+	void run();
+
+	struct Entry {
+		std::string file;
+		std::string line;
+	};
+	struct FileCount {
+		long long second;   // time (second) of current rate limit window
+		int nInWindow;      // messages in the window
+		int nSuppressed;    // messages suppressed by rate limit (not reported yet)
+		int nDropped;       // messages dropped by full buffer (not reported yet)
+	};
+	std::vector<Entry> ring;
+	int head, count;           // first entry and number of entries in ring
+	int writing;               // number of entries being written by the thread
+	std::map<std::string, FileCount> counts;
+	int minLevel, maxPerSecond;
+	int nFlushing;             // number of callers waiting in flush()
+	bool stopping;
+	std::mutex mtx;
+	std::condition_variable cvWork, cvDone;
+	std::thread worker;
+};
@@ -0,0 +1,181 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "BsplineImage.h"
+
+using namespace std;
+
+// cubic B-spline prefilter of a line (in place), mirror boundary
+// (M. Unser, "Splines: a perfect fit for signal and image processing", 1999)
+static void bsplinePrefilterLine(float * c, int n, int step)
+{
+	const double z = sqrt(3.0) - 2.0;
+	const double lambda = (1.0 - z) * (1.0 - 1.0 / z);
+	if (n < 2) return;
+	for (int k = 0; k < n; k++)
+		c[k * step] = (float)(c[k * step] * lambda);
+	// initial causal coefficient
+	int horizon = std::min(n, (int)ceil(log(1e-6) / log(fabs(z))));
+	double zn = z, sum = c[0];
+	for (int k = 1; k < horizon; k++) {
+		sum += zn * c[k * step];
+		zn *= z;
+	}
+	c[0] = (float)sum;
+	// causal
+	for (int k = 1; k < n; k++)
+		c[k * step] = (float)(c[k * step] + z * c[(k - 1) * step]);
+	// initial anti-causal coefficient
+	c[(n - 1) * step] = (float)((z / (z * z - 1.0)) * (z * c[(n - 2) * step] + c[(n - 1) * step]));
+	// anti-causal
+	for (int k = n - 2; k >= 0; k--)
+		c[k * step] = (float)(z * (c[(k + 1) * step] - c[k * step]));
+}
+
+// cubic B-spline weights (w) and their derivatives (dw) of fraction t
+static inline void bsplineWeights(double t, double w[4])
+{
+	double t2 = t * t, t3 = t2 * t;
+	w[0] = (1 - t) * (1 - t) * (1 - t) / 6.;
+	w[1] = (3 * t3 - 6 * t2 + 4) / 6.;
+	w[2] = (-3 * t3 + 3 * t2 + 3 * t + 1) / 6.;
+	w[3] = t3 / 6.;
+}
+
+static inline void bsplineDerivWeights(double t, double dw[4])
+{
+	double t2 = t * t;
+	dw[0] = -(1 - t) * (1 - t) / 2.;
+	dw[1] = (3 * t2 - 4 * t) / 2.;
+	dw[2] = (-3 * t2 + 2 * t + 1) / 2.;
+	dw[3] = t2 / 2.;
+}
+
+BsplineImage::BsplineImage()
+{
+	this->margin = 12; // sqrt(3)-2 to the power of 12 is about 1e-7
+}
+
+void BsplineImage::setMargin(int _margin)
+{
+	this->margin = std::max(_margin, 0);
+}
+
+int BsplineImage::set(const cv::Mat & img, cv::Rect roi)
+{
+	if (img.cols <= 0 || img.rows <= 0) {
+		cerr << "BsplineImage::set(): Empty image.\n";
+		return -1;
+	}
+	cv::Rect full(0, 0, img.cols, img.rows);
+	if (roi.width <= 0 || roi.height <= 0)
+		roi = full;
+	roi = cv::Rect(roi.x - margin, roi.y - margin, roi.width + 2 * margin, roi.height + 2 * margin) & full;
+	if (roi.width <= 0 || roi.height <= 0) {
+		cerr << "BsplineImage::set(): Empty region.\n";
+		return -1;
+	}
+	// convert the region to 1-channel float (coefficients are computed in place)
+	cv::Mat gray;
+	if (img.channels() == 3)
+		cv::cvtColor(img(roi), gray, cv::COLOR_BGR2GRAY);
+	else if (img.channels() == 4)
+		cv::cvtColor(img(roi), gray, cv::COLOR_BGRA2GRAY);
+	else
+		gray = img(roi);
+	gray.convertTo(this->coef, CV_32F); // always a copy
+	this->coefRect = roi;
+	// separable prefilter
+	int rows = this->coef.rows, cols = this->coef.cols;
+	int step = (int)(this->coef.step1());
+#pragma omp parallel for
+	for (int i = 0; i < rows; i++)
+		bsplinePrefilterLine(this->coef.ptr<float>(i), cols, 1);
+#pragma omp parallel for
+	for (int j = 0; j < cols; j++)
+		bsplinePrefilterLine(this->coef.ptr<float>(0) + j, rows, step);
+	return 0;
+}
+
+bool BsplineImage::empty() const
+{
+	return this->coef.empty();
+}
+
+cv::Rect BsplineImage::region() const
+{
+	return this->coefRect;
+}
+
+const cv::Mat & BsplineImage::coefficients() const
+{
+	return this->coef;
+}
+
+bool BsplineImage::interp(double x, double y, double & val) const
+{
+	x -= this->coefRect.x;
+	y -= this->coefRect.y;
+	int ix = (int)floor(x), iy = (int)floor(y);
+	if (ix < 1 || iy < 1 || ix > this->coef.cols - 3 || iy > this->coef.rows - 3)
+		return false;
+	double wx[4], wy[4];
+	bsplineWeights(x - ix, wx);
+	bsplineWeights(y - iy, wy);
+	double v = 0.0;
+	for (int m = 0; m < 4; m++) {
+		const float * row = this->coef.ptr<float>(iy - 1 + m) + (ix - 1);
+		v += wy[m] * (wx[0] * row[0] + wx[1] * row[1] + wx[2] * row[2] + wx[3] * row[3]);
+	}
+	val = v;
+	return true;
+}
+
+bool BsplineImage::interpGrad(double x, double y, double & val, double & gx, double & gy) const
+{
+	x -= this->coefRect.x;
+	y -= this->coefRect.y;
+	int ix = (int)floor(x), iy = (int)floor(y);
+	if (ix < 1 || iy < 1 || ix > this->coef.cols - 3 || iy > this->coef.rows - 3)
+		return false;
+	double wx[4], wy[4], dwx[4], dwy[4];
+	bsplineWeights(x - ix, wx);
+	bsplineWeights(y - iy, wy);
+	bsplineDerivWeights(x - ix, dwx);
+	bsplineDerivWeights(y - iy, dwy);
+	double v = 0.0, vx = 0.0, vy = 0.0;
+	for (int m = 0; m < 4; m++) {
+		const float * row = this->coef.ptr<float>(iy - 1 + m) + (ix - 1);
+		double r = wx[0] * row[0] + wx[1] * row[1] + wx[2] * row[2] + wx[3] * row[3];
+		double rx = dwx[0] * row[0] + dwx[1] * row[1] + dwx[2] * row[2] + dwx[3] * row[3];
+		v += wy[m] * r;
+		vx += wy[m] * rx;
+		vy += dwy[m] * r;
+	}
+	val = v;
+	gx = vx;
+	gy = vy;
+	return true;
+}
+
+int BsplineImage::warpAffine(const cv::Matx23d & M, cv::Size dsize, cv::Mat & dst, float outValue) const
+{
+	dst.create(dsize, CV_32F);
+	int nOut = 0;
+#pragma omp parallel for reduction(+:nOut)
+	for (int i = 0; i < dsize.height; i++) {
+		float * d = dst.ptr<float>(i);
+		for (int j = 0; j < dsize.width; j++) {
+			double v;
+			if (this->interp(M(0, 0) * j + M(0, 1) * i + M(0, 2), M(1, 0) * j + M(1, 1) * i + M(1, 2), v))
+				d[j] = (float)v;
+			else {
+				d[j] = outValue;
+				nOut++;
+			}
+		}
+	}
+	return nOut;
+}
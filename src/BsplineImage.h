@@ -0,0 +1,71 @@
+#pragma once
+#include <opencv2/core.hpp>
+
+// BsplineImage keeps the bicubic B-spline interpolation coefficients of an
+// image (or of a region of it) so that all sub-pixel samplers of the same
+// frame (e.g., hundreds of subsets whose windows overlap) read the same
+// coefficients instead of interpolating the frame independently.
+// The coefficients are computed once per frame by a separable recursive
+// prefilter (rows and columns in parallel). Sampling is const and thread-safe.
+// All coordinates are image coordinates even if only a region is computed.
+//
+// BsplineImage bimg;
+// bimg.set(imgCurr, unionRect(searchRects, imgCurr.size()));
+// double v;
+// if (bimg.interp(x, y, v)) ...
+
+class BsplineImage
+{
+public:
+	BsplineImage();
+
+	//! Computes B-spline coefficients of an image (or a region of it)
+	/*!
+	\param img image (1-channel, 8U/16U/32F/64F, or 3/4-channel which is converted to gray)
+	\param roi region to compute (image coordinate). If empty, the whole image is computed.
+	A margin (see setMargin()) is added around roi (within image) so that values near
+	the roi border are the same as if the whole image is computed.
+	\return 0: success. -1: empty image or region.
+	*/
+	int set(const cv::Mat & img, cv::Rect roi = cv::Rect());
+
+	//! Sets the margin (in pixel) added around the region (default: 12)
+	void setMargin(int margin);
+
+	//! Returns true if coefficients are not computed
+	bool empty() const;
+
+	//! Returns the region (image coordinate) whose coefficients are computed
+	cv::Rect region() const;
+
+	//! Returns the coefficients (CV_32F) of region()
+	const cv::Mat & coefficients() const;
+
+	//! Interpolates the value at (x, y)
+	/*!
+	\return false if (x, y) is too close to the border of region() (needs 4x4 coefficients)
+	*/
+	bool interp(double x, double y, double & val) const;
+
+	//! Interpolates the value and gradients at (x, y)
+	/*!
+	\return false if (x, y) is too close to the border of region() (needs 4x4 coefficients)
+	*/
+	bool interpGrad(double x, double y, double & val, double & gx, double & gy) const;
+
+	//! Samples an affine-mapped grid, similar to cv::warpAffine with cv::WARP_INVERSE_MAP
+	/*!
+	\details dst(i, j) = img(M(0,0) * j + M(0,1) * i + M(0,2), M(1,0) * j + M(1,1) * i + M(1,2))
+	\param M inverse affine map (dst pixel --> image coordinate)
+	\param dsize size of dst
+	\param dst output image (CV_32F). Samples out of region() are set to outValue.
+	\param outValue value of samples out of region()
+	\return number of samples out of region()
+	*/
+	int warpAffine(const cv::Matx23d & M, cv::Size dsize, cv::Mat & dst, float outValue = 0.f) const;
+
+private:
+	cv::Mat coef;       // coefficients (CV_32F)
+	cv::Rect coefRect;  // region of coef (image coordinate)
+	int margin;
+};
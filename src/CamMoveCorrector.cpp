@@ -1,3 +1,4 @@
+#include <cmath>
 #include <opencv2/opencv.hpp>
 #include "CamMoveCorrector.h"
 #include "impro_util.h"
@@ -6,6 +7,15 @@
 // TEST
 // TEST 2
 
+CamMoveCorrector::CamMoveCorrector()
+{
+	this->winSize = cv::Size(61, 61);
+	this->maxLevel = 3;
+	this->roiHalfSize = 0;
+	this->maxMotion = 50.f;
+	this->reset();
+}
+
 int CamMoveCorrector::pickInitFixedPoint(int numFixedPoints)
 {
 	// check 
@@ -21,6 +31,7 @@ int CamMoveCorrector::pickInitFixedPoint(int numFixedPoints)
 		return -1;
 	}
 	this->fixedPoints.resize(numFixedPoints);
+	this->reset();
 	// Get points
 	// get the first image to be the background for user to pick fixed reference points
 	if (this->imgFixed.rows <= 0 || this->imgFixed.cols <= 0)
@@ -40,51 +51,145 @@ int CamMoveCorrector::pickInitFixedPoint(int numFixedPoints)
 
 int CamMoveCorrector::correctImgMoved()
 {
-	cv::Mat imgOri, imgCamMoveCorrected;
 	// Check if there are fixed point
 	if (this->fixedPoints.size() > 0)
 	{
-		cv::Mat imgFixedSobel; 
-		cv::Mat imgMovedSobel;
-		// correct image: 
-		// compare imgFixed and imgOri
-		vector<cv::Point2f> fixedPointsMoved = this->fixedPoints; 
-		vector<uchar> optStatus(this->fixedPoints.size());
-		vector<float> optError(this->fixedPoints.size());
-		imgFixedSobel = sobel_xy(imgFixed); 
-		imgMovedSobel = sobel_xy(imgMoved);
-		cout << imgFixedSobel.type() << endl;
-		cout << imgMovedSobel.type() << endl;
-		cout << imgFixedSobel.channels() << endl;
-		cout << imgMovedSobel.channels() << endl;
-		cv::calcOpticalFlowPyrLK(imgFixedSobel, imgMovedSobel,
-			this->fixedPoints, // points which are supposed to be fixed
-			fixedPointsMoved,
-			optStatus,
-			optError,
-			cv::Size(61, 61),
-			3 /* max level */,
-			cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.001 /* eps */)) ; 
-			
-			
-			// find homography
-		cv::Mat hMat = cv::findHomography(fixedPointsMoved, this->fixedPoints, cv::noArray(), cv::RHO); 
-		// simplify hMat
-		//double c = 0.5 * (hMat.at<double>(0, 0) + hMat.at<double>(0, 0)); 
-		//double s = 0.5 * (hMat.at<double>(1, 0) - hMat.at<double>(0, 1));
-		//double theta = atan(s / c); 
-		//hMat.at<double>(0, 0) = cos(theta); hMat.at<double>(1, 1) = cos(theta);
-		//hMat.at<double>(1, 0) = sin(theta); hMat.at<double>(1, 0) = -sin(theta);
-		//hMat.at<double>(2, 0) = 0.0; hMat.at<double>(2, 1) = 0.0; hMat.at<double>(2, 2) = 1.0;
-
-//		cv::Mat hMat = cv::estimateRigidTransform(fixedPointsMoved, this->fixedPoints, false); 
-		// warp image 
-		cv::warpPerspective(this->imgMoved, this->imgMoved, hMat, imgOri.size());
-		return true;
+		cv::Mat hMat;
+		if (this->estimate(this->imgMoved, hMat) != 0)
+			return -1;
+		// warp image
+		cv::Mat imgCamMoveCorrected;
+		cv::warpPerspective(this->imgMoved, imgCamMoveCorrected, hMat, this->imgMoved.size());
+		this->imgMoved = imgCamMoveCorrected;
+		return 0;
 	}
 	return 0; 
 }
 
+void CamMoveCorrector::reset()
+{
+	this->cacheValid = false;
+	this->cacheFixedPoints.clear();
+	this->fixedRois.clear();
+	this->fixedPyrs.clear();
+	this->hPrev = cv::Mat();
+}
+
+int CamMoveCorrector::roiHalf() const
+{
+	if (this->roiHalfSize > 0)
+		return this->roiHalfSize;
+	// at the top level (scale 1 / 2^maxLevel) the region has to cover the window
+	// around the point after it moves by maxMotion
+	int scale = 1 << std::max(this->maxLevel, 0);
+	int winHalf = std::max(this->winSize.width, this->winSize.height) / 2 + 1;
+	return winHalf * scale + (int) std::ceil(std::max(this->maxMotion, 0.f));
+}
+
+// builds sobel pyramids of the regions around the fixed points (only after
+// reset(), or when fixedPoints or the optical flow parameters are changed)
+int CamMoveCorrector::buildCache()
+{
+	int half = this->roiHalf();
+	if (this->cacheValid &&
+		this->cacheFixedPoints == this->fixedPoints &&
+		this->cacheWinSize == this->winSize &&
+		this->cacheMaxLevel == this->maxLevel &&
+		this->cacheRoiHalf == half)
+		return 0;
+	cv::Mat hPrev = this->hPrev;
+	this->reset();
+	this->hPrev = hPrev; // previous transform is kept as the fixed image is the same
+	if (this->imgFixed.rows <= 0 || this->imgFixed.cols <= 0 || this->fixedPoints.size() <= 0)
+		return -1;
+	int nPoint = (int) this->fixedPoints.size();
+	cv::Rect full(0, 0, this->imgFixed.cols, this->imgFixed.rows);
+	this->fixedRois.resize(nPoint);
+	this->fixedPyrs.resize(nPoint);
+	for (int i = 0; i < nPoint; i++) {
+		cv::Point c((int)(this->fixedPoints[i].x + .5f), (int)(this->fixedPoints[i].y + .5f));
+		this->fixedRois[i] = cv::Rect(c.x - half, c.y - half, 2 * half + 1, 2 * half + 1) & full;
+		if (this->fixedRois[i].width <= 0 || this->fixedRois[i].height <= 0)
+			continue;
+		cv::buildOpticalFlowPyramid(sobel_xy(this->imgFixed, this->fixedRois[i]), this->fixedPyrs[i],
+			this->winSize, this->maxLevel);
+	}
+	this->cacheValid = true;
+	this->cacheFixedPoints = this->fixedPoints;
+	this->cacheWinSize = this->winSize;
+	this->cacheMaxLevel = this->maxLevel;
+	this->cacheRoiHalf = half;
+	return 0;
+}
+
+int CamMoveCorrector::estimate(const cv::Mat & img, cv::Mat & hMat, bool warm)
+{
+	if (this->hPrev.empty() || warm == false)
+		hMat = cv::Mat::eye(3, 3, CV_64F);
+	else
+		hMat = this->hPrev.clone();
+	if (this->buildCache() != 0 || img.rows <= 0 || img.cols <= 0) {
+		cerr << "CamMoveCorrector::estimate(): Fixed image, fixed points, or moved image is not set.\n";
+		return -1;
+	}
+	int nPoint = (int) this->fixedPoints.size();
+	int half = this->cacheRoiHalf;
+	cv::Rect full(0, 0, img.cols, img.rows);
+
+	// predicted positions of fixed points in the moved image (inverse of previous transform)
+	vector<cv::Point2f> predicted(nPoint);
+	cv::perspectiveTransform(this->fixedPoints, predicted, hMat.inv());
+
+	// track each point between its fixed region and its (predicted) moved region
+	this->movedPoints.assign(nPoint, cv::Point2f(std::nanf(""), std::nanf("")));
+	vector<uchar> valid(nPoint, 0);
+#pragma omp parallel for
+	for (int i = 0; i < nPoint; i++) {
+		if (this->fixedPyrs[i].size() == 0)
+			continue;
+		cv::Point c((int)(predicted[i].x + .5f), (int)(predicted[i].y + .5f));
+		cv::Rect movedRoi = cv::Rect(c.x - half, c.y - half, 2 * half + 1, 2 * half + 1) & full;
+		if (movedRoi.width <= this->winSize.width || movedRoi.height <= this->winSize.height)
+			continue;
+		vector<cv::Point2f> prevPts(1, this->fixedPoints[i] - cv::Point2f(this->fixedRois[i].tl()));
+		vector<cv::Point2f> nextPts(1, predicted[i] - cv::Point2f(movedRoi.tl()));
+		vector<uchar> optStatus(1);
+		vector<float> optError(1);
+		vector<cv::Mat> movedPyr;
+		cv::buildOpticalFlowPyramid(sobel_xy(img, movedRoi), movedPyr, this->winSize, this->maxLevel);
+		cv::calcOpticalFlowPyrLK(this->fixedPyrs[i], movedPyr,
+			prevPts, nextPts, optStatus, optError,
+			this->winSize,
+			this->maxLevel,
+			cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.001 /* eps */),
+			cv::OPTFLOW_USE_INITIAL_FLOW);
+		if (optStatus[0] == 0)
+			continue;
+		this->movedPoints[i] = nextPts[0] + cv::Point2f(movedRoi.tl());
+		valid[i] = 1;
+	}
+
+	// find homography
+	vector<cv::Point2f> src, dst;
+	for (int i = 0; i < nPoint; i++) {
+		if (valid[i] == 0) continue;
+		src.push_back(this->movedPoints[i]);
+		dst.push_back(this->fixedPoints[i]);
+	}
+	if (src.size() < 4) {
+		cerr << "CamMoveCorrector::estimate(): Only " << src.size() << " fixed points are tracked.\n";
+		return -2;
+	}
+	cv::Mat h = cv::findHomography(src, dst, cv::noArray(), cv::RHO);
+	if (h.rows != 3 || h.cols != 3) {
+		cerr << "CamMoveCorrector::estimate(): Cannot find homography.\n";
+		return -2;
+	}
+	h.convertTo(hMat, CV_64F);
+	this->hPrev = hMat.clone();
+	return 0;
+}
+
 
 
 
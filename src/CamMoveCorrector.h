@@ -4,23 +4,68 @@
 // CamMoveCorrector a;
 // a.imgFixed = imgInit;  // assign initial (unmoved) image
 // a.pickInitFixedPoint(6); //pick fixed points from ui, Or assign fixedPoints redirectly
-// a.fixedPoints.resize(6); a.fixedPoints[0] = ... ...; 
-// a.imgMoved = imgCurr.clone(); 
-// a.correctImgMoved(); 
-// imgCurr = a.imgMoved.clone(); 
+// a.fixedPoints.resize(6); a.fixedPoints[0] = ... ...;
+// a.imgMoved = imgCurr.clone();
+// a.correctImgMoved();
+// imgCurr = a.imgMoved.clone();
+//
+// or, if only the transform is needed (no warping of the full image):
+// cv::Mat hMat;
+// a.estimate(imgCurr, hMat);  // hMat maps imgCurr to imgFixed
+//
+// The sobel gradients and pyramids of the fixed image around the fixed points
+// are computed once. They are re-computed when fixedPoints, winSize, maxLevel,
+// or the region size change, or after reset(), which has to be called when
+// imgFixed (or its pixels) is changed.
+// For each moved image, only the regions around the fixed points (predicted by
+// the previous transform) are processed.
 
 class CamMoveCorrector
 {
 public:
+	CamMoveCorrector();
+
 	int pickInitFixedPoint(int numFixedPoints = 0);
 
 	int correctImgMoved(); // This function updates imgMoved, making it unmoved (which movedPoints moves to fixedPoints)
 
+	//! Estimates the transform of a moved image without warping it
+	/*!
+	\param img moved image
+	\param hMat output 3x3 homography (CV_64F) which maps img to imgFixed. If the estimation
+	fails, hMat is the transform of the previous image (or identity).
+	\param warm if true, search starts from the transform of the previous image
+	\return 0: success. -1: no fixed image or fixed points. -2: less than 4 fixed points are tracked.
+	*/
+	int estimate(const cv::Mat & img, cv::Mat & hMat, bool warm = true);
+
+	//! Clears the cache of fixed image and the previous transform. Call it after imgFixed is changed.
+	void reset();
+
+	//! Returns the half size of the regions around points (roiHalfSize, or if it is 0, the size that
+	//! fits the optical flow window at the top pyramid level moved by maxMotion)
+	int roiHalf() const;
+
 	std::vector<cv::Point2f> fixedPoints;
 	std::vector<cv::Point2f> movedPoints;
 
 	cv::Mat imgFixed;
-	cv::Mat imgMoved; 
-};
+	cv::Mat imgMoved;
+
+	cv::Size winSize;     // window size of optical flow (default: 61 x 61)
+	int maxLevel;         // max pyramid level of optical flow (default: 3)
+	int roiHalfSize;      // half size of region around each point that is processed (default: 0, given by roiHalf())
+	float maxMotion;      // expected motion (pixels) of a point from its predicted position (default: 50)
 
+private:
+	int buildCache();
 
+	bool cacheValid;                               // false after reset()
+	std::vector<cv::Point2f> cacheFixedPoints;     // fixedPoints of which cache is built
+	cv::Size cacheWinSize;                         // winSize of which cache is built
+	int cacheMaxLevel;                             // maxLevel of which cache is built
+	int cacheRoiHalf;                              // roiHalf() of which cache is built
+	std::vector<cv::Rect> fixedRois;               // regions around fixed points
+	std::vector<std::vector<cv::Mat> > fixedPyrs;  // pyramids of sobel of regions
+	cv::Mat hPrev;                                 // transform of previous image (moved --> fixed)
+};
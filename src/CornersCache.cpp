@@ -0,0 +1,150 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "CornersCache.h"
+
+using namespace std;
+
+static const char cornersCacheMagic[4] = { 'I', 'C', 'C', '2' };
+
+static void writeRecord(ofstream & ofs, const CornersCache::Entry & e)
+{
+	int nameLen = (int) e.name.length();
+	int vals[7] = { e.boardType, e.bSize.width, e.bSize.height, e.imgSize.width, e.imgSize.height,
+		e.found, (int) e.corners.size() };
+	ofs.write((const char *) &nameLen, sizeof(int));
+	ofs.write(e.name.c_str(), nameLen);
+	ofs.write((const char *) &e.fileSize, sizeof(long long));
+	ofs.write((const char *) &e.mtime, sizeof(long long));
+	ofs.write((const char *) vals, sizeof(vals));
+	if (e.corners.size() > 0)
+		ofs.write((const char *) e.corners.data(), e.corners.size() * sizeof(cv::Point2f));
+}
+
+static bool readRecord(ifstream & ifs, CornersCache::Entry & e)
+{
+	int nameLen = 0, vals[7];
+	if (!ifs.read((char *) &nameLen, sizeof(int)) || nameLen <= 0 || nameLen > 10000)
+		return false;
+	e.name.resize(nameLen);
+	if (!ifs.read(&e.name[0], nameLen) || !ifs.read((char *) &e.fileSize, sizeof(long long)) ||
+		!ifs.read((char *) &e.mtime, sizeof(long long)) ||
+		!ifs.read((char *) vals, sizeof(vals)) || vals[6] < 0 || vals[6] > 1000000)
+		return false;
+	e.boardType = vals[0];
+	e.bSize = cv::Size(vals[1], vals[2]);
+	e.imgSize = cv::Size(vals[3], vals[4]);
+	e.found = vals[5];
+	e.corners.resize(vals[6]);
+	if (vals[6] > 0 && !ifs.read((char *) e.corners.data(), vals[6] * sizeof(cv::Point2f)))
+		return false;
+	return true;
+}
+
+int CornersCache::open(std::string fname)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	this->fname = fname;
+	this->entries.clear();
+	// load complete records
+	bool complete = false;
+	ifstream ifs(fname, ios::binary);
+	if (ifs.is_open()) {
+		char magic[4] = { 0, 0, 0, 0 };
+		ifs.read(magic, 4);
+		if (ifs && memcmp(magic, cornersCacheMagic, 4) == 0) {
+			Entry e;
+			long long validEnd = 4; // end of the last complete record
+			while (readRecord(ifs, e)) {
+				this->entries[e.name] = e;
+				validEnd = (long long) ifs.tellg();
+			}
+			complete = (validEnd == fileSizeOf(fname));
+		}
+		ifs.close();
+	}
+	// new file, or rewrite it if it is not a cache file or its last record is truncated (interrupted)
+	if (complete == false) {
+		ofstream ofs(fname, ios::binary | ios::trunc);
+		if (ofs.is_open() == false) {
+			cerr << "CornersCache::open(): Cannot open " << fname << endl;
+			return -1;
+		}
+		ofs.write(cornersCacheMagic, 4);
+		for (map<string, Entry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+			writeRecord(ofs, it->second);
+	}
+	return (int) this->entries.size();
+}
+
+bool CornersCache::find(const std::string & name, long long fileSize, long long mtime, int boardType, cv::Size bSize, Entry & e) const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	map<string, Entry>::const_iterator it = this->entries.find(name);
+	if (it == this->entries.end())
+		return false;
+	if (it->second.fileSize != fileSize || it->second.mtime != mtime ||
+		it->second.boardType != boardType || it->second.bSize != bSize)
+		return false;
+	e = it->second;
+	return true;
+}
+
+int CornersCache::append(const Entry & e)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (this->fname.length() <= 0)
+		return -1;
+	ofstream ofs(this->fname, ios::binary | ios::app);
+	if (ofs.is_open() == false) {
+		cerr << "CornersCache::append(): Cannot open " << this->fname << endl;
+		return -1;
+	}
+	writeRecord(ofs, e);
+	ofs.close();
+	this->entries[e.name] = e;
+	return 0;
+}
+
+std::shared_ptr<CornersCache> CornersCache::shared(std::string fname)
+{
+	// caches in use (a cache is reloaded from its file when nobody uses it any more)
+	static std::mutex mtxShared;
+	static map<string, std::weak_ptr<CornersCache> > caches;
+	string key = fname;
+	std::replace(key.begin(), key.end(), '\\', '/');
+	std::lock_guard<std::mutex> lock(mtxShared);
+	std::shared_ptr<CornersCache> cache = caches[key].lock();
+	if (cache)
+		return cache;
+	cache = std::make_shared<CornersCache>();
+	if (cache->open(fname) < 0)
+		return std::shared_ptr<CornersCache>();
+	caches[key] = cache;
+	return cache;
+}
+
+long long CornersCache::fileSizeOf(std::string fname)
+{
+	ifstream ifs(fname, ios::binary | ios::ate);
+	if (ifs.is_open() == false)
+		return -1;
+	return (long long) ifs.tellg();
+}
+
+long long CornersCache::fileMTimeOf(std::string fname)
+{
+#if defined(_WIN32)
+	struct _stat64 st;
+	if (_stat64(fname.c_str(), &st) != 0)
+		return -1;
+#else
+	struct stat st;
+	if (stat(fname.c_str(), &st) != 0)
+		return -1;
+#endif
+	return (long long) st.st_mtime;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <opencv2/core.hpp>
+
+// CornersCache is a binary sidecar file of calibration board corners found in
+// photos (one file for a set of photos, instead of one _corners.xml per photo).
+// Records are appended and flushed one by one, so an interrupted corner search
+// resumes from where it stopped (a truncated last record is ignored). Failed
+// photos are also recorded so that they are not searched again. A record is
+// used only if the photo file size, modification time, board type and board
+// size are the same.
+// Calibrators working on the same sidecar file at the same time (e.g., two
+// cameras with photos in one directory) should share one CornersCache, given
+// by shared(), so that their appends do not interleave in the file.
+//
+// std::shared_ptr<CornersCache> cache = CornersCache::shared("c:/calib/cornersCache.bin");
+// CornersCache::Entry e;
+// if (cache->find("IMG_0001.JPG", fileSize, mtime, boardType, bSize, e) == false) {
+//     ... find corners, set e ...
+//     cache->append(e);
+// }
+
+class CornersCache
+{
+public:
+	struct Entry {
+		std::string name;            // file name (without directory)
+		long long fileSize;          // file size (bytes) of the photo
+		long long mtime;             // modification time (sec. since 1970) of the photo
+		int boardType;               // 1:chessboard, 2.grid(sym), 3.grid(unsym)
+		cv::Size bSize;              // board size (number of points along width and height)
+		cv::Size imgSize;            // image size of the photo
+		int found;                   // 1: corners found. 0: not found
+		std::vector<cv::Point2f> corners;
+	};
+
+	//! Loads records of a sidecar file (creates it if it does not exist)
+	/*!
+	\param fname full path of the sidecar file
+	\return number of records loaded, or -1 if the file cannot be opened for appending
+	*/
+	int open(std::string fname);
+
+	//! Finds a record of a photo. Thread safe.
+	/*!
+	\return true if a record of the same file size, modification time, board type and size is found (and copied to e)
+	*/
+	bool find(const std::string & name, long long fileSize, long long mtime, int boardType, cv::Size bSize, Entry & e) const;
+
+	//! Appends a record to the sidecar file (flushed immediately). Thread safe.
+	int append(const Entry & e);
+
+	//! Returns the cache of a sidecar file shared by all users in this process (opened at first use). Thread safe.
+	/*!
+	\return the shared cache, or an empty pointer if the file cannot be opened
+	*/
+	static std::shared_ptr<CornersCache> shared(std::string fname);
+
+	//! Returns size of a file in bytes, or -1 if it cannot be opened
+	static long long fileSizeOf(std::string fname);
+
+	//! Returns modification time of a file (sec. since 1970), or -1 if it cannot be read
+	static long long fileMTimeOf(std::string fname);
+
+private:
+	std::string fname;
+	std::map<std::string, Entry> entries;  // the last record of each file name
+	mutable std::mutex mtx;
+};
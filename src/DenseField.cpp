@@ -0,0 +1,246 @@
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+#include "impro_util.h"
+#include "DenseField.h"
+
+using namespace std;
+
+int q4MeshDenseField(const std::vector<cv::Point2f> & meshPoints, const std::vector<cv::Point2f> & meshDisp,
+	int n12, int n23, cv::Size imgSize, int gridStep,
+	cv::Mat & u, cv::Mat & exx, cv::Mat & eyy, cv::Mat & exy, cv::Mat & mask)
+{
+	// check
+	if (n12 < 2 || n23 < 2 || (int)meshPoints.size() != n12 * n23 || meshDisp.size() != meshPoints.size() ||
+		imgSize.width <= 0 || imgSize.height <= 0 || gridStep < 1)
+	{
+		cerr << "q4MeshDenseField: Invalid arguments. Mesh needs n12 x n23 (at least 2 x 2) points and displacements.\n";
+		return -1;
+	}
+	cv::Size fieldSize((imgSize.width + gridStep - 1) / gridStep, (imgSize.height + gridStep - 1) / gridStep);
+	u = cv::Mat::zeros(fieldSize, CV_32FC2);
+	exx = cv::Mat::zeros(fieldSize, CV_32F);
+	eyy = cv::Mat::zeros(fieldSize, CV_32F);
+	exy = cv::Mat::zeros(fieldSize, CV_32F);
+	mask = cv::Mat::zeros(fieldSize, CV_8U);
+
+	// bucket cells by the field rows they cover, so that each row is rasterized by one thread
+	int nCell = (n12 - 1) * (n23 - 1);
+	vector<vector<int> > rowCells(fieldSize.height);
+	for (int iCell = 0; iCell < nCell; iCell++) {
+		int i = iCell / (n12 - 1), j = iCell % (n12 - 1);
+		int c[4] = { j + i * n12, j + 1 + i * n12, j + 1 + (i + 1) * n12, j + (i + 1) * n12 };
+		float ymin = 1e30f, ymax = -1e30f;
+		bool valid = true;
+		for (int k = 0; k < 4; k++) {
+			if (std::isnan(meshDisp[c[k]].x) || std::isnan(meshDisp[c[k]].y) || std::isnan(meshPoints[c[k]].y))
+				valid = false;
+			ymin = std::min(ymin, meshPoints[c[k]].y);
+			ymax = std::max(ymax, meshPoints[c[k]].y);
+		}
+		if (valid == false) continue;
+		int r0 = std::max(0, (int)ceil(ymin / gridStep));
+		int r1 = std::min(fieldSize.height - 1, (int)floor(ymax / gridStep));
+		for (int r = r0; r <= r1; r++)
+			rowCells[r].push_back(iCell);
+	}
+
+#pragma omp parallel for schedule(dynamic)
+	for (int r = 0; r < fieldSize.height; r++)
+	{
+		double y = (double)r * gridStep;
+		for (size_t k = 0; k < rowCells[r].size(); k++)
+		{
+			int iCell = rowCells[r][k];
+			int i = iCell / (n12 - 1), j = iCell % (n12 - 1);
+			int c[4] = { j + i * n12, j + 1 + i * n12, j + 1 + (i + 1) * n12, j + (i + 1) * n12 };
+			cv::Point2d p[4], d[4];
+			double xmin = 1e30, xmax = -1e30;
+			for (int m = 0; m < 4; m++) {
+				p[m] = cv::Point2d(meshPoints[c[m]].x, meshPoints[c[m]].y);
+				d[m] = cv::Point2d(meshDisp[c[m]].x, meshDisp[c[m]].y);
+				xmin = std::min(xmin, p[m].x);
+				xmax = std::max(xmax, p[m].x);
+			}
+			int c0 = std::max(0, (int)ceil(xmin / gridStep));
+			int c1 = std::min(fieldSize.width - 1, (int)floor(xmax / gridStep));
+			double xi = .5, eta = .5;
+			for (int col = c0; col <= c1; col++)
+			{
+				double x = (double)col * gridStep;
+				// inverse bilinear map by Newton's method. The previous sample of the row is the initial guess.
+				// x(xi, eta) = p0 (1-xi)(1-eta) + p1 xi (1-eta) + p2 xi eta + p3 (1-xi) eta
+				cv::Point2d dxdxi, dxdeta;
+				bool converged = false;
+				for (int iter = 0; iter < 10; iter++) {
+					cv::Point2d xe = p[0] * (1 - xi) * (1 - eta) + p[1] * xi * (1 - eta) + p[2] * xi * eta + p[3] * (1 - xi) * eta;
+					dxdxi = (p[1] - p[0]) * (1 - eta) + (p[2] - p[3]) * eta;
+					dxdeta = (p[3] - p[0]) * (1 - xi) + (p[2] - p[1]) * xi;
+					double det = dxdxi.x * dxdeta.y - dxdeta.x * dxdxi.y;
+					if (fabs(det) < 1e-12) break;
+					double rx = x - xe.x, ry = y - xe.y;
+					double dxi = (dxdeta.y * rx - dxdeta.x * ry) / det;
+					double deta = (-dxdxi.y * rx + dxdxi.x * ry) / det;
+					xi += dxi; eta += deta;
+					if (fabs(dxi) + fabs(deta) < 1e-7) { converged = true; break; }
+				}
+				const double tol = 1e-6;
+				if (converged == false || xi < -tol || xi > 1 + tol || eta < -tol || eta > 1 + tol) {
+					xi = .5; eta = .5;
+					continue;
+				}
+				// displacement by shape functions
+				cv::Point2d uu = d[0] * (1 - xi) * (1 - eta) + d[1] * xi * (1 - eta) + d[2] * xi * eta + d[3] * (1 - xi) * eta;
+				// strain: [du/dx du/dy] = [du/dxi du/deta] J^-1
+				cv::Point2d dudxi = (d[1] - d[0]) * (1 - eta) + (d[2] - d[3]) * eta;
+				cv::Point2d dudeta = (d[3] - d[0]) * (1 - xi) + (d[2] - d[1]) * xi;
+				dxdxi = (p[1] - p[0]) * (1 - eta) + (p[2] - p[3]) * eta;
+				dxdeta = (p[3] - p[0]) * (1 - xi) + (p[2] - p[1]) * xi;
+				double det = dxdxi.x * dxdeta.y - dxdeta.x * dxdxi.y;
+				// J = [dx/dxi dx/deta; dy/dxi dy/deta], J^-1 = [dxi/dx dxi/dy; deta/dx deta/dy]
+				double dxidx = dxdeta.y / det, dxidy = -dxdeta.x / det;
+				double detadx = -dxdxi.y / det, detady = dxdxi.x / det;
+				double duxdx = dudxi.x * dxidx + dudeta.x * detadx;
+				double duxdy = dudxi.x * dxidy + dudeta.x * detady;
+				double duydx = dudxi.y * dxidx + dudeta.y * detadx;
+				double duydy = dudxi.y * dxidy + dudeta.y * detady;
+				u.at<cv::Point2f>(r, col) = cv::Point2f((float)uu.x, (float)uu.y);
+				exx.at<float>(r, col) = (float)duxdx;
+				eyy.at<float>(r, col) = (float)duydy;
+				exy.at<float>(r, col) = (float)(duxdy + duydx);
+				mask.at<uchar>(r, col) = 255;
+			}
+		}
+	}
+	return 0;
+}
+
+// max, min, average, and standard deviation of a CV_32F field (of masked samples)
+static void denseFieldStats(const cv::Mat & f, const cv::Mat & mask,
+	float & vmax, float & vmin, float & vavg, float & vstd)
+{
+	double sum = 0., s2 = 0.;
+	int n = 0;
+	vmax = -1e30f; vmin = 1e30f;
+	for (int i = 0; i < f.rows; i++) {
+		for (int j = 0; j < f.cols; j++) {
+			if (mask.empty() == false && mask.at<uchar>(i, j) == 0) continue;
+			float v = f.at<float>(i, j);
+			sum += v; s2 += v * v; n++;
+			if (v > vmax) vmax = v;
+			if (v < vmin) vmin = v;
+		}
+	}
+	if (n == 0) { vmax = vmin = vavg = vstd = 0.f; return; }
+	vavg = (float)(sum / n);
+	vstd = (float)sqrt(std::max(0., s2 / n - (sum / n) * (sum / n)));
+}
+
+// field to image in jet-256 colormap (red: cmax, blue: cmin, gray: outside mask)
+static cv::Mat denseFieldJet(const cv::Mat & f, const cv::Mat & mask, float cmin, float cmax)
+{
+	cv::Mat img(f.rows, f.cols, CV_8UC3);
+	for (int i = 0; i < f.rows; i++) {
+		for (int j = 0; j < f.cols; j++) {
+			if (mask.empty() == false && mask.at<uchar>(i, j) == 0) {
+				img.at<cv::Vec3b>(i, j) = cv::Vec3b(128, 128, 128);
+				continue;
+			}
+			int v256_i = (int)(255 * ((f.at<float>(i, j) - cmin) / (cmax - cmin)) + .5f);
+			unsigned char v256 = min(255, max(0, v256_i));
+			for (int ch = 0; ch < 3; ch++)
+				img.at<cv::Vec3b>(i, j).val[ch] = jet_bgr[v256][ch];
+		}
+	}
+	char buf[1000];
+	snprintf(buf, 1000, "Max(red)/Min(blue): %12.4e %12.4e", cmax, cmin);
+	cv::putText(img, buf, cv::Point(100, 100), 0, 3, cv::Scalar(0, 0, 0), 2);
+	return img;
+}
+
+static void denseFieldWriteM(FILE * fm, const char * name, const cv::Mat & f)
+{
+	fprintf(fm, "%s=[", name);
+	for (int i = 0; i < f.rows; i++) {
+		for (int j = 0; j < f.cols; j++)
+			fprintf(fm, "%11.4f ", f.at<float>(i, j));
+		fprintf(fm, ";");
+	}
+	fprintf(fm, "];\n");
+}
+
+int writeDenseFieldResults(const cv::Mat & u, const cv::Mat & exx, const cv::Mat & eyy, const cv::Mat & exy,
+	const std::string & fnamePrefix, const cv::Mat & mask)
+{
+	if (u.empty() || u.type() != CV_32FC2 || exx.size() != u.size() || eyy.size() != u.size() || exy.size() != u.size() ||
+		(mask.empty() == false && mask.size() != u.size()))
+	{
+		cerr << "writeDenseFieldResults: Fields need to be CV_32FC2 (u) and CV_32F (strains) of the same size.\n";
+		return -1;
+	}
+	cv::Mat uxy[2], crack_opening, crack_sliding;
+	cv::split(u, uxy);
+	float vmax[2], vmin[2], vavg[2], vstd[2];
+
+	// displacement
+	for (int k = 0; k < 2; k++)
+		denseFieldStats(uxy[k], mask, vmax[k], vmin[k], vavg[k], vstd[k]);
+	printf("  Ux/Uy max are: %12.4e %12.4e\n", vmax[0], vmax[1]);
+	printf("  Ux/Uy min are: %12.4e %12.4e\n", vmin[0], vmin[1]);
+	printf("  Ux/Uy avg are: %12.4e %12.4e\n", vavg[0], vavg[1]);
+	printf("  Ux/Uy std are: %12.4e %12.4e\n", vstd[0], vstd[1]);
+	cv::imwrite(fnamePrefix + "_result_ux.JPG", denseFieldJet(uxy[0], mask, -.5f, .5f));
+	cv::imwrite(fnamePrefix + "_result_uy.JPG", denseFieldJet(uxy[1], mask, -.5f, .5f));
+
+	// strain
+	float smax[3], smin[3], savg[3], sstd[3];
+	denseFieldStats(exx, mask, smax[0], smin[0], savg[0], sstd[0]);
+	denseFieldStats(eyy, mask, smax[1], smin[1], savg[1], sstd[1]);
+	denseFieldStats(exy, mask, smax[2], smin[2], savg[2], sstd[2]);
+	printf("  Exx/Eyy/Exy max are: %12.4e %12.4e %12.4e\n", smax[0], smax[1], smax[2]);
+	printf("  Exx/Eyy/Exy min are: %12.4e %12.4e %12.4e\n", smin[0], smin[1], smin[2]);
+	printf("  Exx/Eyy/Exy avg are: %12.4e %12.4e %12.4e\n", savg[0], savg[1], savg[2]);
+	printf("  Exx/Eyy/Exy std are: %12.4e %12.4e %12.4e\n", sstd[0], sstd[1], sstd[2]);
+	cv::imwrite(fnamePrefix + "_result_exx.JPG", denseFieldJet(exx, mask, -.005f, .005f));
+	cv::imwrite(fnamePrefix + "_result_eyy.JPG", denseFieldJet(eyy, mask, -.005f, .005f));
+	cv::imwrite(fnamePrefix + "_result_exy.JPG", denseFieldJet(exy, mask, -.005f, .005f));
+
+	// crack
+	uToCrack(u, crack_opening, crack_sliding, 999);
+	denseFieldStats(crack_opening, mask, vmax[0], vmin[0], vavg[0], vstd[0]);
+	denseFieldStats(crack_sliding, mask, vmax[1], vmin[1], vavg[1], vstd[1]);
+	printf("  Opn/Sld max are: %12.4e %12.4e\n", vmax[0], vmax[1]);
+	printf("  Opn/Sld min are: %12.4e %12.4e\n", vmin[0], vmin[1]);
+	printf("  Opn/Sld avg are: %12.4e %12.4e\n", vavg[0], vavg[1]);
+	printf("  Opn/Sld std are: %12.4e %12.4e\n", vstd[0], vstd[1]);
+	cv::imwrite(fnamePrefix + "_result_cr_opn.JPG", denseFieldJet(crack_opening, mask, -.1f, .1f));
+	cv::imwrite(fnamePrefix + "_result_cr_sld.JPG", denseFieldJet(crack_sliding, mask, -.1f, .1f));
+
+	// write fields to files (_ux.m, _uy.m, _cr_opn.m, _cr_sld.m, _exx.m, _eyy.m, _exy.m)
+	string fields_m_fname = fnamePrefix + "_result_fields.m";
+	FILE * if_fields_m;
+	int if_fields_ok = fopen_s(&if_fields_m, fields_m_fname.c_str(), "w");
+	if (if_fields_ok == 0) {
+		denseFieldWriteM(if_fields_m, "ux", uxy[0]);
+		denseFieldWriteM(if_fields_m, "uy", uxy[1]);
+		denseFieldWriteM(if_fields_m, "opn", crack_opening);
+		denseFieldWriteM(if_fields_m, "sld", crack_sliding);
+		denseFieldWriteM(if_fields_m, "exx", exx);
+		denseFieldWriteM(if_fields_m, "eyy", eyy);
+		denseFieldWriteM(if_fields_m, "exy", exy);
+		fprintf(if_fields_m, "figure('name','ux '); imagesc(ux ); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','uy '); imagesc(uy ); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','opn'); imagesc(opn); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','sld'); imagesc(sld); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','exx'); imagesc(exx); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','eyy'); imagesc(eyy); colormap('jet'); axis image; colorbar;\n");
+		fprintf(if_fields_m, "figure('name','exy'); imagesc(exy); colormap('jet'); axis image; colorbar;\n");
+		fclose(if_fields_m);
+	}
+	else
+		cerr << "writeDenseFieldResults: Cannot write " << fields_m_fname << endl;
+	return 0;
+}
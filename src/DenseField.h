@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Dense (full-field) displacement and strain maps.
+//
+// q4MeshDenseField() reconstructs a dense field from the displacements of a
+// tracked Q4 mesh (points ordered as interpQ4(), i.e., j + i * n12), which is
+// much cheaper than dense optical flow. Each mesh cell is rasterized with
+// bilinear (Q4) shape functions, the local coordinates of every grid sample
+// are found by inverse mapping (Newton), and the strains are the derivatives
+// of the shape functions (no finite difference across cell edges).
+// Grid rows are rasterized in parallel.
+//
+// writeDenseFieldResults() writes a field in the same outputs as the dense
+// optical flow analysis (optflow): statistics, jet-colormap images
+// (_result_ux/uy/exx/eyy/exy/cr_opn/cr_sld.JPG) and a matlab script
+// (_result_fields.m).
+//
+// cv::Mat u, exx, eyy, exy, mask;
+// q4MeshDenseField(refPoints, disp, 40, 30, imgSize, 4, u, exx, eyy, exy, mask);
+// writeDenseFieldResults(u, exx, eyy, exy, "c:/test/Step_0005", mask);
+
+//! Reconstructs dense displacement and strain fields from displacements of a Q4 mesh
+/*!
+\param meshPoints positions of mesh points in the reference (initial) image. n12 * n23 points,
+       point (i, j) is meshPoints[j + i * n12] (the order of interpQ4()).
+\param meshDisp displacements of mesh points (pixel, image coordinate). Same size as meshPoints.
+       Points of NaN displacement make their cells excluded.
+\param n12 number of mesh points along point-1 and point-2
+\param n23 number of mesh points along point-2 and point-3
+\param imgSize size of the reference image
+\param gridStep distance (pixel) between field samples. Sample (r, c) is at image point (c * gridStep, r * gridStep).
+\param u displacement field (CV_32FC2, pixel), sized ceil(imgSize / gridStep). Zero outside the mesh.
+\param exx strain field exx (CV_32F). Zero outside the mesh.
+\param eyy strain field eyy (CV_32F). Zero outside the mesh.
+\param exy strain field exy (CV_32F, engineering shear strain, as uToStrain()). Zero outside the mesh.
+\param mask 255 for samples within the mesh, 0 otherwise (CV_8U)
+\return 0: success. -1: invalid arguments.
+*/
+int q4MeshDenseField(const std::vector<cv::Point2f> & meshPoints, const std::vector<cv::Point2f> & meshDisp,
+	int n12, int n23, cv::Size imgSize, int gridStep,
+	cv::Mat & u, cv::Mat & exx, cv::Mat & eyy, cv::Mat & exy, cv::Mat & mask);
+
+//! Writes displacement and strain fields (statistics, colormap images, and matlab script)
+/*!
+\details Crack opening/sliding fields are calculated by uToCrack().
+\param u displacement field (CV_32FC2)
+\param exx strain field exx (CV_32F)
+\param eyy strain field eyy (CV_32F)
+\param exy strain field exy (CV_32F)
+\param fnamePrefix full path prefix of output files, e.g., "c:/test/IMG_0005" for "c:/test/IMG_0005_result_ux.JPG"
+\param mask if not empty (CV_8U), statistics only count non-zero samples and other samples are gray in images
+\return 0: success. -1: invalid fields.
+*/
+int writeDenseFieldResults(const cv::Mat & u, const cv::Mat & exx, const cv::Mat & eyy, const cv::Mat & exy,
+	const std::string & fnamePrefix, const cv::Mat & mask = cv::Mat());
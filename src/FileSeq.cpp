@@ -9,6 +9,8 @@
 #include <filesystem>
 
 #include "impro_util.h"
+#include "AsyncLog.h"
+#include "FrameBus.h"
 
 using namespace std;
 namespace fs = std::experimental::filesystem; // In C++11 filesystem is under experimental
@@ -158,7 +160,7 @@ int FileSeq::setFilesByListFile(std::string fileListFile)
 	flist.open(fileListFile);
 	if (flist.is_open() == false) {
 		this->log("Error in setFileListByListFile(): Cannot open file-list file: " 
-			+ fileListFile); 
+			+ fileListFile, ALOG_ERROR); 
 		return -1;
 	}
 	// path
@@ -357,7 +359,7 @@ std::string FileSeq::filename(int idx) const
 {
 	if (idx >= 0 && idx < (int) this->filenames.size())
 		return this->filenames[idx];
-	this->log("Error: from FileSeq::filename: Wrong idx: " + to_string(idx)); 
+	this->log("Error: from FileSeq::filename: Wrong idx: " + to_string(idx), ALOG_ERROR); 
 	std::cerr << "Error from FileSeq::filename: "
 			<< "Wrong idx : " << idx << "\n";
 	return std::string("");
@@ -389,7 +391,7 @@ int FileSeq::waitForFile(int idx, int waitTimeEach, int maxTotalWait)
 	// Check arguments
 	if (idx >= this->num_files())
 	{
-		this->log("Error: from FileSeq::waitForFile: Wrong idx: " + to_string(idx));
+		this->log("Error: from FileSeq::waitForFile: Wrong idx: " + to_string(idx), ALOG_ERROR);
 		std::cerr << "Error from FileSeq::waitForFile: " 
 			<< "Wrong idx: " << idx << ". \n";
 		return -1;
@@ -397,7 +399,7 @@ int FileSeq::waitForFile(int idx, int waitTimeEach, int maxTotalWait)
 	if (waitTimeEach < 1)
 	{
 		this->log("Warning from FileSeq::waitForFile: waitTimeEach of a non-positive " 
-			+ std::string("value means waiting forever.")); 
+			+ std::string("value means waiting forever."), ALOG_WARN); 
 		std::cerr << "Warning from FileSeq::waitForFile: "
 			<< "waitTimeEach of a non-positive value means waiting forever.\n";
 	}
@@ -417,7 +419,7 @@ int FileSeq::waitForFile(int idx, int waitTimeEach, int maxTotalWait)
 			if (maxTotalWait >= 0 && waitCount * waitTimeEach >= maxTotalWait)
 			{ // give up waiting
 				this->log("Warning from FileSeq::waitForFile: Gave up waiting file index " +
-					to_string(idx) + ": " + this->filename(idx)); 
+					to_string(idx) + ": " + this->filename(idx), ALOG_WARN); 
 				std::cerr << "Warning from FileSeq::waitForFile: "
 					<< "Gave up waiting file index " << idx << ".\n";
 				// 1. refresh number of files
@@ -448,7 +450,7 @@ int FileSeq::waitForFile(int idx, int waitTimeEach, int maxTotalWait)
 					this->log("Warning from FileSeq::waitForFile: "
 						+ std::string("File ") + to_string(lastCanReadFile) +
 						" is found while you are still waiting for file "
-						+ to_string(idx) + ": " + this->filename(idx));
+						+ to_string(idx) + ": " + this->filename(idx), ALOG_WARN);
 					std::cerr << "Warning from FileSeq::waitForFile: "
 						<< "File " << lastCanReadFile << " is found while you are "
 						<< "still waiting for file " << idx << endl;
@@ -470,7 +472,7 @@ int FileSeq::waitForImageFile(int idx, cv::Mat & img, int imread_flag,
 	// Check arguments
 	if (idx >= this->num_files())
 	{
-		this->log("Error: from FileSeq::waitForImageFile: Wrong idx: " + to_string(idx));
+		this->log("Error: from FileSeq::waitForImageFile: Wrong idx: " + to_string(idx), ALOG_ERROR);
 		std::cerr << "Error from FileSeq::waitForImageFile: "
 			<< "Wrong idx: " << idx << ". \n";
 		return -1;
@@ -478,17 +480,27 @@ int FileSeq::waitForImageFile(int idx, cv::Mat & img, int imread_flag,
 	if (waitTimeEach < 1)
 	{
 		this->log("Warning from FileSeq::waitForImageFile: waitTimeEach of a non-positive "
-			+ std::string("value means waiting forever."));
+			+ std::string("value means waiting forever."), ALOG_WARN);
 		std::cerr << "Warning from FileSeq::waitForImageFile: "
 			<< "waitTimeEach of a non-positive value means waiting forever.\n";
 	}
 
+	// frame bus of environment variable (if it is set and the bus exists)
+	if (!this->frameBus) {
+		std::string busName = FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_IN");
+		if (busName.length() > 0)
+			this->setFrameBus(busName);
+	}
+
 	// 
 	int waitCount = 0;
 	int checkLaterFileExisting = 1;
 	int checkEndOfFileSeq = 1;
 	while (true)
 	{
+		// try to get the decoded image from the frame bus
+		if (this->frameBus && this->frameBus->read(this->fullPathOfFile(idx), img, imread_flag) == 0)
+			break;
 		// try to open the file
 		if (this->canRead(idx)) {
 			img = cv::imread(this->fullPathOfFile(idx), imread_flag); 
@@ -501,7 +513,7 @@ int FileSeq::waitForImageFile(int idx, cv::Mat & img, int imread_flag,
 			if (maxTotalWait >= 0 && waitCount * waitTimeEach >= maxTotalWait)
 			{ // give up waiting
 				this->log("Warning from FileSeq::waitForFile: Gave up waiting file index " +
-					to_string(idx) + ": " + this->filename(idx));
+					to_string(idx) + ": " + this->filename(idx), ALOG_WARN);
 				std::cerr << "Warning from FileSeq::waitForFile: "
 					<< "Gave up waiting file index " << idx << ".\n";
 				// 1. refresh number of files
@@ -532,7 +544,7 @@ int FileSeq::waitForImageFile(int idx, cv::Mat & img, int imread_flag,
 					this->log("Warning from FileSeq::waitForFile: "
 						+ std::string("File ") + to_string(lastCanReadFile) +
 						" is found while you are still waiting for file "
-						+ to_string(idx) + ": " + this->filename(idx));
+						+ to_string(idx) + ": " + this->filename(idx), ALOG_WARN);
 					std::cerr << "Warning from FileSeq::waitForFile: "
 						<< "File " << lastCanReadFile << " is found while you are "
 						<< "still waiting for file " << idx << endl;
@@ -548,6 +560,19 @@ int FileSeq::waitForImageFile(int idx, cv::Mat & img, int imread_flag,
 	return 0;
 }
 
+int FileSeq::setFrameBus(std::string busName)
+{
+	this->frameBus.reset();
+	if (busName.length() <= 0)
+		return 0;
+	std::shared_ptr<FrameBus> bus = std::make_shared<FrameBus>();
+	if (bus->open(busName) != 0)
+		return -1;
+	this->frameBus = bus;
+	this->log("Subscribed to frame bus " + busName);
+	return 0;
+}
+
 
 int FileSeq::findLastCanReadFile() const
 {
@@ -581,22 +606,14 @@ int FileSeq::generateFileList(std::string fileListFile)
 	return 0;
 }
 
-int FileSeq::log(std::string msg) const 
+int FileSeq::log(std::string msg, int level) const 
 {
 	// Log file is located in the working directory.
 	// If the working directory (theDir) is not defined yet, logging will not 
 	// be carried out. 
+	// The message is buffered and written by the background thread of AsyncLog,
+	// so that logging does not block the caller on file I/O.
 	if (this->theDir.length() <= 1) return -1; 
-	ofstream logFile(this->theDir + this->logFilename, std::ios_base::app); 
-	if (logFile.is_open()) {
-		std::time_t t = std::time(0);
-		std::tm* now = std::localtime(&t);
-		char logTime[100];
-		snprintf(logTime, 100, " (%4d-%02d-%02d %02d:%02d:%02d)",
-			now->tm_year + 1900, now->tm_mon + 1, now->tm_mday,
-			now->tm_hour, now->tm_min, now->tm_sec);
-		logFile << msg << logTime << endl;
-		logFile.close(); 
-	}
+	AsyncLog::instance().write(this->theDir + this->logFilename, msg, level);
 	return 0;
 }
@@ -5,8 +5,12 @@
 #include <vector>
 #include <cstring>
 #include <cstdlib>
+#include <memory>
 
 #include <opencv2/opencv.hpp> // for cv::imread
+#include "AsyncLog.h"
+
+class FrameBus;
 
 using namespace std;
 
@@ -246,6 +250,8 @@ public:
 	\param waitTimeEach waiting time (in ms) between each check
 	\param maxTotalWait maximum waiting time (in ms) before giving up.
 	mxs being < 0 indicates waiting without giving up.
+	If a frame bus is set (see setFrameBus()), the image is taken from the bus if
+	it is there, without waiting for or reading the file.
 	\see FileSeq::checkEndOfFiles()
 	\return 0: the file can be read. -1: time-out. -2: a signal of end of FileSeq is found.
 	The "end-of-FileSeq" signal indicates that no more files will be added. The number
@@ -255,6 +261,16 @@ public:
 	int waitForImageFile(int idx, cv::Mat & img, int imread_flag = cv::IMREAD_COLOR, 
 		int waitTimeEach = 50, int maxTotalWait = 86400 * 1000);
 
+	//! Subscribes to a frame bus (shared memory of decoded frames published by another process)
+	/*!
+	\details waitForImageFile() looks up the bus (by file name) before reading the file.
+	If no bus is set, waitForImageFile() subscribes to the bus named by environment
+	variable IMPRO_FRAME_BUS_IN (if it is set). See FrameBus.
+	\param busName name of the bus. Empty string to unsubscribe.
+	\return 0: subscribed. -1: the bus does not exist (yet).
+	*/
+	int setFrameBus(std::string busName);
+
 	
 	//! Returns the index of the last file.
 	/*! For example, if there are files 0, 1, 2, 3, 9, the
@@ -280,10 +296,11 @@ public:
 	*/
 	int generateFileList(std::string fileListFile);
 
-	//! Writes string to log file
+	//! Writes string to log file (buffered, written by a background thread, see AsyncLog)
 	/*!
+	\param level ALOG_DEBUG, ALOG_INFO, ALOG_WARN, or ALOG_ERROR (defined in AsyncLog.h)
 	*/
-	int log(std::string) const; 
+	int log(std::string, int level = ALOG_INFO) const;
 
 
 
@@ -292,4 +309,6 @@ protected:
 	std::vector<std::string> filenames; 
 
 	std::string logFilename; 
+
+	std::shared_ptr<FrameBus> frameBus;   // shared by copies of this FileSeq
 };
\ No newline at end of file
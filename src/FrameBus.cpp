@@ -0,0 +1,422 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "FrameBus.h"
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "FrameBus needs lock-free 64-bit atomics in shared memory");
+
+static const char frameBusMagic[8] = { 'I', 'M', 'P', 'R', 'O', 'F', 'B', '2' };
+static const int frameBusMaxName = 1024;
+
+// Layout of the shared memory: header, nSlot slot headers, nSlot slot data
+struct FrameBusHeader {
+	char magic[8];                       // written last when the bus is created
+	int nSlot;
+	int reserved;
+	long long slotBytes;                 // capacity (bytes) of each slot data
+	std::atomic<long long> nPublished;   // number of published frames
+};
+
+struct FrameBusSlot {
+	std::atomic<long long> seq;          // odd while the slot is being written
+	long long frameNo;                   // publish count of the frame
+	int rows, cols, type, nameLen;
+	char name[frameBusMaxName];
+};
+
+static long long frameBusAlign(long long n)
+{
+	return (n + 63) / 64 * 64;
+}
+
+static long long frameBusSlotsOffset()
+{
+	return frameBusAlign((long long) sizeof(FrameBusHeader));
+}
+
+static long long frameBusDataOffset(int nSlot)
+{
+	return frameBusSlotsOffset() + frameBusAlign((long long) sizeof(FrameBusSlot) * nSlot);
+}
+
+// full path of a frame as it is compared on the bus ('\\' as '/', case-insensitive on Windows)
+static std::string frameBusKey(const std::string & fname)
+{
+	string key = fname;
+	for (size_t i = 0; i < key.length(); i++) {
+		if (key[i] == '\\') key[i] = '/';
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+		key[i] = (char) tolower((unsigned char) key[i]);
+#endif
+	}
+	return key;
+}
+
+// file extension (lower case, with dot), e.g., ".jpg"
+static std::string frameBusExt(const std::string & fname)
+{
+	size_t pos = fname.find_last_of("./\\");
+	if (pos == string::npos || fname[pos] != '.')
+		return string("");
+	string ext = fname.substr(pos);
+	for (size_t i = 0; i < ext.length(); i++)
+		ext[i] = (char) tolower((unsigned char) ext[i]);
+	return ext;
+}
+
+// true if pictures of the file format are changed by encoding (cv::imread() does not give the written picture)
+static bool frameBusLossy(const std::string & ext)
+{
+	return ext == ".jpg" || ext == ".jpeg" || ext == ".jpe" || ext == ".webp" || ext == ".jp2" || ext == ".avif";
+}
+
+static std::string frameBusShmName(const std::string & name)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	return "Local\\ImProFrameBus_" + name;
+#else
+	return "/ImProFrameBus_" + name;
+#endif
+}
+
+FrameBus::FrameBus()
+{
+	this->producer = false;
+	this->nSlot = 0;
+	this->base = NULL;
+	this->nBytes = 0;
+	this->handle = NULL;
+	this->fd = -1;
+}
+
+FrameBus::~FrameBus()
+{
+	this->close();
+}
+
+int FrameBus::create(std::string name, int nSlot)
+{
+	this->close();
+	std::lock_guard<std::mutex> lock(mtxPublish);
+	this->name = name;
+	this->producer = true;
+	this->nSlot = std::max(nSlot, 1);
+	return 0;
+}
+
+int FrameBus::open(std::string name)
+{
+	this->close();
+	std::lock_guard<std::mutex> lock(mtxPublish);
+	this->name = name;
+	this->producer = false;
+	if (name.length() <= 0 || this->mapMemory(false, 0) != 0)
+		return -1;
+	return 0;
+}
+
+bool FrameBus::isOpen() const
+{
+	return this->base != NULL;
+}
+
+int FrameBus::mapMemory(bool create, long long nBytes)
+{
+	string shmName = frameBusShmName(this->name);
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	HANDLE h = NULL;
+	if (create) {
+		h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)(nBytes >> 32), (DWORD)(nBytes & 0xffffffff), shmName.c_str());
+		if (h != NULL && GetLastError() == ERROR_ALREADY_EXISTS) {
+			// kept alive by consumers of a previous run. Re-used if it is large enough.
+			void * p = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+			MEMORY_BASIC_INFORMATION info;
+			bool large = (p != NULL && VirtualQuery(p, &info, sizeof(info)) > 0 && (long long) info.RegionSize >= nBytes);
+			if (p != NULL) UnmapViewOfFile(p);
+			if (large == false) {
+				cerr << "FrameBus: Bus " << this->name << " exists (used by other processes) and is too small.\n";
+				CloseHandle(h);
+				return -1;
+			}
+		}
+	}
+	else
+		h = OpenFileMappingA(FILE_MAP_READ, FALSE, shmName.c_str());
+	if (h == NULL)
+		return -1;
+	void * p = MapViewOfFile(h, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (p == NULL || VirtualQuery(p, &info, sizeof(info)) == 0) {
+		if (p != NULL) UnmapViewOfFile(p);
+		CloseHandle(h);
+		return -1;
+	}
+	this->handle = (void *) h;
+	this->base = (unsigned char *) p;
+	this->nBytes = create ? nBytes : (long long) info.RegionSize;
+#else
+	int f = -1;
+	if (create) {
+		// a bus of a previous run is removed (its consumers keep their own mapping)
+		shm_unlink(shmName.c_str());
+		f = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+		if (f >= 0 && ftruncate(f, (off_t) nBytes) != 0) {
+			::close(f);
+			shm_unlink(shmName.c_str());
+			f = -1;
+		}
+	}
+	else {
+		f = shm_open(shmName.c_str(), O_RDONLY, 0);
+		struct stat st;
+		if (f >= 0 && fstat(f, &st) == 0)
+			nBytes = (long long) st.st_size;
+		else
+			nBytes = 0;
+	}
+	if (f < 0 || nBytes <= 0) {
+		if (f >= 0) ::close(f);
+		return -1;
+	}
+	void * p = mmap(NULL, (size_t) nBytes, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, f, 0);
+	if (p == MAP_FAILED) {
+		::close(f);
+		if (create) shm_unlink(shmName.c_str());
+		return -1;
+	}
+	this->fd = f;
+	this->base = (unsigned char *) p;
+	this->nBytes = nBytes;
+#endif
+
+	FrameBusHeader * hdr = (FrameBusHeader *) this->base;
+	if (create) {
+		// initialize header and slots, then magic (consumers check magic)
+		memset(hdr->magic, 0, 8);
+		hdr->nSlot = this->nSlot;
+		hdr->reserved = 0;
+		hdr->slotBytes = (nBytes - frameBusDataOffset(this->nSlot)) / this->nSlot / 64 * 64;
+		new (&hdr->nPublished) std::atomic<long long>(0);
+		for (int i = 0; i < this->nSlot; i++) {
+			FrameBusSlot * s = (FrameBusSlot *)(this->base + frameBusSlotsOffset()) + i;
+			new (&s->seq) std::atomic<long long>(0);
+			s->frameNo = -1;
+			s->rows = s->cols = s->type = s->nameLen = 0;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(hdr->magic, frameBusMagic, 8);
+	}
+	else {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (this->nBytes < frameBusSlotsOffset() || memcmp(hdr->magic, frameBusMagic, 8) != 0 ||
+			hdr->nSlot <= 0 || hdr->slotBytes < 0 ||
+			frameBusDataOffset(hdr->nSlot) + hdr->slotBytes * hdr->nSlot > this->nBytes) {
+			this->unmap();
+			return -1;
+		}
+		this->nSlot = hdr->nSlot;
+	}
+	return 0;
+}
+
+int FrameBus::publish(const std::string & fname, const cv::Mat & img)
+{
+	if (this->producer == false || this->name.length() <= 0 || img.empty())
+		return -1;
+	// a lossy file holds the decoded picture of the encoded one, which is what consumers have to get
+	string ext = frameBusExt(fname);
+	if (frameBusLossy(ext)) {
+		vector<uchar> buf;
+		if (cv::imencode(ext, img, buf) == false)
+			return -1;
+		return this->publishFrame(fname, cv::imdecode(buf, cv::IMREAD_UNCHANGED));
+	}
+	return this->publishFrame(fname, img);
+}
+
+int FrameBus::writeAndPublish(const std::string & fname, const cv::Mat & img, const std::vector<int> & params)
+{
+	if (this->producer == false || this->name.length() <= 0)
+		return cv::imwrite(fname, img, params) ? 0 : -1;
+	// encode once, write the file, and publish the picture as it is decoded from the file
+	string ext = frameBusExt(fname);
+	vector<uchar> buf;
+	if (img.empty() || cv::imencode(ext, img, buf, params) == false)
+		return -1;
+	ofstream ofs(fname, ios::binary);
+	if (ofs.is_open() == false)
+		return -1;
+	ofs.write((const char *) buf.data(), buf.size());
+	ofs.close();
+	if (ofs.fail())
+		return -1;
+	if (frameBusLossy(ext))
+		this->publishFrame(fname, cv::imdecode(buf, cv::IMREAD_UNCHANGED));
+	else
+		this->publishFrame(fname, img);
+	return 0;
+}
+
+int FrameBus::publishFrame(const std::string & fname, const cv::Mat & img)
+{
+	std::lock_guard<std::mutex> lock(mtxPublish);
+	if (this->producer == false || this->name.length() <= 0 || img.empty())
+		return -1;
+	long long bytes = (long long) img.total() * (long long) img.elemSize();
+	// the first frame decides the slot size
+	if (this->base == NULL) {
+		long long slotBytes = frameBusAlign(bytes);
+		if (this->mapMemory(true, frameBusDataOffset(this->nSlot) + slotBytes * this->nSlot) != 0) {
+			cerr << "FrameBus: Cannot create bus " << this->name << " (" << (slotBytes * this->nSlot) << " bytes).\n";
+			this->name = "";
+			return -1;
+		}
+	}
+	FrameBusHeader * hdr = (FrameBusHeader *) this->base;
+	if (bytes > hdr->slotBytes)
+		return -1;
+	string name = frameBusKey(fname);
+	if ((int) name.length() > frameBusMaxName)
+		return -1;
+
+	// overwrite the oldest slot
+	long long k = hdr->nPublished.load(std::memory_order_relaxed);
+	FrameBusSlot * s = (FrameBusSlot *)(this->base + frameBusSlotsOffset()) + (int)(k % this->nSlot);
+	unsigned char * data = this->base + frameBusDataOffset(this->nSlot) + (k % this->nSlot) * hdr->slotBytes;
+	long long q = s->seq.load(std::memory_order_relaxed);
+	s->seq.store(q + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s->frameNo = k;
+	s->rows = img.rows;
+	s->cols = img.cols;
+	s->type = img.type();
+	s->nameLen = (int) name.length();
+	memcpy(s->name, name.c_str(), name.length());
+	size_t rowBytes = (size_t) img.cols * img.elemSize();
+	for (int i = 0; i < img.rows; i++)
+		memcpy(data + i * rowBytes, img.ptr(i), rowBytes);
+	s->seq.store(q + 2, std::memory_order_release);
+	hdr->nPublished.store(k + 1, std::memory_order_release);
+	return 0;
+}
+
+int FrameBus::read(const std::string & fname, cv::Mat & img, int imread_flag) const
+{
+	if (this->base == NULL)
+		return -1;
+	if (imread_flag != cv::IMREAD_UNCHANGED && imread_flag != cv::IMREAD_GRAYSCALE && imread_flag != cv::IMREAD_COLOR)
+		return -1;
+	const FrameBusHeader * hdr = (const FrameBusHeader *) this->base;
+	string name = frameBusKey(fname);
+	cv::Mat frame;
+	// from the newest slot, as consumers normally wait for the latest frames
+	long long n = hdr->nPublished.load(std::memory_order_acquire);
+	for (int j = 0; j < this->nSlot && frame.empty(); j++) {
+		long long k = n - 1 - j;
+		if (k < 0) break;
+		const FrameBusSlot * s = (const FrameBusSlot *)(this->base + frameBusSlotsOffset()) + (int)(k % this->nSlot);
+		const unsigned char * data = this->base + frameBusDataOffset(this->nSlot) + (k % this->nSlot) * hdr->slotBytes;
+		for (int attempt = 0; attempt < 3; attempt++) {
+			long long s1 = s->seq.load(std::memory_order_acquire);
+			if (s1 == 0) break;          // never written
+			if (s1 % 2 == 1) continue;   // being written
+			int rows = s->rows, cols = s->cols, type = s->type, nameLen = s->nameLen;
+			bool same = (nameLen == (int) name.length() && memcmp(s->name, name.c_str(), name.length()) == 0);
+			bool valid = rows > 0 && cols > 0 &&
+				(long long) rows * cols * CV_ELEM_SIZE(type) <= hdr->slotBytes;
+			if (same && valid) {
+				frame.create(rows, cols, type);
+				memcpy(frame.data, data, (size_t) rows * cols * CV_ELEM_SIZE(type));
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (s->seq.load(std::memory_order_relaxed) == s1)
+				break;                   // consistent
+			frame.release();             // overwritten while copying, try again
+		}
+	}
+	if (frame.empty())
+		return -1;
+
+	// convert as cv::imread() with the flag
+	if (imread_flag == cv::IMREAD_UNCHANGED)
+		img = frame;
+	else if (frame.depth() != CV_8U)
+		return -1;
+	else if (imread_flag == cv::IMREAD_GRAYSCALE) {
+		if (frame.channels() == 1) img = frame;
+		else if (frame.channels() == 3) cv::cvtColor(frame, img, cv::COLOR_BGR2GRAY);
+		else if (frame.channels() == 4) cv::cvtColor(frame, img, cv::COLOR_BGRA2GRAY);
+		else return -1;
+	}
+	else {
+		if (frame.channels() == 3) img = frame;
+		else if (frame.channels() == 1) cv::cvtColor(frame, img, cv::COLOR_GRAY2BGR);
+		else if (frame.channels() == 4) cv::cvtColor(frame, img, cv::COLOR_BGRA2BGR);
+		else return -1;
+	}
+	return 0;
+}
+
+void FrameBus::close()
+{
+	std::lock_guard<std::mutex> lock(mtxPublish);
+	this->unmap();
+}
+
+void FrameBus::unmap()
+{
+	if (this->base == NULL)
+		return;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	UnmapViewOfFile(this->base);
+	CloseHandle((HANDLE) this->handle);
+	this->handle = NULL;
+#else
+	munmap(this->base, (size_t) this->nBytes);
+	::close(this->fd);
+	this->fd = -1;
+	if (this->producer)
+		shm_unlink(frameBusShmName(this->name).c_str());
+#endif
+	this->base = NULL;
+	this->nBytes = 0;
+}
+
+std::string FrameBus::busNameFromEnv(std::string envName)
+{
+	string name;
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	char * buf = NULL;
+	size_t len = 0;
+	if (_dupenv_s(&buf, &len, envName.c_str()) == 0 && buf != NULL) {
+		name = buf;
+		free(buf);
+	}
+#else
+	const char * val = std::getenv(envName.c_str());
+	if (val != NULL) name = val;
+#endif
+	return name;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+// FrameBus hands decoded frames from one ImProConsole process (producer) to
+// others on the same computer (consumers) through shared memory, so that a
+// consumer does not have to wait for, re-read and decode the picture file the
+// producer has just written.
+//
+// The shared memory (POSIX shm, or a named file mapping on Windows) is a ring
+// of nSlot frames. Each slot keeps a decoded frame and its metadata (full path
+// of the file, size, type, frame number). The producer overwrites the oldest
+// slot; a consumer looks up a frame by full path and copies it out. Paths are
+// compared with '\' as '/' (and case-insensitively on Windows), so producer and
+// consumer have to name the files by the same (absolute) path.
+// A slot is guarded by a sequence number (odd while being written), so that a
+// consumer never gets a frame which is being overwritten. Only one producer
+// can publish to a bus. The slot size is given by the first published frame.
+//
+// Frames on a bus are an alternative source only: the producer still writes
+// the files, and consumers read files of frames which are not (or no longer)
+// on the bus. A frame on the bus is what cv::imread() gives for the file, also
+// for lossy formats (JPEG, WebP, ...): the producer publishes the decoded
+// picture of the encoded file, not the picture before encoding.
+//
+// Commands use buses named by environment variables:
+//   IMPRO_FRAME_BUS_OUT: bus which a producer command publishes its pictures to
+//                        (wallDispCam, camera movement correction)
+//   IMPRO_FRAME_BUS_IN:  bus which FileSeq::waitForImageFile() (and camera movement
+//                        correction) reads frames from before reading files
+//
+// Producer:
+//   FrameBus bus;
+//   bus.create("cam", 8);
+//   bus.writeAndPublish(fname, img);  // instead of cv::imwrite(fname, img)
+// Consumer:
+//   FrameBus bus;
+//   bus.open("cam");
+//   if (bus.read(fname, img, cv::IMREAD_GRAYSCALE) != 0)
+//       img = cv::imread(fname, cv::IMREAD_GRAYSCALE);
+
+class FrameBus
+{
+public:
+	FrameBus();
+	~FrameBus();
+
+	//! Creates a bus as the producer (shared memory is allocated at the first publish())
+	/*!
+	\param name bus name (letters, digits, and underscores)
+	\param nSlot number of frames kept in the ring
+	\return 0
+	*/
+	int create(std::string name, int nSlot = 8);
+
+	//! Opens an existing bus as a consumer
+	/*!
+	\return 0: opened. -1: the bus does not exist (yet) or is not valid.
+	*/
+	int open(std::string name);
+
+	//! Publishes a frame of a file written by cv::imwrite(fname, img) (copied into the oldest slot). Thread safe.
+	/*!
+	\details If the file format is lossy (by extension of fname), img is encoded and decoded
+	   again, so that the published frame is the same as the file. writeAndPublish() does it
+	   without encoding twice.
+	\param fname full path of the file of the frame
+	\param img frame (continuous or not). Must not be larger than the first published frame.
+	\return 0: published. -1: not published (not created, too large, or shared memory error).
+	*/
+	int publish(const std::string & fname, const cv::Mat & img);
+
+	//! Writes a frame to file (as cv::imwrite()) and publishes the frame as it is decoded from the file. Thread safe.
+	/*!
+	\param fname full path of the file
+	\param img frame
+	\param params parameters of cv::imwrite()
+	\return 0: file is written (published if possible). -1: file is not written.
+	*/
+	int writeAndPublish(const std::string & fname, const cv::Mat & img, const std::vector<int> & params = std::vector<int>());
+
+	//! Copies a frame from the bus. Thread safe.
+	/*!
+	\param fname full path of the file of the frame
+	\param img output frame (converted as cv::imread() would do with imread_flag)
+	\param imread_flag cv::IMREAD_UNCHANGED, cv::IMREAD_GRAYSCALE, or cv::IMREAD_COLOR
+	\return 0: copied. -1: the frame is not on the bus.
+	*/
+	int read(const std::string & fname, cv::Mat & img, int imread_flag = -1 /* cv::IMREAD_UNCHANGED */) const;
+
+	bool isOpen() const;
+
+	//! Unmaps the shared memory (the producer also removes the bus name)
+	void close();
+
+	//! Returns the bus name of environment variable IMPRO_FRAME_BUS_IN or IMPRO_FRAME_BUS_OUT ("" if not set)
+	static std::string busNameFromEnv(std::string envName);
+
+private:
+	FrameBus(const FrameBus &) = delete;
+	FrameBus & operator=(const FrameBus &) = delete;
+	int mapMemory(bool create, long long nBytes);
+	int publishFrame(const std::string & fname, const cv::Mat & img);
+	void unmap();
+
+	std::string name;
+	bool producer;
+	int nSlot;
+	unsigned char * base;      // mapped shared memory
+	long long nBytes;          // size of mapped shared memory
+	void * handle;             // file mapping handle (Windows)
+	int fd;                    // shm file descriptor (POSIX)
+	std::mutex mtxPublish;
+};
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <opencv2/video/tracking.hpp>
+#include "FramePyramidCache.h"
+
+using namespace std;
+
+FramePyramidCache::FramePyramidCache(int capacity)
+{
+	this->capacity = std::max(capacity, 1);
+	this->useCount = 0;
+	this->nBuilt = 0;
+	this->nReused = 0;
+}
+
+std::vector<cv::Mat> FramePyramidCache::get(int frameId, int variant, const cv::Mat & img, cv::Size winSize, int maxLevel,
+	const cv::Mat & imgBuild)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for (size_t i = 0; i < entries.size(); i++) {
+			Entry & e = entries[i];
+			if (e.frameId != frameId || e.variant != variant)
+				continue;
+			// same frame of another buffer (or size) means the caller reused the id for a new image
+			if (e.img.data == img.data && e.img.size() == img.size() &&
+				e.winSize.width >= winSize.width && e.winSize.height >= winSize.height && e.maxLevel >= maxLevel) {
+				e.lastUse = ++useCount;
+				nReused++;
+				return e.pyr;
+			}
+		}
+	}
+	// build out of the lock so that pyramids of different frames are built concurrently
+	Entry e;
+	e.frameId = frameId;
+	e.variant = variant;
+	e.img = img;
+	e.winSize = winSize;
+	e.maxLevel = maxLevel;
+	cv::buildOpticalFlowPyramid(imgBuild.empty() ? img : imgBuild, e.pyr, winSize, maxLevel);
+
+	std::lock_guard<std::mutex> lock(mtx);
+	e.lastUse = ++useCount;
+	nBuilt++;
+	// replace the entry of the same frame and variant, or the least recently used one if full
+	size_t iSlot = entries.size();
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].frameId == frameId && entries[i].variant == variant)
+			iSlot = i;
+	if (iSlot == entries.size() && (int)entries.size() >= capacity) {
+		iSlot = 0;
+		for (size_t i = 1; i < entries.size(); i++)
+			if (entries[i].lastUse < entries[iSlot].lastUse)
+				iSlot = i;
+	}
+	if (iSlot == entries.size())
+		entries.push_back(e);
+	else
+		entries[iSlot] = e;
+	return e.pyr;
+}
+
+void FramePyramidCache::release(int frameId)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	for (size_t i = entries.size(); i > 0; i--)
+		if (entries[i - 1].frameId == frameId)
+			entries.erase(entries.begin() + (i - 1));
+}
+
+void FramePyramidCache::clear()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	entries.clear();
+}
+
+int FramePyramidCache::numBuilt() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return nBuilt;
+}
+
+int FramePyramidCache::numReused() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return nReused;
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+#define PYR_VARIANT_RAW   0   // image as it is (gray)
+#define PYR_VARIANT_SOBEL 1   // sobel_xy() of image
+
+// FramePyramidCache keeps optical flow pyramids (cv::buildOpticalFlowPyramid())
+// of recent frames, so that a frame's pyramid is built once and reused by every
+// calcOpticalFlowPyrLK() call of that frame, e.g., the current frame of a step is
+// the previous frame of the next step, and the initial frame is used by all steps.
+//
+// A pyramid is identified by a frame id (given by the caller, e.g., step index)
+// and a preprocessing variant (raw or sobel). A cached pyramid is reused if it
+// was built with window size and levels not smaller than requested and from the
+// same image buffer; otherwise it is rebuilt. If the caller has to convert the
+// frame for every call (e.g., gray of a color frame), the frame is the key and
+// the converted image is given as imgBuild, so the pyramid is still reused. The least recently used pyramid is
+// dropped when the cache is full.
+//
+// FramePyramidCache pyrs(4);
+// for each step:
+//   vector<cv::Mat> pyrPrev = pyrs.get(iStep - 1, PYR_VARIANT_SOBEL, imgPrev, winSize, 3);
+//   vector<cv::Mat> pyrCurr = pyrs.get(iStep, PYR_VARIANT_SOBEL, imgCurr, winSize, 3);
+//   cv::calcOpticalFlowPyrLK(pyrPrev, pyrCurr, prevPts, currPts, status, err, winSize, 3);
+
+class FramePyramidCache
+{
+public:
+	FramePyramidCache(int capacity = 4);
+
+	//! Returns pyramid of a frame (built if not cached). Thread safe.
+	/*!
+	\param frameId frame id given by the caller (e.g., step index)
+	\param variant PYR_VARIANT_RAW or PYR_VARIANT_SOBEL. Only a key, the image should be already processed.
+	\param img image of the frame (the image of the variant, or the key of imgBuild)
+	\param winSize window size of optical flow which will use the pyramid
+	\param maxLevel max pyramid level
+	\param imgBuild if not empty, the pyramid is built from imgBuild (e.g., a gray copy of img)
+	   while img (its buffer) is the key
+	\return pyramid (as cv::buildOpticalFlowPyramid() with derivatives). Mats share data with the cache.
+	*/
+	std::vector<cv::Mat> get(int frameId, int variant, const cv::Mat & img, cv::Size winSize, int maxLevel,
+		const cv::Mat & imgBuild = cv::Mat());
+
+	//! Drops pyramids (all variants) of a frame
+	void release(int frameId);
+
+	//! Drops all pyramids
+	void clear();
+
+	int numBuilt() const;    // number of pyramids built
+	int numReused() const;   // number of requests served by cached pyramids
+
+private:
+	struct Entry {
+		int frameId;
+		int variant;
+		cv::Mat img;          // image (key) the pyramid is built for (keeps the buffer alive)
+		cv::Size winSize;
+		int maxLevel;
+		std::vector<cv::Mat> pyr;
+		long long lastUse;
+	};
+	int capacity;
+	std::vector<Entry> entries;
+	long long useCount;
+	int nBuilt, nReused;
+	mutable std::mutex mtx;
+};
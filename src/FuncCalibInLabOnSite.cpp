@@ -20,14 +20,15 @@
 //         dx dy:  grid distances (square size) along horizontal and vertical directions. 
 // Step 2: Left cam calibration photos: (FileSeq)
 //         (ask user. FileSeq options: o, c, f, g, gm) 
-// Step 3: Left find corners 
-// Step 4: Left calibration level for options (output .m scripts)
-// Step 5: Left output result 
-// Step 6: Right cam calibration photos: (FileSeq)
+// Step 3: Left calibration level (and flags of levels that ask them) 
+// Step 4: Left output result file 
+// Step 5: Right cam calibration photos: (FileSeq)
 //         (ask user. FileSeq options: o, c, f, g, gm) 
-// Step 7: Right find corners 
-// Step 8: Right calibration level for options (output .m scripts)
-// Step 9: Right output result 
+// Step 6: Right calibration level (and flags of levels that ask them) 
+// Step 7: Right output result file 
+// Step 8: Find corners and calibrate both cameras (concurrently, corners 
+//         are cached in cornersCache.bin of each photo directory)
+// Step 9: Left and right output result 
 // Step 10: Left extrinsic calibration with user coordinate
 // Step 11: Right extrinsic calibration with user coordinate
 
@@ -41,7 +42,11 @@ const String keys =
 "{calflist1     calfs1    |   | path and file name of list of calibration photos of camera 1 (left) } "
 "{calflist2     calfs2    |   | path and file name of list of calibration photos of camera 2 (right) } "
 "{caliblevel1   callevel1 |   | intrinsic parameters level 0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.  } "
+"{calsweep1     calsweep1 |   | candidates of calibration sweep (level 6) of camera 1, e.g., 3,4,5,5+Rational,5+-FixK3. Default: 1,2,3,4,5 }"
+"{calsweepfx1   calsweepfx1 |  | path and file prefix of candidates of calibration sweep (level 6) of camera 1. Default: calibSweep in photos directory }"
 "{caliblevel2   callevel2 |   | intrinsic parameters level 0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.  } "
+"{calsweep2     calsweep2 |   | candidates of calibration sweep (level 6) of camera 2, e.g., 3,4,5,5+Rational,5+-FixK3. Default: 1,2,3,4,5 }"
+"{calsweepfx2   calsweepfx2 |  | path and file prefix of candidates of calibration sweep (level 6) of camera 2. Default: calibSweep in photos directory }"
 "{calfilexml1   calfx1    |   | path and file name intr/extr parameters of camera 1 }"
 "{calfilexml2   calfx2    |   | path and file name intr/extr parameters of camera 2 }"
 "{calfileimpm1  calfpm1   |   | path and file name of matlab (octave) scirpt file for camera 1 image points }"
@@ -142,39 +147,22 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 
 	// Step 2: Left cam calibration photos 
 	// calfs1
-	FileSeq fsq1;
 	IntrinsicCalibrator calC1;
-	if (parser.has("callevel1"))
-		callevel1 = parser.get<int>("callevel1");
 	if (parser.has("calfs1")) {
 		FileSeq fsq1;
-		calfs1 = parser.get<int>("calfs1");
+		calfs1 = parser.get<string>("calfs1");
 		fsq1.setFilesByListFile(calfs1);
 		calC1.setFileSeq(fsq1);
 	}
-	else 
+	else
 	{
 		cout << "Input camera 1 (left) calibration photos files:\n";
+		FileSeq fsq1;
 		fsq1.setDirFilesByConsole();
 		calC1.setFileSeq(fsq1);
 	}
 
-	// Step 3: Find corners
-	 {
-		calPoints1.resize(calC1.fileSeq().num_files(), calbnx * calbny);
-		calC1.setCalibrationBoard(calbt, calbnx, calbny, calbsx, calbsy);
-		for (int i = 0; i < calC1.fileSeq().num_files(); i++) {
-			cout << "   " << calC1.fileSeq().filename(i) << ": ";
-			int foundOK = calC1.findCorners(i, cv::Size(calbnx, calbny), (float)calbsx, (float)calbsy, calbt);
-			if (foundOK == 0)
-				cout << "Corners found successfully.\n";
-			else
-				cout << "Failed to find corners in this photo.\n";
-		}
-	}
-
-	// Step 4: calibration
-	int flag1 = 0;
+	// Step 3: Left calibration level
 	// callevel1
 	if (parser.has("callevel1"))
 		callevel1 = parser.get<int>("callevel1");
@@ -182,13 +170,22 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 	{
 		cout << "Input calibration level for camera 1 (callevel1=). "
 			"0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, "
-			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.:\n";
+			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2, "
+			"6:sweep of 1-5 (or -calsweep1=) in parallel (keeps the lowest held-out rms), "
+			"11-15:as 1-5 with incremental photo selection (for many photos).:\n";
 		callevel1 = readIntFromCin();
 	}
 	if (callevel1 == 0) callevel1 = 3; // set to 3 (fx,fy,cx,cy,k1) by default 
-	calC1.calibrateByLevel(callevel1);
+	// candidates and output files of calibration sweep (level 6)
+	if (parser.has("calsweep1") || parser.has("calsweepfx1")) {
+		if (calC1.setSweep(parser.get<string>("calsweep1"), parser.get<string>("calsweepfx1")) < 0)
+			return -1;
+	}
+	// flags of a level that asks them (not 1-6 or 11-15) are asked here. Calibration is done in step 8.
+	if (IntrinsicCalibrator::calibLevelAsksFlags(callevel1))
+		calC1.setFlagByAsking();
 
-	// Step 5: Write to xml file
+	// Step 4: Left output file
 	if (parser.has("calfx1")) {
 		calfx1 = parser.get<string>("calfx1");
 	}
@@ -196,14 +193,13 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 		cout << "Enter path and file name intr/extr parameters of camera 1:\n";
 		calfx1 = readStringLineFromCin();
 	}
-	calC1.writeToFsFile(calfx1);
 
-	// Step 6: Right cam calibration photos 
+	// Step 5: Right cam calibration photos 
 	// calfs2
 	IntrinsicCalibrator calC2;
 	if (parser.has("calfs2")) {
 		FileSeq fsq2;
-		calfs2 = parser.get<int>("calfs2");
+		calfs2 = parser.get<string>("calfs2");
 		fsq2.setFilesByListFile(calfs2);
 		calC2.setFileSeq(fsq2);
 	}
@@ -215,20 +211,7 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 		calC2.setFileSeq(fsq2);
 	}
 
-	// Step 7: Find corners
-	calPoints2.resize(calC2.fileSeq().num_files(), calbnx * calbny);
-	calC2.setCalibrationBoard(calbt, calbnx, calbny, calbsx, calbsy);
-	for (int i = 0; i < calC2.fileSeq().num_files(); i++) {
-		cout << "   " << calC2.fileSeq().filename(i) << ": ";
-		int foundOK = calC2.findCorners(i, cv::Size(calbnx, calbny), (float)calbsx, (float)calbsy, calbt);
-		if (foundOK == 0)
-			cout << "Corners found successfully.\n";
-		else
-			cout << "Failed to find corners in this photo.\n";
-	}
-
-	// Step 8: calibration
-	int flag2 = 0;
+	// Step 6: Right calibration level
 	// callevel2
 	if (parser.has("callevel2"))
 		callevel2 = parser.get<int>("callevel2");
@@ -236,13 +219,22 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 	{
 		cout << "Input calibration level for camera 2 (callevel2=). "
 			"0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, "
-			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.:\n";
+			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2, "
+			"6:sweep of 1-5 (or -calsweep2=) in parallel (keeps the lowest held-out rms), "
+			"11-15:as 1-5 with incremental photo selection (for many photos).:\n";
 		callevel2 = readIntFromCin();
 	}
 	if (callevel2 == 0) callevel2 = 3; // set to 3 (fx,fy,cx,cy,k1) by default 
-	calC2.calibrateByLevel(callevel2);
+	// candidates and output files of calibration sweep (level 6)
+	if (parser.has("calsweep2") || parser.has("calsweepfx2")) {
+		if (calC2.setSweep(parser.get<string>("calsweep2"), parser.get<string>("calsweepfx2")) < 0)
+			return -1;
+	}
+	// flags of a level that asks them (not 1-6 or 11-15) are asked here. Calibration is done in step 8.
+	if (IntrinsicCalibrator::calibLevelAsksFlags(callevel2))
+		calC2.setFlagByAsking();
 
-	// Step 9: Write C2 intrinsic to xml file
+	// Step 7: Right output file
 	if (parser.has("calfx2")) {
 		calfx2 = parser.get<string>("calfx2");
 	}
@@ -250,6 +242,16 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 		cout << "Enter path and file name intr/extr parameters of camera 2:\n";
 		calfx2 = readStringLineFromCin();
 	}
+
+	// Step 8: Find corners and calibrate both cameras (the two cameras concurrently)
+	calPoints1.resize(calC1.fileSeq().num_files(), calbnx * calbny);
+	calPoints2.resize(calC2.fileSeq().num_files(), calbnx * calbny);
+	if (calibrateTwoCameras(calC1, calC2, cv::Size(calbnx, calbny), (float) calbsx, (float) calbsy,
+		calbt, callevel1, callevel2) != 0)
+		return -1;
+
+	// Step 9: Write C1 and C2 intrinsic to xml files
+	calC1.writeToFsFile(calfx1);
 	calC2.writeToFsFile(calfx2);
 
 	// Step 10: Left extrinsic calibration with user coordinate
@@ -284,7 +286,7 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 	cv::Mat rvec1 = cv::Mat::zeros(3, 1, CV_64F); // rvec of camera 1 for extrinsic calibration wrt user coord.
 	cv::Mat tvec1 = cv::Mat::zeros(3, 1, CV_64F); // rvec of camera 1 for extrinsic calibration wrt user coord.
 	cv::Mat rvec133 = cv::Mat::zeros(3, 3, CV_64F);
-	cv::solvePnP(points3dUserDefined.getVecVec()[0], pointsUserDefined.getVecVec()[0],
+	cv::solvePnP(points3dUserDefined.stepView(0).mat(), pointsUserDefined.stepView(0).mat(),
 		calC1.cameraMatrix(), calC1.distortionVector(), rvec1, tvec1);
 	// convert to rvec/tvec of the other cam
 	cv::Rodrigues(rvec1, rvec133);
@@ -310,8 +312,8 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 
 	int userDefinedPhotoId = calC1.numValidPhotos();
 	calC1.defineUserPoints(userDefinedPhotoId,
-		pointsUserDefined.getVecVec()[0],
-		points3dUserDefined.getVecVec()[0], calC1.imageSize()); 
+		pointsUserDefined.stepView(0).toVector(),
+		points3dUserDefined.stepView(0).toVector(), calC1.imageSize()); 
 	calC1.solvePnp(userDefinedPhotoId); 
 	calC1.writeToFsFile(calfx1);
 	calC1.writeToMscript(calfpm1);
@@ -345,7 +347,7 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 	cv::Mat rvec2 = cv::Mat::zeros(3, 1, CV_64F); // rvec of camera 2 for extrinsic calibration wrt user coord.
 	cv::Mat tvec2 = cv::Mat::zeros(3, 1, CV_64F); // tvec of camera 2 for extrinsic calibration wrt user coord.
 	cv::Mat rvec233 = cv::Mat::zeros(3, 3, CV_64F);
-	cv::solvePnP(points3dUserDefined.getVecVec()[0], pointsUserDefined.getVecVec()[0],
+	cv::solvePnP(points3dUserDefined.stepView(0).mat(), pointsUserDefined.stepView(0).mat(),
 		calC2.cameraMatrix(), calC2.distortionVector(), rvec2, tvec2);
 	// convert to rvec/tvec of the other cam
 	cv::Rodrigues(rvec2, rvec233);
@@ -372,8 +374,8 @@ int FuncCalibInLabOnSite(int argc, char** argv)
 
 	int userDefinedPhotoIdC2 = calC2.numValidPhotos();
 	calC2.defineUserPoints(userDefinedPhotoIdC2,
-		pointsUserDefined.getVecVec()[0],
-		points3dUserDefined.getVecVec()[0], calC2.imageSize());
+		pointsUserDefined.stepView(0).toVector(),
+		points3dUserDefined.stepView(0).toVector(), calC2.imageSize());
 	calC2.solvePnp(userDefinedPhotoIdC2);
 	calC2.writeToFsFile(calfx2);
 	calC2.writeToMscript(calfpm2);
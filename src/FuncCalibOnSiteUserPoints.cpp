@@ -34,7 +34,11 @@
 const String keys =
 "{help          h usage ? |   | print this message   }"
 "{caliblevel1   callevel1 |   | intrinsic parameters level 0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.  } "
+"{calsweep1     calsweep1 |   | candidates of calibration sweep (level 6) of camera 1, e.g., 3,4,5,5+Rational,5+-FixK3. Default: 1,2,3,4,5 }"
+"{calsweepfx1   calsweepfx1 |  | path and file prefix of candidates of calibration sweep (level 6) of camera 1. Default: calibSweep in photos directory }"
 "{caliblevel2   callevel2 |   | intrinsic parameters level 0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.  } "
+"{calsweep2     calsweep2 |   | candidates of calibration sweep (level 6) of camera 2, e.g., 3,4,5,5+Rational,5+-FixK3. Default: 1,2,3,4,5 }"
+"{calsweepfx2   calsweepfx2 |  | path and file prefix of candidates of calibration sweep (level 6) of camera 2. Default: calibSweep in photos directory }"
 "{calfilexml1   calfx1    |   | path and file name intr/extr parameters of camera 1 }"
 "{calfilexml2   calfx2    |   | path and file name intr/extr parameters of camera 2 }"
 "{calfileimpm1  calfpm1   |   | path and file name of matlab (octave) scirpt file for camera 1 image points }"
@@ -113,7 +117,7 @@ int FuncCalibOnSiteUserPoints(int argc, char** argv)
 		points3dUserDefinedC1.readThruUserInteraction(1 /* nStep */, pointsUserDefinedC1.nPoint());
 	}
 	// intrinsic/extrinsic for left cam
-	calC1.defineUserPoints(0, pointsUserDefinedC1.getVecVec()[0], points3dUserDefinedC1.getVecVec()[0]);
+	calC1.defineUserPoints(0, pointsUserDefinedC1.stepView(0).toVector(), points3dUserDefinedC1.stepView(0).toVector());
 
 	// Step 2: Intrinsic / extrinsic calibration all in one
 	int flag1 = 0;
@@ -124,10 +128,17 @@ int FuncCalibOnSiteUserPoints(int argc, char** argv)
 	{
 		cout << "Input calibration level for camera 1 (callevel1=). "
 			"0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, "
-			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.:\n";
+			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2, "
+			"6:sweep of 1-5 (or -calsweep1=) in parallel (keeps the lowest held-out rms), "
+			"11-15:as 1-5 with incremental photo selection (for many photos).:\n";
 		callevel1 = readIntFromCin();
 	}
 	if (callevel1 == 0) callevel1 = 3; // set to 3 (fx,fy,cx,cy,k1) by default 
+	// candidates and output files of calibration sweep (level 6)
+	if (parser.has("calsweep1") || parser.has("calsweepfx1")) {
+		if (calC1.setSweep(parser.get<string>("calsweep1"), parser.get<string>("calsweepfx1")) < 0)
+			return -1;
+	}
 	calC1.calibrateByLevel(callevel1);
 
 	// Step 3: Write to xml file
@@ -177,7 +188,7 @@ int FuncCalibOnSiteUserPoints(int argc, char** argv)
 		points3dUserDefinedC2.readThruUserInteraction(1 /* nStep */, pointsUserDefinedC2.nPoint());
 	}
 	// intrinsic/extrinsic for right cam
-	calC2.defineUserPoints(0, pointsUserDefinedC2.getVecVec()[0], points3dUserDefinedC2.getVecVec()[0]);
+	calC2.defineUserPoints(0, pointsUserDefinedC2.stepView(0).toVector(), points3dUserDefinedC2.stepView(0).toVector());
 
 	// Step 5: Intrinsic / extrinsic calibration all in one
 	int flag2 = 0;
@@ -188,10 +199,17 @@ int FuncCalibOnSiteUserPoints(int argc, char** argv)
 	{
 		cout << "Input calibration level for camera 2 (callevel2=). "
 			"0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, "
-			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.:\n";
+			"4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2, "
+			"6:sweep of 1-5 (or -calsweep2=) in parallel (keeps the lowest held-out rms), "
+			"11-15:as 1-5 with incremental photo selection (for many photos).:\n";
 		callevel2 = readIntFromCin();
 	}
 	if (callevel2 == 0) callevel2 = 3; // set to 3 (fx,fy,cx,cy,k1) by default 
+	// candidates and output files of calibration sweep (level 6)
+	if (parser.has("calsweep2") || parser.has("calsweepfx2")) {
+		if (calC2.setSweep(parser.get<string>("calsweep2"), parser.get<string>("calsweepfx2")) < 0)
+			return -1;
+	}
 	calC2.calibrateByLevel(callevel2);
 
 	// Step 3: Write to xml file
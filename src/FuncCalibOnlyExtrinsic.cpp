@@ -46,7 +46,7 @@ int FuncCalibOnlyExtrinsic(int argc, char ** argv)
 	cv::Mat R44C1 = cv::Mat::eye(4, 4, CV_64F); // R matrix (4 by 4) of camera 1 (wrt user-defined coord.)
 	cv::Mat R33C1(R44C1(cv::Rect(0, 0, 3, 3))); // R matrix (3 by 3) of stereo calibration of camera 1 (wrt user-defined coord.)
 	cv::Mat T31C1(R44C1(cv::Rect(3, 0, 1, 3))); // T vector (3 by 1) of stereo calibration of camera 1 (wrt user-defined coord.)
-	cv::solvePnP(points3dUserDefined.getVecVec()[0], pointsUserDefined.getVecVec()[0],
+	cv::solvePnP(points3dUserDefined.stepView(0).mat(), pointsUserDefined.stepView(0).mat(),
 		calC1.cameraMatrix(), calC1.distortionVector(), rvec1, tvec1);
 	// convert to rvec/tvec of the other cam
 	cv::Rodrigues(rvec1, rvec133);
@@ -68,8 +68,8 @@ int FuncCalibOnlyExtrinsic(int argc, char ** argv)
 	// output to matlab script
 	//int userDefinedPhotoId = calC1.numValidPhotos();
 	//calC1.defineUserPoints(userDefinedPhotoId,
-	//	pointsUserDefined.getVecVec()[0],
-	//	points3dUserDefined.getVecVec()[0], calC1.imageSize());
+	//	pointsUserDefined.stepView(0).toVector(),
+	//	points3dUserDefined.stepView(0).toVector(), calC1.imageSize());
 	//calC1.solvePnp(userDefinedPhotoId);
 	//calC1.writeToFsFile(calfx1);
 	//calC1.writeToMscript(calfpm1);
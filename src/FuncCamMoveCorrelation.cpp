@@ -2,84 +2,297 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <cmath>
 #include <opencv2/opencv.hpp>
+#include <omp.h>
 #include "FileSeq.h" 
 #include "impro_util.h"
+#include "FrameBus.h"
+#include "CamMoveCorrector.h"
+#include "PerfTrace.h"
 
 using namespace std;
 
+// Options without prompts (defaults are used if not given)
+const cv::String keys =
+"{help          h usage ? |    | print this message   }"
+"{cammode                 | 1  | 1:compute transforms and write corrected photos, 2:compute and write transforms only (no photo), 3:write corrected photos from a transform file (written by mode 2), 4:estimate transforms from fixed points picked on the first photo (no tracked points) and write corrected photos }"
+"{camquality              | -1 | output quality. -1:default, 0-100:JPEG/WebP quality, 0-9:PNG compression }"
+"{caminterp               | 1  | interpolation. 1:Lanczos4 (best, slowest), 2:cubic, 3:linear (fastest) }"
+"{camthreads              | 0  | number of worker threads (0 for all cores) }"
+;
+
+// Computes the 3x3 transform (CV_64F) that moves the reference points of a step
+// back to their positions in step 0. Returns empty Mat if it cannot be computed.
+static cv::Mat camMoveTransform(const vector<cv::Point2f> & pointsStep, const vector<cv::Point2f> & points0)
+{
+	cv::Mat warp = cv::Mat::eye(3, 3, CV_64F);
+	if (pointsStep.size() < 4) {
+		cv::Mat affine = cv::getAffineTransform(pointsStep, points0);
+		if (affine.rows != 2) return cv::Mat();
+		affine.convertTo(affine, CV_64F);
+		affine.copyTo(warp(cv::Rect(0, 0, 3, 2)));
+	}
+	else {
+		warp = cv::findHomography(pointsStep, points0);
+		if (warp.rows != 3) return cv::Mat();
+		warp.convertTo(warp, CV_64F);
+	}
+	return warp;
+}
+
+// Correction of a photo: decode, warp, and encode, one after another in the
+// worker (OpenMP thread) which takes the photo. Photos are corrected in
+// parallel (one photo per worker at a time), so no more than two images per
+// worker are in memory.
+static int camMoveDecode(const string & fname, cv::Mat & img, const FrameBus & busIn)
+{
+	PERF_SCOPE("cammov.decode");
+	// decoded frame on the frame bus (published by the process which wrote the file), if any
+	if (busIn.read(fname, img, cv::IMREAD_COLOR) == 0)
+		return 0;
+	img = cv::imread(fname);
+	if (img.rows == 0 || img.cols == 0)
+		return -1;
+	return 0;
+}
+
+static void camMoveWarp(const cv::Mat & img, const cv::Mat & warp, cv::Mat & newImg, int interp)
+{
+	// warpPerspective is internally parallel. It is called in a worker thread
+	// (nested parallelism is off by default) so it runs in one thread here.
+	PERF_SCOPE("cammov.warp");
+	cv::warpPerspective(img, newImg, warp, img.size(), interp);
+}
+
+static int camMoveEncode(const string & fname, const cv::Mat & img, const vector<int> & params, FrameBus & busOut)
+{
+	// written file is also published to the frame bus of other processes, if any
+	PERF_SCOPE("cammov.encode");
+	bool ok = false;
+	try {
+		ok = busOut.writeAndPublish(fname, img, params) == 0;
+	}
+	catch (cv::Exception & e) {
+		cerr << "Warning: " << e.what() << endl;
+	}
+	return ok ? 0 : -1;
+}
+
+// imwrite parameters of the given quality.
+// quality: -1 for default. 0-100 for JPEG/WebP quality. 0-9 for PNG compression.
+static vector<int> camMoveImwriteParams(const string & fname, int quality)
+{
+	vector<int> params;
+	if (quality < 0) return params;
+	string ext = fname.substr(fname.find_last_of('.') + 1);
+	for (size_t i = 0; i < ext.size(); i++) ext[i] = (char) tolower(ext[i]);
+	if (ext == "jpg" || ext == "jpeg") {
+		params.push_back(cv::IMWRITE_JPEG_QUALITY);
+		params.push_back(std::min(quality, 100));
+	}
+	else if (ext == "webp") {
+		params.push_back(cv::IMWRITE_WEBP_QUALITY);
+		params.push_back(std::max(std::min(quality, 100), 1));
+	}
+	else if (ext == "png") {
+		params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+		params.push_back(std::min(quality, 9));
+	}
+	return params;
+}
+
 int FuncCamMoveCorrection(int argc, char** argv)
 {
 	int nRefPoints; 
 	int nStep; 
+	int mode;
 	FileSeq fsqI; // input file sequence
 	FileSeq fsqO; // output file sequence
 	string fnameTrackedPoints; 
+	string fnameTransforms;
 	vector<vector<cv::Point2f> >  vecvecTrackedPoints; 
 	vector<int> refPointsIds;
 	vector<vector<cv::Point2f> >  refVecvecTrackedPoints; 
+	cv::Mat transforms; // nStep x 9 (CV_64F), row-major 3x3 transform of each step. NaN if not available.
 
-	cout << "Input photos list: \n";
-	fsqI.setDirFilesByConsole(); 
-	cout << "Output photos list: \n";
-	fsqO.setDirFilesByConsole();
-
-	cout << "Enter the tracked points (format: compact.xml, VecVecPoint2f): "; 
-	fnameTrackedPoints = readStringLineFromCin(); 
-	cv::FileStorage ifs(fnameTrackedPoints, cv::FileStorage::READ);
-	ifs["VecVecPoint2f"] >> vecvecTrackedPoints;
-	nStep = (int) vecvecTrackedPoints.size(); 
-	refVecvecTrackedPoints.resize(nStep);
-
-	cout << "How many reference points are tracked?\n";
-	nRefPoints = readIntFromCin(); 
-	if (nRefPoints < 3) {
-		cerr << "Number of reference points have to be >= 3.\n";
+	// mode and output options (see keys)
+	cv::CommandLineParser parser(argc, argv, keys);
+	mode = parser.get<int>("cammode");
+	if (mode < 1 || mode > 4) {
+		cerr << "Mode (-cammode) has to be 1, 2, 3, or 4.\n";
 		return -1; 
 	}
-	refPointsIds.resize(nRefPoints);
-	for (int iStep = 0; iStep < nStep; iStep++)
-		refVecvecTrackedPoints[iStep].resize(nRefPoints);
+	int quality = std::max(-1, std::min(parser.get<int>("camquality"), 100));
+	int interpOpt = parser.get<int>("caminterp");
+	int interp = (interpOpt == 2) ? cv::INTER_CUBIC : ((interpOpt == 3) ? cv::INTER_LINEAR : cv::INTER_LANCZOS4);
+	int nWorker = parser.get<int>("camthreads");
+	if (nWorker <= 0) nWorker = omp_get_max_threads();
 
-	cout << "Input reference points ID one by one (1-based): \n"; 
-	for (int iPoint = 0; iPoint < nRefPoints; iPoint++)
-		refPointsIds[iPoint] = readIntFromCin() - 1; // from user's 1-base to array 0-base
+	if (mode == 1 || mode == 3 || mode == 4) {
+		cout << "Input photos list: \n";
+		fsqI.setDirFilesByConsole(); 
+		cout << "Output photos list (file extension decides the format, e.g., .JPG, .png, .webp, .tif): \n";
+		fsqO.setDirFilesByConsole();
+	}
 
-	// copy all-point data (vecvecTrackedPoints) to selected reference points (refVecvecTrackedPoints)
-	for (int iStep = 0; iStep < nStep; iStep++)
+	if (mode == 1 || mode == 2) {
+		cout << "Enter the tracked points (format: compact.xml, VecVecPoint2f): "; 
+		fnameTrackedPoints = readStringLineFromCin(); 
+		cv::FileStorage ifs(fnameTrackedPoints, cv::FileStorage::READ);
+		ifs["VecVecPoint2f"] >> vecvecTrackedPoints;
+		nStep = (int) vecvecTrackedPoints.size(); 
+		if (nStep <= 0) {
+			cerr << "Cannot read tracked points from " << fnameTrackedPoints << endl;
+			return -1; 
+		}
+		refVecvecTrackedPoints.resize(nStep);
+
+		cout << "How many reference points are tracked?\n";
+		nRefPoints = readIntFromCin(); 
+		if (nRefPoints < 3) {
+			cerr << "Number of reference points have to be >= 3.\n";
+			return -1; 
+		}
+		refPointsIds.resize(nRefPoints);
+		for (int iStep = 0; iStep < nStep; iStep++)
+			refVecvecTrackedPoints[iStep].resize(nRefPoints);
+
+		cout << "Input reference points ID one by one (1-based): \n"; 
 		for (int iPoint = 0; iPoint < nRefPoints; iPoint++)
-			refVecvecTrackedPoints[iStep][iPoint] = vecvecTrackedPoints[iStep][refPointsIds[iPoint]];
+			refPointsIds[iPoint] = readIntFromCin() - 1; // from user's 1-base to array 0-base
+
+		// copy all-point data (vecvecTrackedPoints) to selected reference points (refVecvecTrackedPoints)
+		for (int iStep = 0; iStep < nStep; iStep++)
+			for (int iPoint = 0; iPoint < nRefPoints; iPoint++)
+				refVecvecTrackedPoints[iStep][iPoint] = vecvecTrackedPoints[iStep][refPointsIds[iPoint]];
+
+		// transforms of all steps (cheap, computed before any image is touched)
+		transforms = cv::Mat(nStep, 9, CV_64F, cv::Scalar(std::nan("")));
+		for (int iStep = 0; iStep < nStep; iStep++) {
+			cv::Mat warp = camMoveTransform(refVecvecTrackedPoints[iStep], refVecvecTrackedPoints[0]);
+			if (warp.rows == 3)
+				warp.reshape(1, 1).copyTo(transforms.row(iStep));
+			else
+				cerr << "Warning: Cannot compute the transform of step " << iStep << endl;
+		}
+
+		if (mode == 2) {
+			cout << "Enter the transform file to write (.xml): ";
+			fnameTransforms = readStringLineFromCin();
+			cv::FileStorage ofs(fnameTransforms, cv::FileStorage::WRITE);
+			if (ofs.isOpened() == false) {
+				cerr << "Cannot write " << fnameTransforms << endl;
+				return -1; 
+			}
+			ofs << "CamMoveTransforms" << transforms;
+			ofs.release();
+			cout << nStep << " transforms written to " << fnameTransforms << endl;
+			return 0;
+		}
+	}
+	else if (mode == 3) {
+		cout << "Enter the transform file (.xml, written by mode 2): ";
+		fnameTransforms = readStringLineFromCin();
+		cv::FileStorage ifs(fnameTransforms, cv::FileStorage::READ);
+		ifs["CamMoveTransforms"] >> transforms;
+		if (transforms.cols != 9 || transforms.rows <= 0) {
+			cerr << "Cannot read transforms from " << fnameTransforms << endl;
+			return -1; 
+		}
+		transforms.convertTo(transforms, CV_64F);
+		nStep = transforms.rows;
+	}
+	else {
+		// transforms are estimated by CamMoveCorrector (optical flow of the regions around
+		// the fixed points), one photo after another as each estimation starts from the
+		// transform of the previous photo. Photos are read again when they are corrected.
+		CamMoveCorrector cmc;
+		nStep = fsqI.num_files();
+		if (nStep > 0)
+			cmc.imgFixed = cv::imread(fsqI.fullPathOfFile(0));
+		if (cmc.imgFixed.rows <= 0 || cmc.imgFixed.cols <= 0) {
+			cerr << "Cannot read the first photo " << (nStep > 0 ? fsqI.fullPathOfFile(0) : string("")) << endl;
+			return -1;
+		}
+		cout << "How many fixed points (>= 4) are picked on the first photo?\n";
+		if (cmc.pickInitFixedPoint(readIntFromCin(4, 10000)) != 0)
+			return -1;
+		transforms = cv::Mat(nStep, 9, CV_64F, cv::Scalar(std::nan("")));
+		for (int iStep = 0; iStep < nStep; iStep++) {
+			cv::Mat img = cv::imread(fsqI.fullPathOfFile(iStep)), hMat;
+			if (img.rows <= 0 || img.cols <= 0) {
+				cerr << "Warning: Cannot read file " << fsqI.fullPathOfFile(iStep) << endl;
+				continue;
+			}
+			PERF_SCOPE_POINT("cammov.estimate", iStep);
+			if (cmc.estimate(img, hMat) == 0)
+				hMat.reshape(1, 1).copyTo(transforms.row(iStep));
+			else
+				cerr << "Warning: Cannot estimate the transform of step " << iStep << endl;
+			cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+			cout << "Step " << iStep + 1 << "/" << nStep << " transform estimated.";
+		}
+		cout << endl;
+	}
+
+	// file names are generated before the parallel loop (FileSeq is not meant to be shared by threads)
+	nStep = std::min(nStep, std::min(fsqI.num_files(), fsqO.num_files()));
+	vector<string> fnamesI(nStep), fnamesO(nStep);
+	for (int iStep = 0; iStep < nStep; iStep++) {
+		fnamesI[iStep] = fsqI.fullPathOfFile(iStep);
+		fnamesO[iStep] = fsqO.fullPathOfFile(iStep);
+	}
 
 	// generate new photos
+	int nDone = 0, nFail = 0;
+	double tStart = getWallTime();
+	// frame buses of other processes on this computer (environment variables
+	// IMPRO_FRAME_BUS_IN and IMPRO_FRAME_BUS_OUT), see FrameBus
+	FrameBus busIn, busOut;
+	if (FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_IN").length() > 0)
+		busIn.open(FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_IN"));
+	if (FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_OUT").length() > 0)
+		busOut.create(FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_OUT"), 8);
+#pragma omp parallel for schedule(dynamic) num_threads(nWorker)
 	for (int iStep = 0; iStep < nStep; iStep++) {
-		cv::Mat warp = cv::Mat::eye(3, 3, CV_32F); 
-		cv::Mat oriImg = cv::imread(fsqI.fullPathOfFile(iStep));
-		if (oriImg.rows == 0 || oriImg.cols == 0) {
-			cerr << "Warning: Cannot read file " << fsqI.fullPathOfFile(iStep) << endl;
+		if (std::isnan(transforms.at<double>(iStep, 0))) {
+#pragma omp atomic
+			nFail++;
 			continue; 
 		}
-		cv::Mat newImg; 
-		if (nRefPoints < 4) {
-			cv::Mat affine = cv::getAffineTransform(
-				refVecvecTrackedPoints[iStep], refVecvecTrackedPoints[0]);
-			affine.convertTo(affine, CV_32F); 
-			warp.at<float>(0, 0) = affine.at<float>(0, 0);
-			warp.at<float>(0, 1) = affine.at<float>(0, 1);
-			warp.at<float>(0, 2) = affine.at<float>(0, 2);
-			warp.at<float>(1, 0) = affine.at<float>(1, 0);
-			warp.at<float>(1, 1) = affine.at<float>(1, 1);
-			warp.at<float>(1, 2) = affine.at<float>(1, 2);
+		// an exception must not leave the parallel region (it would terminate the program)
+		string err;
+		try {
+			cv::Mat warp = transforms.row(iStep).reshape(1, 3);
+			cv::Mat oriImg, newImg;
+			if (camMoveDecode(fnamesI[iStep], oriImg, busIn) != 0)
+				err = "Cannot read file " + fnamesI[iStep];
+			else {
+				camMoveWarp(oriImg, warp, newImg, interp);
+				oriImg.release();
+				if (camMoveEncode(fnamesO[iStep], newImg, camMoveImwriteParams(fnamesO[iStep], quality), busOut) != 0)
+					err = "Cannot write file " + fnamesO[iStep];
+			}
+		}
+		catch (const std::exception & e) {
+			err = "Step " + std::to_string(iStep) + ": " + e.what();
+		}
+		if (err.length() > 0) {
+#pragma omp critical
+			cerr << "Warning: " << err << endl;
+#pragma omp atomic
+			nFail++;
+			continue; 
 		}
-		else {
-			warp = cv::findHomography(
-				refVecvecTrackedPoints[iStep], refVecvecTrackedPoints[0]);
-			warp.convertTo(warp, CV_32F);
+#pragma omp critical
+		{
+			nDone++;
+			cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+			cout << "Step " << nDone << "/" << nStep << " conversion completed.";
 		}
-		cv::warpPerspective(oriImg, newImg, warp, oriImg.size(), cv::INTER_LANCZOS4);
-		cv::imwrite(fsqO.fullPathOfFile(iStep), newImg); 
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Step " << iStep << " conversion completed.";
 	}
 	cout << endl;
+	cout << nDone << " photos corrected (" << nFail << " failed) in " << getWallTime() - tStart << " sec.\n";
 	return 0;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include <opencv2/opencv.hpp>
 #include "impro_util.h"
+#include "PreviewDisplay.h"
 
 using namespace std;
 using namespace cv;
@@ -210,11 +211,22 @@ int FuncDrawHouse(int argc, char ** argv)
 	cv::Mat dvec0 = dvec.clone();
 	cv::Mat rvec0 = rvec.clone();
 	cv::Mat tvec0 = tvec.clone();
+	// the house is shown by the display thread. This loop only redraws when a key is pressed.
+	PreviewDisplay display(PREVIEW_ASYNC);
+	if (display.mode() != PREVIEW_ASYNC) {
+		cerr << "FuncDrawHouse: Needs a display to tune parameters by keyboard.\n";
+		return -1;
+	}
+	display.setMaxSize(cv::Size(0, 0));
+	bool redraw = true;
 	while (true)
 	{
-		drawhouse(img, w, h, cmat, dvec, rvec, tvec, lines, p3, p2); 
-		cv::imshow("House", img); 
-		int ikey = cv::waitKey(100);
+		if (redraw) {
+			drawhouse(img, w, h, cmat, dvec, rvec, tvec, lines, p3, p2); 
+			display.show("House", img); 
+		}
+		int ikey = display.waitKey(100);
+		redraw = (ikey >= 0);
 		if (ikey == 27) break;
 		// adjusting fx
 		if (ikey == 'q') cmat.at<float>(0, 0) /= .9f; 
@@ -256,7 +268,7 @@ int FuncDrawHouse(int argc, char ** argv)
 
 	}
 
-	cv::destroyAllWindows();
+	display.close();
 
 	return 0; 
 }
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "impro_util.h"
+#include "Points2fHistoryData.h"
+#include "DenseField.h"
+
+using namespace std;
+
+// Reconstructs dense displacement and strain fields of every step from tracked
+// points of a Q4 mesh (e.g., generated by picktmq4 and tracked by tmatch or ecc),
+// and writes them in the same outputs as the dense optical flow analysis (optflow).
+// Displacements are relative to step 0. This gives a full-field view at a
+// fraction of the cost of dense optical flow.
+
+int FuncQ4DenseField(int argc, char ** argv)
+{
+	Points2fHistoryData imgPoints;
+	cout << "Image points history data (tracked points):\n";
+	if (imgPoints.readThruUserInteraction() != 0) return -1;
+	int nStep = imgPoints.nStep(), nPoint = imgPoints.nPoint();
+	if (nStep < 2) {
+		cerr << "FuncQ4DenseField: Image points history data needs at least 2 steps.\n";
+		return -1;
+	}
+	if (nPoint < 4) {
+		cerr << "FuncQ4DenseField: Image points history data needs at least 4 points (a 2 x 2 mesh).\n";
+		return -1;
+	}
+	cout << "Index of the first mesh point (0-based) and mesh size n12 n23 (e.g., 0 40 30):\n";
+	cout << "  (Mesh points are ordered as picktmq4, i.e., point (i, j) is first + j + i * n12.)\n";
+	int iFirst = readIntFromCin(0, nPoint - 4);
+	int n12 = readIntFromCin(2, nPoint), n23 = readIntFromCin(2, nPoint);
+	if (iFirst + n12 * n23 > nPoint) {
+		cerr << "FuncQ4DenseField: Mesh (" << n12 << " x " << n23 << " from point " << iFirst
+			<< ") exceeds the number of points (" << nPoint << ").\n";
+		return -1;
+	}
+	cout << "Full path of the initial (reference) image (for image size):\n";
+	string fnameImg = readStringLineFromCin();
+	cv::Mat img = cv::imread(fnameImg, cv::IMREAD_GRAYSCALE);
+	if (img.empty()) {
+		cerr << "FuncQ4DenseField: Cannot read " << fnameImg << endl;
+		return -1;
+	}
+	cout << "Grid step of fields (pixel, e.g., 4):\n";
+	int gridStep = readIntFromCin(1, 10000);
+	cout << "Output directory:\n";
+	string outDir = appendSlashOrBackslashAfterDirectoryIfNecessary(readStringLineFromCin());
+
+	vector<cv::Point2f> refPoints(n12 * n23), disp(n12 * n23);
+	for (int k = 0; k < n12 * n23; k++)
+		refPoints[k] = imgPoints.get(0, iFirst + k);
+	cv::Mat u, exx, eyy, exy, mask;
+	for (int iStep = 1; iStep < nStep; iStep++)
+	{
+		double t0 = getWallTime();
+		for (int k = 0; k < n12 * n23; k++)
+			disp[k] = imgPoints.get(iStep, iFirst + k) - refPoints[k];
+		if (q4MeshDenseField(refPoints, disp, n12, n23, img.size(), gridStep, u, exx, eyy, exy, mask) != 0)
+			return -1;
+		printf("Step %d: fields sized %dx%d reconstructed in %.3f sec.\n", iStep, u.rows, u.cols, getWallTime() - t0);
+		char buf[1000];
+		snprintf(buf, 1000, "%sQ4Field_Step_%04d", outDir.c_str(), iStep);
+		writeDenseFieldResults(u, exx, eyy, exy, string(buf), mask);
+	}
+	return 0;
+}
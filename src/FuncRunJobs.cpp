@@ -0,0 +1,386 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#include <opencv2/opencv.hpp>
+#include "impro_util.h"
+#include "PerfTrace.h"
+
+using namespace std;
+
+// Runs a batch of jobs described in a job file (YAML or XML, read by cv::FileStorage)
+// without user interaction.
+//
+// A job is a list of commands. Each command runs in its own process (this
+// program with -cmd=<command>, which runs only that command and exits with its
+// return value), so that jobs never share cin/cout and can run concurrently,
+// and so that a failed command stops its job. The number of concurrent jobs
+// is limited by maxConcurrency. Processes are started directly (fork/exec or
+// CreateProcess) with an argument vector, not through a shell, so that texts
+// of a job file are never interpreted as shell commands.
+//
+// Parameters of a command are given by name (params), and are passed as
+// command-line arguments (-key=value), which commands read by their
+// cv::CommandLineParser keys (e.g., calbt, calbnx, calfs1) instead of prompting.
+// Answers to prompts which have no key can still be given in order (input),
+// as the standard input of the command.
+//
+// Job file example (YAML):
+// %YAML:1.0
+// maxConcurrency: 4
+// jobs:
+//    -
+//       name: "calibA"
+//       log: "c:/test/logs/calibA.log"   # optional. Default: <job file dir>/<name>.log
+//       args: [ "-calbt=1" ]             # optional, command-line arguments of all commands of the job
+//       commands:
+//          -
+//             cmd: "callabsite"
+//             params: { calbnx: 7, calbny: 7, calbsx: 57.15, calbsy: 57.15, calfs1: "c:/test/c1/*.JPG" }
+//    -
+//       name: "syncA"
+//       commands:
+//          -
+//             cmd: "syncC2"
+//             input: [ 3, 3, 4, 0, 100, 500, 1000, 0.01, "c:/test/c2sync.xml" ]
+//
+// Logs of jobs with the same name (or the same log file) are made unique by
+// appending the job number (e.g., calibA_3.log).
+//
+// Usage:
+//   ImProConsole -jobs=c:/test/jobs.yml   (headless, then quits. Exit code is 0 if all jobs succeed.)
+//   or command "jobs" in the menu.
+
+struct JobCmd {
+	string cmd;             // command (menu item), e.g., "syncC2"
+	vector<string> params;  // named parameters as command-line arguments ("-key=value")
+	string input;           // standard input of the command (answers of prompts, one per line)
+};
+
+struct JobDesc {
+	string name;            // job name
+	string log;             // log file (standard output and error of the job)
+	vector<string> args;    // command-line arguments passed to all commands of the job
+	vector<JobCmd> cmds;    // commands, run in order
+	int retVal;             // exit code of the first failed command (0 if all succeed)
+	string failedCmd;       // the first failed command
+	double wallTime;        // wall time of the job (sec.)
+};
+
+// converts a FileNode (string, int, or real) to a string
+static string jobNodeToString(const cv::FileNode & node)
+{
+	if (node.isString())
+		return (string)node;
+	if (node.isInt())
+		return std::to_string((int)node);
+	if (node.isReal()) {
+		stringstream ss;
+		ss.precision(17);
+		ss << (double)node;
+		return ss.str();
+	}
+	return string("");
+}
+
+static vector<string> jobNodeToStrings(const cv::FileNode & node)
+{
+	vector<string> strs;
+	if (node.isSeq()) {
+		for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+			strs.push_back(jobNodeToString(*it));
+	}
+	else if (node.empty() == false && node.isNone() == false)
+		strs.push_back(jobNodeToString(node));
+	return strs;
+}
+
+// converts a map of named parameters to command-line arguments ("-key=value")
+static vector<string> jobNodeToParams(const cv::FileNode & node)
+{
+	vector<string> params;
+	if (node.isMap() == false)
+		return params;
+	for (cv::FileNodeIterator it = node.begin(); it != node.end(); ++it)
+		params.push_back("-" + (*it).name() + "=" + jobNodeToString(*it));
+	return params;
+}
+
+// returns the log file name, with "_<job number>" appended if it is already used by another job
+static string uniqueJobLog(string log, int iJob, const vector<JobDesc> & jobs)
+{
+	for (int i = 0; i < (int)jobs.size(); i++) {
+		if (jobs[i].log != log)
+			continue;
+		size_t dot = log.find_last_of('.');
+		size_t slash = log.find_last_of("/\\");
+		if (dot == string::npos || (slash != string::npos && dot < slash))
+			dot = log.length();
+		string newLog = log.substr(0, dot) + "_" + std::to_string(iJob + 1) + log.substr(dot);
+		cerr << "Job " << iJob + 1 << ": log " << log << " is used by job " << i + 1
+			<< ". Writes to " << newLog << " instead.\n";
+		return uniqueJobLog(newLog, iJob, jobs);
+	}
+	return log;
+}
+
+// reads a job file. Returns number of jobs, or -1 if the file cannot be read.
+static int readJobFile(const string & fname, vector<JobDesc> & jobs, int & maxConcurrency)
+{
+	cv::FileStorage fs(fname, cv::FileStorage::READ);
+	if (fs.isOpened() == false) {
+		cerr << "Cannot open job file " << fname << endl;
+		return -1;
+	}
+	maxConcurrency = 1;
+	if (fs["maxConcurrency"].isInt())
+		maxConcurrency = std::max((int)fs["maxConcurrency"], 1);
+	string dir = directoryOfFullPathFile(fname);
+	cv::FileNode jobsNode = fs["jobs"];
+	jobs.clear();
+	int iJob = 0;
+	for (cv::FileNodeIterator it = jobsNode.begin(); it != jobsNode.end(); ++it, ++iJob) {
+		cv::FileNode jobNode = *it;
+		JobDesc job;
+		job.name = jobNodeToString(jobNode["name"]);
+		if (job.name.length() <= 0)
+			job.name = "job" + std::to_string(iJob + 1);
+		job.log = jobNodeToString(jobNode["log"]);
+		if (job.log.length() <= 0)
+			job.log = dir + job.name + ".log";
+		job.log = uniqueJobLog(job.log, iJob, jobs);
+		job.args = jobNodeToStrings(jobNode["args"]);
+		cv::FileNode cmdsNode = jobNode["commands"];
+		for (cv::FileNodeIterator itc = cmdsNode.begin(); itc != cmdsNode.end(); ++itc) {
+			JobCmd cmd;
+			cmd.cmd = jobNodeToString((*itc)["cmd"]);
+			if (cmd.cmd.length() <= 0) {
+				cerr << "Job " << job.name << ": a command without cmd is ignored.\n";
+				continue;
+			}
+			cmd.params = jobNodeToParams((*itc)["params"]);
+			vector<string> answers = jobNodeToStrings((*itc)["input"]);
+			for (int i = 0; i < (int)answers.size(); i++)
+				cmd.input += answers[i] + "\n";
+			job.cmds.push_back(cmd);
+		}
+		job.retVal = -1;
+		job.wallTime = 0.0;
+		jobs.push_back(job);
+	}
+	return (int)jobs.size();
+}
+
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+// quotes an argument for CommandLineToArgvW() / the C runtime: embedded quotes
+// and the backslashes before them (or before the closing quote) are escaped
+static string quoteJobArg(const string & s)
+{
+	string r = "\"";
+	size_t nBackslash = 0;
+	for (size_t i = 0; i < s.length(); i++) {
+		if (s[i] == '\\') {
+			nBackslash++;
+			continue;
+		}
+		if (s[i] == '"') {
+			r.append(nBackslash * 2 + 1, '\\');
+			r += '"';
+		}
+		else {
+			r.append(nBackslash, '\\');
+			r += s[i];
+		}
+		nBackslash = 0;
+	}
+	r.append(nBackslash * 2, '\\');
+	return r + "\"";
+}
+#endif
+
+// runs a program (args[0]) with arguments, standard input from fnameIn, and
+// standard output and error to fnameLog (appended if append is true).
+// Returns the exit code of the program, or -1 if it cannot be started.
+static int runJobProcess(const vector<string> & args, const string & fnameIn, const string & fnameLog, bool append)
+{
+#if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
+	string cmdLine;
+	for (int i = 0; i < (int)args.size(); i++)
+		cmdLine += (i > 0 ? " " : "") + quoteJobArg(args[i]);
+	SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+	HANDLE hIn = CreateFileA(fnameIn.c_str(), GENERIC_READ, FILE_SHARE_READ, &sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	HANDLE hLog = CreateFileA(fnameLog.c_str(), append ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ, &sa,
+		append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hIn == INVALID_HANDLE_VALUE || hLog == INVALID_HANDLE_VALUE) {
+		if (hIn != INVALID_HANDLE_VALUE) CloseHandle(hIn);
+		if (hLog != INVALID_HANDLE_VALUE) CloseHandle(hLog);
+		return -1;
+	}
+	STARTUPINFOA si;
+	PROCESS_INFORMATION pi;
+	ZeroMemory(&si, sizeof(si));
+	ZeroMemory(&pi, sizeof(pi));
+	si.cb = sizeof(si);
+	si.dwFlags = STARTF_USESTDHANDLES;
+	si.hStdInput = hIn;
+	si.hStdOutput = hLog;
+	si.hStdError = hLog;
+	vector<char> cmdBuf(cmdLine.begin(), cmdLine.end());
+	cmdBuf.push_back('\0');
+	BOOL ok = CreateProcessA(NULL, cmdBuf.data(), NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+	CloseHandle(hIn);
+	CloseHandle(hLog);
+	if (ok == FALSE)
+		return -1;
+	DWORD exitCode = (DWORD)-1;
+	WaitForSingleObject(pi.hProcess, INFINITE);
+	GetExitCodeProcess(pi.hProcess, &exitCode);
+	CloseHandle(pi.hProcess);
+	CloseHandle(pi.hThread);
+	return (int)exitCode;
+#else
+	// everything the child needs is prepared before fork() (other threads may hold locks)
+	vector<char *> argv;
+	for (int i = 0; i < (int)args.size(); i++)
+		argv.push_back(const_cast<char *>(args[i].c_str()));
+	argv.push_back(NULL);
+	int fdIn = open(fnameIn.c_str(), O_RDONLY | O_CLOEXEC);
+	int fdLog = open(fnameLog.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+	if (fdIn < 0 || fdLog < 0) {
+		if (fdIn >= 0) close(fdIn);
+		if (fdLog >= 0) close(fdLog);
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == 0) {
+		// dup2() clears close-on-exec of the standard descriptors
+		if (dup2(fdIn, 0) < 0 || dup2(fdLog, 1) < 0 || dup2(fdLog, 2) < 0)
+			_exit(127);
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+	close(fdIn);
+	close(fdLog);
+	if (pid < 0)
+		return -1;
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0)
+		if (errno != EINTR) return -1;
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+	return -1;
+#endif
+}
+
+// runs the commands of a job (each in a child process) until one fails
+static void runJob(JobDesc & job, const string & exe)
+{
+	string fnameIn = job.log + ".in";
+	double t0 = getWallTime();
+	job.retVal = 0;
+	for (int iCmd = 0; iCmd < (int)job.cmds.size(); iCmd++) {
+		const JobCmd & jc = job.cmds[iCmd];
+		ofstream ofs(fnameIn);
+		if (ofs.is_open() == false) {
+			cerr << "Job " << job.name << ": cannot write " << fnameIn << endl;
+			job.retVal = -1;
+			job.failedCmd = jc.cmd;
+			break;
+		}
+		ofs << jc.input;
+		ofs.close();
+
+		vector<string> args;
+		args.push_back(exe);
+		args.push_back("-cmd=" + jc.cmd);
+		args.insert(args.end(), job.args.begin(), job.args.end());
+		args.insert(args.end(), jc.params.begin(), jc.params.end());
+		// the first command creates the log, the others append to it
+		int retVal = runJobProcess(args, fnameIn, job.log, iCmd > 0);
+		if (retVal != 0) {
+			job.retVal = retVal;
+			job.failedCmd = jc.cmd;
+			break;
+		}
+	}
+	std::remove(fnameIn.c_str());
+	job.wallTime = getWallTime() - t0;
+}
+
+int FuncRunJobs(int argc, char** argv)
+{
+	string fnameJobs;
+	vector<JobDesc> jobs;
+	int maxConcurrency = 1;
+
+	// job file from command line (-jobs=file) or console
+	for (int i = 1; i < argc; i++) {
+		string arg(argv[i]);
+		if (arg.find("-jobs=") == 0)
+			fnameJobs = arg.substr(6);
+	}
+	if (fnameJobs.length() <= 0) {
+		cout << "Job file (.yml or .xml) ('g' for gui file dialog): ";
+		fnameJobs = readStringLineFromCin();
+		if (fnameJobs.length() == 1 && fnameJobs[0] == 'g')
+			fnameJobs = uigetfile();
+	}
+	if (readJobFile(fnameJobs, jobs, maxConcurrency) <= 0) {
+		cerr << "No job is found in " << fnameJobs << endl;
+		return -1;
+	}
+	if (argc <= 0 || argv == NULL || argv[0] == NULL) {
+		cerr << "Cannot find the executable to run jobs.\n";
+		return -1;
+	}
+	string exe(argv[0]);
+	int nJob = (int)jobs.size();
+	int nWorker = std::min(maxConcurrency, nJob);
+	cout << "Running " << nJob << " jobs (" << nWorker << " at a time) ...\n";
+
+	// worker pool
+	std::atomic<int> nextJob(0);
+	vector<std::thread> workers;
+	double t0 = getWallTime();
+	for (int w = 0; w < nWorker; w++) {
+		workers.push_back(std::thread([&]() {
+			while (true) {
+				int iJob = nextJob++;
+				if (iJob >= nJob) break;
+				PERF_SCOPE_POINT("jobs.job", iJob);
+				runJob(jobs[iJob], exe);
+			}
+		}));
+	}
+	for (int w = 0; w < nWorker; w++)
+		workers[w].join();
+
+	// summary
+	int nFail = 0;
+	for (int iJob = 0; iJob < nJob; iJob++) {
+		printf("  %-20s %s (%.1f sec.) log: %s\n", jobs[iJob].name.c_str(),
+			jobs[iJob].retVal == 0 ? "done  " : "FAILED", jobs[iJob].wallTime, jobs[iJob].log.c_str());
+		if (jobs[iJob].retVal != 0) {
+			printf("  %-20s command %s exited with %d\n", "", jobs[iJob].failedCmd.c_str(), jobs[iJob].retVal);
+			nFail++;
+		}
+	}
+	cout << nJob - nFail << " jobs done, " << nFail << " failed, in " << getWallTime() - t0 << " sec.\n";
+	return nFail > 0 ? -1 : 0;
+}
@@ -0,0 +1,113 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/utils/filesystem.hpp>
+#include "impro_util.h"
+#include "FileSeq.h"
+#include "IntrinsicCalibrator.h"
+#include "SyntheticSequence.h"
+#include "FramePyramidCache.h"
+
+using namespace std;
+
+// Self tests of components which can be checked without user interaction or
+// data files (images are generated by SyntheticSequence, or written to a 
+// temporary directory and removed afterwards). Each check prints
+// PASS or FAIL. Returns 0 only if all checks pass, so that it can run as a
+// job command (-cmd=selftest).
+
+static int selfTestCheck(bool ok, const string & name)
+{
+	cout << (ok ? "  PASS  " : "  FAIL  ") << name << endl;
+	return ok ? 0 : 1;
+}
+
+// mtm_opfs() with a FramePyramidCache builds the pyramid of a frame once, also when
+// its gray image is a new buffer of every call (color frames, or rotation tracked)
+static int selfTestPyramidCache()
+{
+	SyntheticSequence seq;
+	seq.imgSize = cv::Size(400, 300);
+	seq.transPerStep = cv::Point2f(0.6f, -0.4f);
+	if (seq.init() != 0)
+		return selfTestCheck(false, "pyramid cache: synthetic sequence");
+	cv::Mat img0, img1;
+	seq.render(0, img0);
+	seq.render(1, img1);
+	vector<cv::Point2f> pts;
+	for (int y = 100; y <= 200; y += 100)
+		for (int x = 100; x <= 300; x += 100)
+			pts.push_back(cv::Point2f((float)x, (float)y));
+
+	int nFail = 0;
+	for (int iCase = 0; iCase < 2; iCase++) {
+		// case 0: color frames. case 1: gray frames with rotation tracked.
+		cv::Mat imgInit = img0, imgSrch = img1;
+		if (iCase == 0) {
+			cv::cvtColor(img0, imgInit, cv::COLOR_GRAY2BGR);
+			cv::cvtColor(img1, imgSrch, cv::COLOR_GRAY2BGR);
+		}
+		vector<float> maxMove(3, 5.f);
+		maxMove[2] = (iCase == 1) ? 2.f : 0.f;
+		FramePyramidCache pyrs(4);
+		for (int iCall = 0; iCall < 2; iCall++) {
+			vector<cv::Point3f> srch(pts.size());
+			for (size_t i = 0; i < pts.size(); i++)
+				srch[i] = cv::Point3f(pts[i].x, pts[i].y, 0.f);
+			vector<uchar> status;
+			vector<float> error, timing;
+			mtm_opfs(imgInit, imgSrch, pts, srch, maxMove, status, error, timing,
+				cv::Size(25, 25), 3,
+				cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01),
+				cv::OPTFLOW_USE_INITIAL_FLOW, &pyrs, -1, 1);
+		}
+		// first call builds both pyramids, second call reuses both
+		nFail += selfTestCheck(pyrs.numBuilt() == 2 && pyrs.numReused() == 2,
+			string("pyramid cache hit across calls (") + (iCase == 0 ? "color frames)" : "gray frames, rotation tracked)"));
+	}
+	return nFail;
+}
+
+// calibrateTwoCameras() returns an error (instead of terminating the program) when 
+// calibration of a camera throws in its thread. The set has corners (read from 
+// per-photo _corners.xml files) of a 3x1 board, which cv::calibrateCamera() rejects 
+// (fewer than 4 points per photo). 
+static int selfTestCalibrationFailure()
+{
+	string dir = "selftest_calib_tmp/";
+	cv::utils::fs::createDirectories(dir);
+	cv::Size bSize(3, 1);
+	vector<string> files(1, dir);
+	cv::RNG rng(1);
+	for (int i = 0; i < 3; i++) {
+		string fname = "photo" + to_string(i + 1) + ".png";
+		cv::Mat img(48, 64, CV_8U);
+		rng.fill(img, cv::RNG::UNIFORM, 0, 256);
+		cv::imwrite(dir + fname, img);
+		vector<cv::Point2f> corners;
+		for (int j = 0; j < bSize.width; j++)
+			corners.push_back(cv::Point2f(10.f + 10.f * j + i, 20.f + 2.f * i));
+		cv::FileStorage fs(dir + "photo" + to_string(i + 1) + "_corners.xml", cv::FileStorage::WRITE);
+		fs << "CornersVecPoint2f" << corners;
+		files.push_back(fname);
+	}
+	FileSeq fsq;
+	fsq.setFilesByStringVec(files);
+	IntrinsicCalibrator cal1, cal2;
+	cal1.setFileSeq(fsq);
+	cal2.setFileSeq(fsq);
+	int ret = calibrateTwoCameras(cal1, cal2, bSize, 1.f, 1.f, 1, 1, 1);
+	cv::utils::fs::remove_all(dir);
+	return selfTestCheck(ret == -2, "calibrateTwoCameras() returns -2 for a set that fails to calibrate");
+}
+
+int FuncSelfTest(int argc, char ** argv)
+{
+	int nFail = 0;
+	cout << "Self tests:\n";
+	nFail += selfTestPyramidCache();
+	nFail += selfTestCalibrationFailure();
+	cout << (nFail == 0 ? "All self tests passed.\n" : "Some self tests FAILED.\n");
+	return nFail == 0 ? 0 : -1;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "impro_util.h"
+#include "matchTemplateWithRotPyr.h"
+#include "IcgnMatcher.h"
+#include "SyntheticSequence.h"
+#include "FramePyramidCache.h"
+
+using namespace std;
+
+// Generates a synthetic image sequence with known motion (SyntheticSequence),
+// writes the images and the ground truth, and runs the tracking methods of
+// this program over it, reporting throughput and error against the ground
+// truth. The written sequence (pictures + truth) can also be fed to the
+// interactive commands (ecc, tmatch, optflow) through a job file (see jobs).
+//
+// Methods:
+//   1. matchTemplateWithRotPyr (pyramid template match)
+//   2. mtm_ecc (template match + ECC)
+//   3. mtm_opfs (template match + optical flow, all points)
+//   4. calcOpticalFlowPyrLK (all points)
+//   5. IcgnMatcher (IC-GN, affine shape function)
+//   6. calcOpticalFlowFarneback (dense, sampled at points)
+
+static const char * synthMethodNames[] = { "", "tmatchPyr", "mtm_ecc", "mtm_opfs", "LK", "IC-GN", "Farneback" };
+
+// tracks all points over all steps (step 0 is the initial image). est[iStep][iPoint]
+static double synthTrack(int method, const vector<cv::Mat> & imgs, const vector<cv::Point2f> & pts0,
+	int tSize, vector<vector<cv::Point2f> > & est)
+{
+	int nStep = (int)imgs.size(), nPoint = (int)pts0.size();
+	int hw = tSize / 2;
+	est.assign(nStep, pts0);
+	IcgnMatcher icgn;
+	vector<int> icgnIdx(nPoint, -1);
+	if (method == 5) {
+		icgn.setReferenceImage(imgs[0]);
+		for (int i = 0; i < nPoint; i++)
+			icgnIdx[i] = icgn.addSubset(pts0[i], cv::Size(tSize, tSize));
+	}
+	FramePyramidCache pyrs(3);  // pyramid of the initial image is built once (frame id: step index)
+	vector<cv::Mat> tmplts(nPoint);
+	vector<cv::Point2f> refs(nPoint);
+	for (int i = 0; i < nPoint; i++) {
+		cv::Rect r((int)(pts0[i].x + .5f) - hw, (int)(pts0[i].y + .5f) - hw, tSize, tSize);
+		r &= cv::Rect(0, 0, imgs[0].cols, imgs[0].rows);
+		tmplts[i] = imgs[0](r).clone();
+		refs[i] = pts0[i] - cv::Point2f((float)r.x, (float)r.y);
+	}
+
+	double t0 = getWallTime();
+	for (int iStep = 1; iStep < nStep; iStep++) {
+		const vector<cv::Point2f> & guess = est[iStep - 1];
+		vector<cv::Point2f> & out = est[iStep];
+		const cv::Mat & img = imgs[iStep];
+		if (method == 1 || method == 2 || method == 5) {
+			if (method == 5)
+				icgn.setDeformedImage(img);
+#pragma omp parallel for schedule(dynamic)
+			for (int i = 0; i < nPoint; i++) {
+				vector<double> result(12);
+				cv::Point2f p(std::nanf(""), std::nanf(""));
+				if (std::isnan(guess[i].x)) { out[i] = p; continue; }
+				if (method == 1) {
+					int ret = matchTemplateWithRotPyr(img, tmplts[i], refs[i].x, refs[i].y,
+						guess[i].x - hw / 2, guess[i].x + hw / 2, 0.01,
+						guess[i].y - hw / 2, guess[i].y + hw / 2, 0.01,
+						0., 0., 1., result, cv::TM_CCORR_NORMED, -1, -1, -1, true);
+					if (ret == 0) p = cv::Point2f((float)result[0], (float)result[1]);
+				}
+				else if (method == 2) {
+					int ret = mtm_ecc(img, imgs[0], pts0[i], cv::Size(tSize, tSize), result, guess[i], 0.f,
+						guess[i].x - hw, guess[i].x + hw, guess[i].y - hw, guess[i].y + hw);
+					if (ret == 0) p = cv::Point2f((float)result[0], (float)result[1]);
+				}
+				else {
+					int ret = icgn.match(icgnIdx[i], guess[i], result);
+					if (ret == 0 || ret == -3) p = cv::Point2f((float)result[0], (float)result[1]);
+				}
+				out[i] = p;
+			}
+		}
+		else if (method == 3) {
+			vector<cv::Point3f> srch(nPoint);
+			for (int i = 0; i < nPoint; i++) srch[i] = cv::Point3f(guess[i].x, guess[i].y, 0.f);
+			vector<float> maxMove = { (float)hw, (float)hw, 0.f };
+			vector<uchar> status; vector<float> error, timing;
+			mtm_opfs(imgs[0], img, pts0, srch, maxMove, status, error, timing, cv::Size(tSize, tSize), 3,
+				cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01), cv::OPTFLOW_USE_INITIAL_FLOW,
+				&pyrs, 0, iStep);
+			pyrs.release(iStep);
+			for (int i = 0; i < nPoint; i++)
+				out[i] = (i < (int)status.size() && status[i]) ? cv::Point2f(srch[i].x, srch[i].y) : cv::Point2f(std::nanf(""), std::nanf(""));
+		}
+		else if (method == 4) {
+			vector<uchar> status; vector<float> error;
+			out = guess;
+			vector<cv::Mat> pyr0 = pyrs.get(0, PYR_VARIANT_RAW, imgs[0], cv::Size(tSize, tSize), 3);
+			vector<cv::Mat> pyr = pyrs.get(iStep, PYR_VARIANT_RAW, img, cv::Size(tSize, tSize), 3);
+			pyrs.release(iStep);
+			cv::calcOpticalFlowPyrLK(pyr0, pyr, pts0, out, status, error, cv::Size(tSize, tSize), 3,
+				cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50, 0.001), cv::OPTFLOW_USE_INITIAL_FLOW);
+			for (int i = 0; i < nPoint; i++)
+				if (status[i] == 0) out[i] = cv::Point2f(std::nanf(""), std::nanf(""));
+		}
+		else if (method == 6) {
+			cv::Mat flow;
+			cv::calcOpticalFlowFarneback(imgs[0], img, flow, 0.5, 4, tSize, 5, 7, 1.5, 0);
+			for (int i = 0; i < nPoint; i++) {
+				cv::Mat f;
+				cv::getRectSubPix(flow, cv::Size(1, 1), pts0[i], f, CV_32FC2);
+				out[i] = pts0[i] + f.at<cv::Point2f>(0, 0);
+			}
+		}
+	}
+	return getWallTime() - t0;
+}
+
+int FuncSynthBenchmark(int argc, char** argv)
+{
+	SyntheticSequence seq;
+	cout << "Output directory of synthetic sequence and report: ";
+	string dir = appendSlashOrBackslashAfterDirectoryIfNecessary(readStringLineFromCin());
+	cout << "Image width and height (e.g., 800 600): ";
+	seq.imgSize.width = readIntFromCin(32, 100000);
+	seq.imgSize.height = readIntFromCin(32, 100000);
+	cout << "Pattern (1: speckles, 2: circular markers): ";
+	seq.pattern = readIntFromCin(SYNTH_PATTERN_SPECKLE, SYNTH_PATTERN_MARKERS);
+	cout << "Number of steps (including the initial image): ";
+	int nStep = readIntFromCin(2, 1000000);
+	cout << "Translation per step (x y, pixel, e.g., 0.37 -0.21): ";
+	seq.transPerStep.x = (float)readDoubleFromCin();
+	seq.transPerStep.y = (float)readDoubleFromCin();
+	cout << "Rotation per step (degree): ";
+	seq.rotPerStep = readDoubleFromCin();
+	cout << "Strain per step (exx eyy exy, e.g., 0.0005 0 0): ";
+	seq.strainPerStep[0] = readDoubleFromCin();
+	seq.strainPerStep[1] = readDoubleFromCin();
+	seq.strainPerStep[2] = readDoubleFromCin();
+	cout << "Noise sigma (gray level) and blur sigma (pixel) (e.g., 2 0.5): ";
+	seq.noiseSigma = readDoubleFromCin(0., 1e3);
+	seq.blurSigma = readDoubleFromCin(0., 1e3);
+	cout << "Grid of tracked points (nx ny, e.g., 10 8): ";
+	int nx = readIntFromCin(1, 10000), ny = readIntFromCin(1, 10000);
+	cout << "Template (subset) size (pixel, e.g., 31): ";
+	int tSize = readIntFromCin(5, 1000);
+	cout << "Write pictures (1) or only run benchmark (0): ";
+	int writePics = readIntFromCin(0, 1);
+	if (seq.init() != 0) return -1;
+
+	// render sequence
+	vector<cv::Mat> imgs(nStep);
+	double t0 = getWallTime();
+#pragma omp parallel for
+	for (int iStep = 0; iStep < nStep; iStep++) {
+		seq.render(iStep, imgs[iStep]);
+		if (writePics) {
+			char fname[1000];
+			snprintf(fname, 1000, "%ssynth_%05d.png", dir.c_str(), iStep);
+			cv::imwrite(fname, imgs[iStep]);
+		}
+	}
+	cout << nStep << " images rendered in " << getWallTime() - t0 << " sec.\n";
+
+	// points (grid within the part of image which stays in view) and ground truth
+	vector<cv::Point2f> pts0;
+	float mx = 0.2f * seq.imgSize.width, my = 0.2f * seq.imgSize.height;
+	for (int iy = 0; iy < ny; iy++)
+		for (int ix = 0; ix < nx; ix++)
+			pts0.push_back(cv::Point2f(
+				mx + (nx > 1 ? ix * (seq.imgSize.width - 2 * mx) / (nx - 1) : .5f * (seq.imgSize.width - 2 * mx)),
+				my + (ny > 1 ? iy * (seq.imgSize.height - 2 * my) / (ny - 1) : .5f * (seq.imgSize.height - 2 * my))));
+	int nPoint = (int)pts0.size();
+	vector<vector<cv::Point2f> > truth(nStep, vector<cv::Point2f>(nPoint));
+	for (int iStep = 0; iStep < nStep; iStep++)
+		for (int i = 0; i < nPoint; i++)
+			truth[iStep][i] = seq.truth(iStep, pts0[i]);
+	cv::FileStorage ofsTruth(dir + "synth_truth.xml", cv::FileStorage::WRITE);
+	ofsTruth << "numSteps" << nStep;
+	ofsTruth << "numPoints" << nPoint;
+	ofsTruth << "VecVecPoint2f" << truth;
+	ofsTruth.release();
+
+	// benchmark
+	ofstream ofsReport(dir + "synth_benchmark.txt");
+	char buf[1000];
+	snprintf(buf, 1000, "%-12s %10s %12s %10s %10s %8s\n", "Method", "Time(s)", "Points/s", "RMS(px)", "Max(px)", "Fail");
+	cout << buf; ofsReport << buf;
+	for (int method = 1; method <= 6; method++) {
+		vector<vector<cv::Point2f> > est;
+		double t = synthTrack(method, imgs, pts0, tSize, est);
+		double se = 0.0, maxErr = 0.0;
+		int nValid = 0, nFail = 0;
+		for (int iStep = 1; iStep < nStep; iStep++) {
+			for (int i = 0; i < nPoint; i++) {
+				cv::Point2f d = est[iStep][i] - truth[iStep][i];
+				double e = sqrt(d.x * d.x + d.y * d.y);
+				if (std::isnan(e) || e > 1.0) { nFail++; continue; }  // more than one pixel is a failure
+				se += e * e; maxErr = std::max(maxErr, e); nValid++;
+			}
+		}
+		snprintf(buf, 1000, "%-12s %10.3f %12.1f %10.4f %10.4f %8d\n", synthMethodNames[method], t,
+			nPoint * (nStep - 1) / std::max(t, 1e-9), sqrt(se / std::max(nValid, 1)), maxErr, nFail);
+		cout << buf; ofsReport << buf;
+	}
+	cout << "Ground truth: " << dir + "synth_truth.xml" << "\nReport: " << dir + "synth_benchmark.txt" << endl;
+	return 0;
+}
@@ -13,6 +13,8 @@
 
 #include "FileSeq.h"
 #include "impro_util.h"
+#include "PreviewDisplay.h"
+#include "PerfTrace.h"
 
 using namespace std;
 
@@ -28,7 +30,7 @@ const cv::String keys =
 "{outCompact oCpt    |      | output compact (only x y) summary file name.}"
 "{outFrame   oFrame  |      | output picture which plots boxes on each point. Actual file name is oFrame_%06d.jpg}"
 "{outVideo   oVideo  |      | output video which plots boxes on each point.}"
-"{showBoxes  showBx  |      | 1 for showing tracked boxes }"
+"{showBoxes  showBx  |      | 1 for showing tracked boxes in a preview window, 2 for recording them to files (one picture per second, named after oFrame) }"
 "{noAsk      noAsk   |      | 1 for automatic mode, not asking any questions for optional settings }"
 ;
 
@@ -43,6 +45,8 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 	string oSum;            // file of summary result
 	string oCpt;            // file of compact (only x and y for each point) of summary result
 	bool   showBx;          // boolean of showing pictures of tracked boxes 
+	int    showMode;        // PREVIEW_OFF, PREVIEW_ASYNC, or PREVIEW_RECORD 
+	string showPrefix;      // file prefix of recorded preview pictures (PREVIEW_RECORD) 
 
 	int nFrame, nPoint;
 	FileSeq fseq;
@@ -291,13 +295,19 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 	if (pparser)
 		showBxStr = (*pparser).get<string>("showBx");
 	if (showBxStr.length() <= 0) {
-		std::cout << "Show pictures of tracked points? (1 for true): ";
+		std::cout << "Show pictures of tracked points? (1 for preview window, 2 for recording them to files): ";
 		showBxStr = readStringFromCin();
-		if (showBxStr.length() >= 1 && showBxStr[0] == '1')
-			showBx = true;
-		else
-			showBx = false;
 	}
+	showMode = PREVIEW_OFF;
+	if (showBxStr.length() >= 1 && showBxStr[0] == '1')
+		showMode = PREVIEW_ASYNC;
+	else if (showBxStr.length() >= 1 && showBxStr[0] == '2') {
+		showMode = PREVIEW_RECORD;
+		showPrefix = (oFrame.length() > 1 ? oFrame : fseq.directory() + "tracked") + "_preview";
+	}
+	showBx = (showMode != PREVIEW_OFF);
+	PreviewDisplay display(showMode, showPrefix);
+	display.setMaxSize(cv::Size(1280, 720));
 
 	printf("Motion type of point %d is %d \n", 0, mTypes[0]);
 	printf("Motion type of point %d is %d \n", nPoint - 1, mTypes[nPoint - 1]);
@@ -378,6 +388,7 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 //#pragma omp parallel for
 		for (int iPoint = 0; iPoint < nPoint; iPoint++)
 		{
+			PERF_SCOPE_POINT("ecc.point", iPoint);
 			// timing pre-processing
 			double t_point_pre = (double)cv::getTickCount();
 
@@ -606,17 +617,9 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 			if (oVideo.length() > 0 && oVideo[0] != 'n' && oVideoWriter.isOpened())
 				oVideoWriter << imgBoxed;
 
-			// show boxes 
-			if (showBx == true) {
-				cv::Mat imgShow;
-				int maxW = 1280, maxH = 720;
-				float facH = maxH * 1.0f / imgBoxed.rows;
-				float facW = maxW * 1.0f / imgBoxed.cols;
-				float fac = facH > facW ? facW : facH;
-				cv::resize(imgBoxed, imgShow, cv::Size(0, 0), fac, fac, cv::INTER_LANCZOS4);
-				cv::imshow("Tracked points", imgShow);
-				cv::waitKey(1);
-			}
+			// show boxes (resized and rendered by the display thread, not waiting for it)
+			if (showBx == true)
+				display.show("Tracked points", imgBoxed);
 		} // end if output box plot
 		t_writeImg = ((double)cv::getTickCount() - t_writeImg) / cv::getTickFrequency();
 		bigTableEcc.at<float>(iFrame, 4) = (float)t_writeImg; //	execution time (sec) to write frame boxed image
@@ -743,7 +746,7 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 		ofsFileCompact.release();
 	}  // end of output summary 
 
-	cv::destroyWindow("Tracked points");
+	display.close();
 	return 0;
 }
 
@@ -757,7 +760,7 @@ int FuncTrackingPointsEcc(int argc, char** argv)
 //"{outCompact oCpt    |      | output compact (only x y) summary file name.}"
 //"{outFrame   oFrame  |      | output picture which plots boxes on each point. Actual file name is oFrame_%06d.jpg}"
 //"{outVideo   oVideo  |      | output video which plots boxes on each point.}"
-//"{showBoxes  showBx  |      | 1 for showing tracked boxes }"
+//"{showBoxes  showBx  |      | 1 for showing tracked boxes in a preview window, 2 for recording them to files (one picture per second, named after oFrame) }"
 //"{noAsk      noAsk   |      | 1 for automatic mode, not asking any questions for optional settings }"
 //;
 //
@@ -772,6 +775,8 @@ int _old_FuncTrackingPointsEcc(int argc, char** argv)
 	string oSum;            // file of summary result
 	string oCpt;            // file of compact (only x and y for each point) of summary result
 	bool   showBx;          // boolean of showing pictures of tracked boxes 
+	int    showMode;        // PREVIEW_OFF, PREVIEW_ASYNC, or PREVIEW_RECORD 
+	string showPrefix;      // file prefix of recorded preview pictures (PREVIEW_RECORD) 
 
 	int nFrame, nPoint;
 	FileSeq fseq;
@@ -1016,13 +1021,19 @@ int _old_FuncTrackingPointsEcc(int argc, char** argv)
 	if (pparser)
 		showBxStr = (*pparser).get<string>("showBx");
 	if (showBxStr.length() <= 0) {
-		std::cout << "Show pictures of tracked points? (1 for true): ";
+		std::cout << "Show pictures of tracked points? (1 for preview window, 2 for recording them to files): ";
 		showBxStr = readStringFromCin();
-		if (showBxStr.length() >= 1 && showBxStr[0] == '1')
-			showBx = true;
-		else
-			showBx = false; 
 	}
+	showMode = PREVIEW_OFF;
+	if (showBxStr.length() >= 1 && showBxStr[0] == '1')
+		showMode = PREVIEW_ASYNC;
+	else if (showBxStr.length() >= 1 && showBxStr[0] == '2') {
+		showMode = PREVIEW_RECORD;
+		showPrefix = (oFrame.length() > 1 ? oFrame : fseq.directory() + "tracked") + "_preview";
+	}
+	showBx = (showMode != PREVIEW_OFF);
+	PreviewDisplay display(showMode, showPrefix);
+	display.setMaxSize(cv::Size(1280, 720));
 	
 	printf("Motion type of point %d is %d \n", 0, mTypes[0]);
 	printf("Motion type of point %d is %d \n", nPoint - 1, mTypes[nPoint - 1]);
@@ -1103,6 +1114,7 @@ int _old_FuncTrackingPointsEcc(int argc, char** argv)
 //#pragma omp parallel for
 		for (int iPoint = 0; iPoint < nPoint; iPoint++)
 		{
+			PERF_SCOPE_POINT("ecc.point", iPoint);
 			// timing pre-processing
 			double t_point_pre = (double)cv::getTickCount();
 
@@ -1330,17 +1342,9 @@ int _old_FuncTrackingPointsEcc(int argc, char** argv)
 			if (oVideo.length() > 0 && oVideo[0] != 'n' && oVideoWriter.isOpened())
 				oVideoWriter << imgBoxed; 
 
-			// show boxes 
-			if (showBx == true) {
-				cv::Mat imgShow;
-				int maxW = 1280, maxH = 720;
-				float facH = maxH * 1.0f / imgBoxed.rows;
-				float facW = maxW * 1.0f / imgBoxed.cols;
-				float fac = facH > facW ? facW : facH;
-				cv::resize(imgBoxed, imgShow, cv::Size(0, 0), fac, fac, cv::INTER_LANCZOS4);
-				cv::imshow("Tracked points", imgShow);
-				cv::waitKey(1);
-			}
+			// show boxes (resized and rendered by the display thread, not waiting for it)
+			if (showBx == true)
+				display.show("Tracked points", imgBoxed);
 		} // end if output box plot
 		t_writeImg = ((double)cv::getTickCount() - t_writeImg) / cv::getTickFrequency();
 		bigTableEcc.at<float>(iFrame, 4) = (float)t_writeImg; //	execution time (sec) to write frame boxed image
@@ -1441,6 +1445,6 @@ int _old_FuncTrackingPointsEcc(int argc, char** argv)
 		std::cout << oCpt << " is written.\n"; cout.flush();
 	}  // end of output summary 
 
-	cv::destroyWindow("Tracked points");
+	display.close();
 	return 0;
 }
@@ -15,6 +15,7 @@
 #include "impro_util.h"
 
 #include "matchTemplateWithRotPyr.h"
+#include "PerfTrace.h"
 
 using namespace std;
 
@@ -315,11 +316,40 @@ int FuncTrackingPyrTmpltMatch(int argc, char** argv)
 	int64 tickCountStart = cv::getTickCount();
 	for (int iFrame = 1; iFrame < nFrame; iFrame++)
 	{
+		// search windows of all points (in full-image coordinate)
+		// (based on previous result, same as the initial guess in the tracking loop below)
+		vector<cv::Rect> rectsSearch(nPoint);
+		for (int iPoint = 0; iPoint < nPoint; iPoint++) {
+			int iFramePreviousValid = 0;
+			for (iFramePreviousValid = iFrame - 1; iFramePreviousValid > 0; iFramePreviousValid--) {
+				if (bigTableTm.at<float>(iFrame - 1, nfFrm + 13 + iPoint * nfPnt) >= coef_threshold)
+					break;
+			}
+			cv::Point2f refPoint;
+			cv::Point2f est(bigTableTm.at<float>(iFramePreviousValid, nfFrm + 14 + iPoint * nfPnt),
+				bigTableTm.at<float>(iFramePreviousValid, nfFrm + 15 + iPoint * nfPnt));
+			rectsSearch[iPoint] = getTmpltRectFromImageSize(imgInit.size(), est,
+				cv::Size(tmpltBoxes[iPoint].width + 2 * maxSearchSizeX[iPoint],
+					tmpltBoxes[iPoint].height + 2 * maxSearchSizeY[iPoint]), refPoint);
+		}
+
 		// read image
+		// If boxed pictures are not needed, only the region covering all search windows
+		// is kept (roiCurr, in full-image coordinate).
 		double t_imreadFrm = (double)cv::getTickCount();
 		fseq.waitForFile(iFrame);
-		imgBoxed = cv::imread(fseq.fullPathOfFile(iFrame), cv::IMREAD_COLOR);
-		cv::cvtColor(imgBoxed, imgCurr, cv::COLOR_BGR2GRAY);
+		cv::Rect roiCurr(0, 0, imgInit.cols, imgInit.rows);
+		if (oFrame.length() > 0 || showBx == true || oVideo.length() > 0) {
+			imgBoxed = cv::imread(fseq.fullPathOfFile(iFrame), cv::IMREAD_COLOR);
+			if (imgBoxed.cols > 0 && imgBoxed.rows > 0)
+				cv::cvtColor(imgBoxed, imgCurr, cv::COLOR_BGR2GRAY);
+			else
+				imgCurr = cv::Mat();
+		}
+		else {
+			if (imreadRoi(fseq.fullPathOfFile(iFrame), rectsSearch, imgCurr, roiCurr, cv::IMREAD_GRAYSCALE) != 0)
+				imgCurr = cv::Mat();
+		}
 		if (imgCurr.cols <= 0 || imgCurr.rows <= 0) {
 			cerr << "Cannot read image " << iFrame << ": " << fseq.fullPathOfFile(iFrame) << ".\n";
 			cerr.flush();
@@ -329,7 +359,7 @@ int FuncTrackingPyrTmpltMatch(int argc, char** argv)
 
 		bigTableTm.at<float>(iFrame, 0) = (float)iFrame;
 		bigTableTm.at<float>(iFrame, 1) = (float)nPoint;
-		bigTableTm.at<float>(iFrame, 2) = (float)t_imreadFrm0; // execution time (sec) to read image file
+		bigTableTm.at<float>(iFrame, 2) = (float)t_imreadFrm; // execution time (sec) to read image file
 		bigTableTm.at<float>(iFrame, 3) = (float) 0.f; //	execution time (sec) to write frame result file 
 		bigTableTm.at<float>(iFrame, 4) = (float) 0.f; //	execution time (sec) to write frame boxed image
 
@@ -337,6 +367,7 @@ int FuncTrackingPyrTmpltMatch(int argc, char** argv)
 //#pragma omp parallel for
 		for (int iPoint = 0; iPoint < nPoint; iPoint++)
 		{
+			PERF_SCOPE_POINT("tmatch.point", iPoint);
 			// timing pre-processing
 			double t_point_pre = (double)cv::getTickCount();
 
@@ -419,22 +450,19 @@ int FuncTrackingPyrTmpltMatch(int argc, char** argv)
 					imgCurr,
 					imgInit(tmpltBoxes[iPoint]),
 					ref_x, ref_y,
-					min_x, max_x, prc_x,
-					min_y, max_y, prc_y,
+					min_x - roiCurr.x, max_x - roiCurr.x, prc_x,
+					min_y - roiCurr.y, max_y - roiCurr.y, prc_y,
 					min_r, max_r, prc_r,
 					tmRes);
+				tmRes[0] += roiCurr.x;
+				tmRes[1] += roiCurr.y;
 			}
 			else if (cloneImagesBeforeTracking == 1) {
 				// copy to smaller clone images
-				int maxMoveX = maxSearchSizeX[iPoint];
-				int maxMoveY = maxSearchSizeY[iPoint];
-				cv::Point2f refPoint;
 				cv::Mat imgTmplt, imgSearch;
 				imgInit(tmpltBoxes[iPoint]).copyTo(imgTmplt);
-				cv::Rect rectSearch =
-					getTmpltRectFromImage(imgCurr, cv::Point2f((float)est_x, (float)est_y),
-						cv::Size(imgTmplt.cols + 2 * maxMoveX, imgTmplt.rows + 2 * maxMoveY), refPoint);
-				imgCurr(rectSearch).copyTo(imgSearch);
+				cv::Rect rectSearch = rectsSearch[iPoint];
+				imgCurr(rectSearch - roiCurr.tl()).copyTo(imgSearch);
 				matchTemplateWithRotPyr(
 					imgSearch,
 					imgTmplt,
@@ -1,9 +1,122 @@
 #include <iostream>
+#include <thread>
+#include <functional>
 #include <opencv2/opencv.hpp>
+#include <omp.h>
 #include "impro_util.h"
+#include "PerfTrace.h"
 
 using namespace std;
 
+// Options without prompts (defaults are used if not given)
+const cv::String keys =
+"{help          h usage ? |   | print this message   }"
+"{stride                  | 1 | video to pictures: 1 for every frame, n for every n-th frame }"
+;
+
+// Video-to-pictures pipeline.
+// The calling thread decodes a batch of frames in a separate (std::thread)
+// decoder while the previous batch is cropped, resized and encoded by a pool
+// of OpenMP threads. Output file names are given by the order of frames
+// (0, 1, 2, ...) so that they do not depend on which thread writes them.
+// Frames between selected ones (frame range and stride) are skipped by
+// seeking (if the container supports it and the gap is large) or by grab()
+// which does not convert (retrieve) the frame.
+// A batch holds frames up to video2PicsBatchBytes (at least one frame), so
+// memory (two batches: one being encoded, one being decoded) does not grow
+// with the number of threads or the frame size.
+static const long long video2PicsBatchBytes = 256LL * 1024 * 1024;
+
+static int video2PicsSkipTo(cv::VideoCapture & vid, int & iPos, int iTarget)
+{
+	const int seekThreshold = 32;
+	if (iTarget - iPos >= seekThreshold) {
+		if (vid.set(cv::CAP_PROP_POS_FRAMES, (double)iTarget) &&
+			(int)(vid.get(cv::CAP_PROP_POS_FRAMES) + .5) == iTarget) {
+			iPos = iTarget;
+			return 0;
+		}
+	}
+	while (iPos < iTarget) {
+		if (vid.grab() == false) return -1;
+		iPos++;
+	}
+	return 0;
+}
+
+static void video2PicsDecodeBatch(cv::VideoCapture & vid, int & iPos, int & iNext, int iEnd, int stride,
+	long long batchBytes, vector<cv::Mat> & frames, vector<int> & frameIds)
+{
+	PERF_SCOPE("v2p.decodeBatch");
+	frames.clear();
+	frameIds.clear();
+	long long bytes = 0;
+	while ((frames.size() == 0 || bytes < batchBytes) && iNext < iEnd) {
+		cv::Mat buf;
+		if (video2PicsSkipTo(vid, iPos, iNext) != 0 || vid.read(buf) == false || buf.empty()) {
+			iNext = iEnd; // end of video
+			break;
+		}
+		iPos++;
+		frames.push_back(buf);
+		frameIds.push_back(iNext);
+		bytes += (long long)buf.total() * buf.elemSize();
+		iNext += stride;
+	}
+}
+
+static int video2Pics(cv::VideoCapture & vid, int iStart, int iEnd, int stride,
+	cv::Rect roiCrop, cv::Size outSize, const string & fnamePicsFormat)
+{
+	vector<cv::Mat> frames[2];
+	vector<int> frameIds[2];
+	int iPos = 0, iNext = iStart, nWritten = 0, nFailed = 0;
+	if (iStart > 0 && video2PicsSkipTo(vid, iPos, iStart) != 0) {
+		cerr << "  Cannot skip to frame " << iStart << endl;
+		return -1;
+	}
+	// first batch
+	video2PicsDecodeBatch(vid, iPos, iNext, iEnd, stride, video2PicsBatchBytes, frames[0], frameIds[0]);
+	for (int k = 0; frames[k % 2].size() > 0; k++) {
+		vector<cv::Mat> & curFrames = frames[k % 2];
+		vector<int> & curIds = frameIds[k % 2];
+		// decode next batch while this batch is being encoded
+		std::thread decoder(video2PicsDecodeBatch, std::ref(vid), std::ref(iPos), std::ref(iNext), iEnd, stride,
+			video2PicsBatchBytes, std::ref(frames[(k + 1) % 2]), std::ref(frameIds[(k + 1) % 2]));
+		int nBatchWritten = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:nBatchWritten)
+		for (int j = 0; j < (int)curFrames.size(); j++) {
+			PERF_SCOPE("v2p.encode");
+			char fnamePic[1000];
+			sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), (curIds[j] - iStart) / stride);
+			cv::Mat pic = curFrames[j];
+			if (roiCrop.width > 0 && roiCrop.height > 0 && roiCrop != cv::Rect(0, 0, pic.cols, pic.rows))
+				pic = pic(roiCrop & cv::Rect(0, 0, pic.cols, pic.rows));
+			if (outSize.width > 0 && outSize.height > 0 && outSize != pic.size()) {
+				cv::Mat resized;
+				cv::resize(pic, resized, outSize, 0.0, 0.0, cv::INTER_LANCZOS4);
+				pic = resized;
+			}
+			if (cv::imwrite(fnamePic, pic) == false) {
+#pragma omp critical
+				cerr << "  Cannot write " << fnamePic << endl;
+				continue;
+			}
+			nBatchWritten++;
+		}
+		decoder.join();
+		nWritten += nBatchWritten;
+		nFailed += (int)curFrames.size() - nBatchWritten;
+		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+		cout << "Written " << nWritten << " frames (up to frame " << curIds.back() << ") ...";
+		curFrames.clear();
+	}
+	cout << endl;
+	if (nFailed > 0)
+		cerr << "  " << nFailed << " frames could not be written.\n";
+	return nWritten;
+}
+
 int FuncVideo2Pics(int argc, char** argv)
 {
 	string fnameVid, fnameFlist; 
@@ -42,38 +155,83 @@ int FuncVideo2Pics(int argc, char** argv)
 	nFrame = readIntFromIstream(cin);
 	if (nFrame < 0)
 		nFrame = vid_FRAME_COUNT - iStart;
+	cv::CommandLineParser parser(argc, argv, keys);
+	int stride = std::max(parser.get<int>("stride"), 1); // every stride-th frame (see keys)
 
 	// Picture files
 	cout << "Full path file names of pictures (in C-style format including a %d, space allowed): ";
 	string fnamePicsFormat = readStringLineFromIstream(cin); 
 
-	// Read video and skip to frame iStart
-	for (int i = 0; i < iStart; i++)
-	{
-		cv::Mat buf;
-		vid >> buf; 
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Skipping frame " << i << " ...";
-	}
-
-	// Start converting video to pictures
-	char fnamePic[1000];
-	for (int i = iStart; i < iStart + nFrame; i++)
-	{
-		if (i >= vid_FRAME_COUNT) break;
-		cv::Mat buf; 
-		vid >> buf; 
-		sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), i - iStart);
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Writing frame " << i << " ...";
-		cv::imwrite(fnamePic, buf); 
-	}
+	// Convert video to pictures
+	video2Pics(vid, iStart, std::min(iStart + nFrame, vid_FRAME_COUNT), stride,
+		cv::Rect(), cv::Size(), fnamePicsFormat);
 	vid.release(); 
 	return 0;
 }
 
 
 
+// Pictures-to-video pipeline.
+// A pool of OpenMP threads reads (and crops/resizes if necessary) a batch of
+// pictures while a writer thread (std::thread) pushes the previous batch,
+// in frame order, into the single VideoWriter. The batch vector works as the
+// reorder buffer: pictures are decoded in any order but written by index.
+// Pictures which are already of the video size are not resized.
+// imgFirst (if not empty) is the picture of iStart, which the caller has
+// already read (e.g., to get the video size), so it is not read again.
+static void pics2VideoWriteBatch(cv::VideoWriter & vid, const vector<cv::Mat> & pics)
+{
+	for (int j = 0; j < (int)pics.size(); j++)
+		if (pics[j].empty() == false)
+			vid << pics[j];
+}
+
+static int pics2Video(cv::VideoWriter & vid, const string & fnamePicsFormat, int iStart, int nFrame,
+	cv::Rect roiCrop, cv::Size outSize, const cv::Mat & imgFirst)
+{
+	int batchSize = 4 * std::max(omp_get_max_threads(), 1);
+	vector<cv::Mat> pics[2];
+	int nWritten = 0;
+	std::thread writer;
+	for (int k = 0; k * batchSize < nFrame; k++) {
+		vector<cv::Mat> & curPics = pics[k % 2];
+		int i0 = iStart + k * batchSize;
+		int n = std::min(batchSize, nFrame - k * batchSize);
+		curPics.assign(n, cv::Mat());
+#pragma omp parallel for schedule(dynamic)
+		for (int j = 0; j < n; j++) {
+			char fnamePic[1000];
+			sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), i0 + j);
+			cv::Mat img = (i0 + j == iStart && imgFirst.empty() == false) ? imgFirst : cv::imread(fnamePic);
+			if (img.cols <= 0 || img.rows <= 0) {
+#pragma omp critical
+				cerr << "  " << fnamePic << " does not exist. Skipping this frame.\n";
+				continue;
+			}
+			if (roiCrop.width > 0 && roiCrop.height > 0 && roiCrop != cv::Rect(0, 0, img.cols, img.rows))
+				img = img(roiCrop & cv::Rect(0, 0, img.cols, img.rows));
+			if (img.size() != outSize) {
+				cv::Mat resized;
+				cv::resize(img, resized, outSize, 0.0, 0.0, cv::INTER_LANCZOS4);
+				img = resized;
+			}
+			curPics[j] = img;
+		}
+		// previous batch must be written before this batch (and before its buffer is reused)
+		if (writer.joinable())
+			writer.join();
+		writer = std::thread(pics2VideoWriteBatch, std::ref(vid), std::cref(curPics));
+		for (int j = 0; j < n; j++)
+			if (curPics[j].empty() == false) nWritten++;
+		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
+		cout << "Writing frame " << i0 + n - 1 << " ...";
+	}
+	if (writer.joinable())
+		writer.join();
+	cout << endl;
+	return nWritten;
+}
+
 int FuncPics2Video(int argc, char** argv)
 {
 	string fnameVid, fnameFlist;
@@ -122,18 +280,7 @@ int FuncPics2Video(int argc, char** argv)
 	cout << "Frame per sec.: " << fps << endl;
 
 	// Start converting 
-	for (int i = iStart; i < iStart + nFrame; i++)
-	{
-		sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), i);
-		img = cv::imread(fnamePic);
-		if (img.cols <= 0 || img.rows <= 0) {
-			cerr << "  " << fnamePic << " does not exist. Skipping this frame.\n"; 
-			continue; 
-		}
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Writing frame " << i << " ...";
-		vid << img;
-	}
+	pics2Video(vid, fnamePicsFormat, iStart, nFrame, cv::Rect(), imgSize, img);
 	vid.release();
 	return 0;
 }
@@ -178,6 +325,8 @@ int FuncVideo2PicsResize(int argc, char** argv)
 	nFrame = readIntFromIstream(cin);
 	if (nFrame < 0)
 		nFrame = vid_FRAME_COUNT - iStart;
+	cv::CommandLineParser parser(argc, argv, keys);
+	int stride = std::max(parser.get<int>("stride"), 1); // every stride-th frame (see keys)
 	cout << "Region of interests to crop (x y w h)(or 0 0 0 0 for full size): ";
 	roiCrop.x = readIntFromIstream(cin);
 	roiCrop.y = readIntFromIstream(cin);
@@ -193,28 +342,9 @@ int FuncVideo2PicsResize(int argc, char** argv)
 	cout << "Full path file names of pictures (in C-style format including a %d, space allowed): ";
 	string fnamePicsFormat = readStringLineFromIstream(cin);
 
-	// Read video and skip to frame iStart
-	for (int i = 0; i < iStart; i++)
-	{
-		cv::Mat buf;
-		vid >> buf;
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Skipping frame " << i << " ...";
-	}
-
-	// Start converting video to pictures
-	char fnamePic[1000];
-	for (int i = iStart; i < iStart + nFrame; i++)
-	{
-		if (i >= vid_FRAME_COUNT) break;
-		cv::Mat buf;
-		vid >> buf;
-		sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), i - iStart);
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Writing frame " << i << " ...";
-		cv::resize(buf(roiCrop), buf, cv::Size(output_vid_width, output_vid_height), 0.0, 0.0, cv::INTER_LANCZOS4); 
-		cv::imwrite(fnamePic, buf);
-	}
+	// Convert video to pictures
+	video2Pics(vid, iStart, std::min(iStart + nFrame, vid_FRAME_COUNT), stride,
+		roiCrop, cv::Size(output_vid_width, output_vid_height), fnamePicsFormat);
 	vid.release();
 	return 0;
 }
@@ -282,20 +412,7 @@ int FuncPics2VideoResize(int argc, char** argv)
 	cout << "Frame per sec.: " << fps << endl;
 
 	// Start converting 
-	for (int i = iStart; i < iStart + nFrame; i++)
-	{
-		sprintf_s(fnamePic, 1000, fnamePicsFormat.c_str(), i);
-		img = cv::imread(fnamePic);
-		if (img.cols <= 0 || img.rows <= 0) {
-			cerr << "  " << fnamePic << " does not exist. Skipping this frame.\n";
-			continue;
-		}
-		cout << "\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b";
-		cout << "Writing frame " << i << " ...";
-		cv::resize(img(roiCrop), img, cv::Size(output_vid_width, output_vid_height), 0.0, 0.0, cv::INTER_LANCZOS4); 
-//		cv::imshow("1200", img); cv::waitKey(0);
-		vid << img;
-	}
+	pics2Video(vid, fnamePicsFormat, iStart, nFrame, roiCrop, cv::Size(output_vid_width, output_vid_height), img);
 	vid.release();
 	return 0;
 }
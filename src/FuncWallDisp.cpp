@@ -14,6 +14,10 @@
 #include "enhancedCorrelationWithReference.h"
 #include "triangulatepoints2.h"
 #include "impro_util.h"
+#include "FramePyramidCache.h"
+#include "MotionPredictor.h"
+#include "IcgnMatcher.h"
+#include "PerfTrace.h"
 
 using namespace std;
 
@@ -40,7 +44,14 @@ using namespace std;
 // Step 12c:     Based on optical flow 
 // Step 13: Goto Step 8 until the end of the test 
 
-
+// Options without prompts (defaults are used if not given)
+const cv::String keys =
+"{help          h usage ? |      | print this message   }"
+"{wdpredict               | 2    | motion prediction type. 1:constant velocity, 2:constant acceleration, 3:Kalman filter }"
+"{wdwinmin                | 4    | minimum half size (pixel) of T-Match search window when it shrinks by prediction }"
+"{wdwarmup                | 3    | number of tracked steps (of a point) with full T-Match search window before it shrinks }"
+"{wdcoefdrop              | 0.02 | drop of T-Match coefficient (from previous step) that widens the search window }"
+;
 
 int FuncWallDisp(int argc, char ** argv)
 {
@@ -366,9 +377,18 @@ int FuncWallDisp(int argc, char ** argv)
 	nStep = fsq[0].num_files();
 
 	cout << "Enter on/off (1/0) of T-Match, ECC, Optical-Flow: (E.g., 1 0 1 for T-Match on, Ecc off, Opt-flow on.)\n";
+	cout << "  (ECC 2 for IC-GN subset matching (affine shape function) instead of ECC.)\n";
 	int tmt_on = readIntFromCin();
 	int ecc_on = readIntFromCin();
 	int opt_on = readIntFromCin();
+	// T-Match search window shrinks when the prediction is confident (see keys)
+	cv::CommandLineParser parser(argc, argv, keys);
+	int motionPredictType = parser.get<int>("wdpredict");
+	if (motionPredictType < MOTION_PREDICT_CONST_VEL || motionPredictType > MOTION_PREDICT_KALMAN)
+		motionPredictType = MOTION_PREDICT_CONST_ACC;
+	double tmWinMin = std::max(1.0, parser.get<double>("wdwinmin"));
+	int tmWarmUp = std::max(0, parser.get<int>("wdwarmup"));
+	double tmCoefDrop = parser.get<double>("wdcoefdrop");
 
 	// preparation for loop: declare big data arrays
 	for (int i = 0; i < 2; i++)
@@ -396,10 +416,22 @@ int FuncWallDisp(int argc, char ** argv)
 
 	// preparation for loop: allocate guessed image points
 	cv::Mat guessedImgPoints[2]; // guessed image points, sized 1 x (n12 x n23)
+	cv::Mat guessedUncertainty[2]; // uncertainty (pixel) of guessed image points, sized 1 x (n12 x n23), <0 for unknown
+	MotionPredictor predictors[2]; 
+	IcgnMatcher icgn[2];                 // IC-GN subset matchers (if ecc_on == 2)
+	vector<int> icgnSubsetIdx[2];        // index of IC-GN subset of each point (-1 if the subset is not valid)
+	cv::Mat icgnShape[2];                // shape parameters (du/dx, du/dy, dv/dx, dv/dy) of previous step, sized (n12 x n23) x 4
+	FramePyramidCache optPyrs[2];        // optical flow pyramids (frame id: step index, -1 for initial image). Current image is the previous of next step.
+	vector<int> tmFullWinSteps[2];       // number of next steps of each point that use full T-Match search window (warm-up, or widened)
+	vector<float> tmCoef[2];             // T-Match coefficient of each point of previous step
 	for (int iCam = 0; iCam < 2; iCam++)
 	{
 		int iStep = 0; 
 		guessedImgPoints[iCam] = cv::Mat(1, n12 * n23, CV_32FC2);
+		guessedUncertainty[iCam] = cv::Mat(1, n12 * n23, CV_32F, cv::Scalar(-1.f));
+		predictors[iCam].init(n12 * n23, motionPredictType);
+		tmFullWinSteps[iCam].assign(n12 * n23, tmWarmUp);
+		tmCoef[iCam].assign(n12 * n23, std::nanf(""));
 		//for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 		//{
 		//	guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = manyPointsDistorted[iCam].get(iStep, iPoint);
@@ -409,6 +441,7 @@ int FuncWallDisp(int argc, char ** argv)
 	// Start the major loop
 	for (int iStep = 0; iStep < nStep; iStep++)
 	{
+		PERF_SCOPE("wallDisp.step");
 //#pragma omp parallel for 
 		for (int iCam = 0; iCam < 2; iCam++)
 		{
@@ -418,36 +451,17 @@ int FuncWallDisp(int argc, char ** argv)
 			else 
 				imgPrev[iCam] = imgCurr[iCam];
 			// guessed points
-			int guessOrder = 2; // if guessOrder == 1, linear extrapolation; if guessOrder == 2, 2nd order extrapolation
-			if (iStep == 0) {
-				// for iStep == 0, guessed point is the user defined target points
-				for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
-					guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = manyPointsDistorted[iCam].get(iStep, iPoint);
-				}
-			}
-			else if (iStep == 1) { // for iStep == 1, guessed point is the previous points 
-				for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
-					if (tmt_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = TMatchPoints[iCam].get(iStep - 1, iPoint); 
-					else if (opt_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = OptPoints[iCam].get(iStep - 1, iPoint);
-					else if (ecc_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = EccPoints[iCam].get(iStep - 1, iPoint);
-					else
-					{
-						cerr << "You disabled all tracking methods.\n";
-						return -1; 
-					}
-				}
-			}
-			else if (iStep == 2 || guessOrder <= 1) { // for iStep == 2, use linear extrapolation
+			// for iStep == 0, guessed point is the user defined target points
+			// for iStep >= 1, guessed point is predicted by motion predictor, which is 
+			// updated by the tracked points of previous step. 
+			if (iStep >= 1) {
 				for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
 					if (tmt_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = 2 * TMatchPoints[iCam].get(iStep - 1, iPoint) - TMatchPoints[iCam].get(iStep - 2, iPoint);
+						predictors[iCam].update(iPoint, TMatchPoints[iCam].get(iStep - 1, iPoint));
 					else if (opt_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = 2 * OptPoints[iCam].get(iStep - 1, iPoint) - OptPoints[iCam].get(iStep - 2, iPoint);
+						predictors[iCam].update(iPoint, OptPoints[iCam].get(iStep - 1, iPoint));
 					else if (ecc_on > 0)
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = 2 * EccPoints[iCam].get(iStep - 1, iPoint) - EccPoints[iCam].get(iStep - 1, iPoint);
+						predictors[iCam].update(iPoint, EccPoints[iCam].get(iStep - 1, iPoint));
 					else
 					{
 						cerr << "You disabled all tracking methods.\n";
@@ -455,34 +469,15 @@ int FuncWallDisp(int argc, char ** argv)
 					}
 				}
 			}
-			else { // for iStep >= 3, use 2nd order extrapolation
-				for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
-					cv::Point2f p0, p1, p2;
-					if (tmt_on > 0) {
-						p2 = TMatchPoints[iCam].get(iStep - 1, iPoint);
-						p1 = TMatchPoints[iCam].get(iStep - 2, iPoint);
-						p0 = TMatchPoints[iCam].get(iStep - 3, iPoint);
-					}
-					else if (opt_on > 0) {
-						p2 = OptPoints[iCam].get(iStep - 1, iPoint);
-						p1 = OptPoints[iCam].get(iStep - 2, iPoint);
-						p0 = OptPoints[iCam].get(iStep - 3, iPoint);
-					}
-					else if (ecc_on > 0) {
-						p2 = EccPoints[iCam].get(iStep - 1, iPoint);
-						p1 = EccPoints[iCam].get(iStep - 2, iPoint);
-						p0 = EccPoints[iCam].get(iStep - 3, iPoint);
-					}
-					else
-					{
-						cerr << "You disabled all tracking methods.\n";
-						return -1;
-					}
-					//guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x = 2 * p2.x - p1.x + 0.5f * powf(p2.x - 2 * p1.x + p0.x, 2);
-					//guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y = 2 * p2.y - p1.y + 0.5f * powf(p2.y - 2 * p1.y + p0.y, 2);
-					guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x = p0.x - 3 * p1.x + 3 * p2.x; 
-					guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y = p0.y - 3 * p1.y + 3 * p2.y;;
+			for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
+				float uncertainty = -1.f; 
+				cv::Point2f guess = predictors[iCam].predict(iPoint, uncertainty);
+				if (iStep == 0 || std::isnan(guess.x) || std::isnan(guess.y)) {
+					guess = manyPointsDistorted[iCam].get(0, iPoint);
+					uncertainty = -1.f; 
 				}
+				guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint) = guess;
+				guessedUncertainty[iCam].at<float>(0, iPoint) = uncertainty;
 			}
 
 			// cloned templates (targets)
@@ -510,8 +505,14 @@ int FuncWallDisp(int argc, char ** argv)
 			}
 
 			// Step 9:   Wait for the photos
-			fsq[iCam].waitForImageFile(iStep, imgCurr[iCam], cv::IMREAD_GRAYSCALE);
-			imgCurr[iCam] = sobel_xy(imgCurr[iCam]); 
+			{
+				PERF_SCOPE("wallDisp.waitImage");
+				fsq[iCam].waitForImageFile(iStep, imgCurr[iCam], cv::IMREAD_GRAYSCALE);
+			}
+			{
+				PERF_SCOPE("wallDisp.sobel");
+				imgCurr[iCam] = sobel_xy(imgCurr[iCam]); 
+			}
 			cout << "Found file of Cam " << iCam + 1 << " Step " << iStep + 1 << ", file name " << fsq[iCam].fullPathOfFile(iStep) << endl;
 
 			// Step 10:  Track many image points on both cameras
@@ -520,14 +521,23 @@ int FuncWallDisp(int argc, char ** argv)
 			// From guessedImgPoints[iCam]
 			// To TMatchPoints[iCam]
 			if (tmt_on > 0)
+			{
 #pragma omp parallel for 
 				for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 				{
-					double min_x = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x - targetsInit[iPoint].cols; 
-					double max_x = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x + targetsInit[iPoint].cols;
+					PERF_SCOPE_POINT("wallDisp.tmatch", iPoint);
+					// search window: template size, or 3 times of prediction uncertainty (+2 pixels, at least tmWinMin) 
+					// if it is smaller, after the warm-up steps of the point 
+					double full_x = targetsInit[iPoint].cols;
+					double full_y = targetsInit[iPoint].rows;
+					double win_x = full_x, win_y = full_y;
+					float uncertainty = guessedUncertainty[iCam].at<float>(0, iPoint);
+					if (uncertainty >= 0.f && tmFullWinSteps[iCam][iPoint] <= 0) {
+						win_x = std::min(win_x, std::max(tmWinMin, 3.0 * uncertainty + 2.0));
+						win_y = std::min(win_y, std::max(tmWinMin, 3.0 * uncertainty + 2.0));
+					}
+					cv::Point2f guess = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint);
 					double precision_x = .05; 
-					double min_y = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y - targetsInit[iPoint].rows;
-					double max_y = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y + targetsInit[iPoint].rows;
 					double precision_y = 0.05;
 					double min_r = 0.;
 					double max_r = 0.;
@@ -535,15 +545,34 @@ int FuncWallDisp(int argc, char ** argv)
 					vector<double> tMatchResult(10); 
 
 					int tmatchRet; 
-					{
-					tmatchRet = matchTemplateWithRotPyr(
-						imgCurr[iCam],
-						targetsInit[iPoint],
-						refsInit[iPoint].x, refsInit[iPoint].y,
-						min_x, max_x, precision_x,
-						min_y, max_y, precision_y,
-						min_r, max_r, precision_r,
-						tMatchResult);
+					while (true) {
+						tmatchRet = matchTemplateWithRotPyr(
+							imgCurr[iCam],
+							targetsInit[iPoint],
+							refsInit[iPoint].x, refsInit[iPoint].y,
+							guess.x - win_x, guess.x + win_x, precision_x,
+							guess.y - win_y, guess.y + win_y, precision_y,
+							min_r, max_r, precision_r,
+							tMatchResult,
+							cv::TM_CCORR_NORMED, -1, -1, -1, 
+							true); // narrower windows once location converges (down to the target precision)
+						if (win_x >= full_x && win_y >= full_y)
+							break;
+						// shrunk window: if the peak is at the window edge or the coefficient drops, 
+						// the prediction may be wrong. Matches again with full window, which is kept 
+						// for the next warm-up steps. 
+						bool atEdge = std::abs(tMatchResult[0] - guess.x) >= win_x - 1.0 ||
+							std::abs(tMatchResult[1] - guess.y) >= win_y - 1.0;
+						bool coefDrop = tMatchResult[3] < tmCoef[iCam][iPoint] - tmCoefDrop;
+						if (atEdge == false && coefDrop == false)
+							break;
+						win_x = full_x;
+						win_y = full_y;
+						tmFullWinSteps[iCam][iPoint] = tmWarmUp + 1;
+					}
+					if (tmFullWinSteps[iCam][iPoint] > 0)
+						tmFullWinSteps[iCam][iPoint]--;
+					tmCoef[iCam][iPoint] = (float)tMatchResult[3];
 					float target_x = (float)tMatchResult[0];
 					float target_y = (float)tMatchResult[1];
 					TMatchPoints[iCam].set(iStep, iPoint, cv::Point2f(target_x, target_y));
@@ -556,11 +585,57 @@ int FuncWallDisp(int argc, char ** argv)
 			// Step 10b:     By t-Ecc
 			// From guessedImgPoints[iCam]
 			// To EccPoints[iCam]
-			if (ecc_on > 0)
+			if (ecc_on == 2)
+			{
+				// IC-GN: subsets of the initial image are defined (and precomputed) only once
+				if (icgnSubsetIdx[iCam].size() == 0) {
+					icgn[iCam].setReferenceImage(imgInit[iCam]);
+					icgnSubsetIdx[iCam].resize(n12 * n23);
+					icgnShape[iCam] = cv::Mat::zeros(n12 * n23, 4, CV_64F);
+					for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
+						icgnSubsetIdx[iCam][iPoint] = icgn[iCam].addSubset(manyPointsDistorted[iCam].get(0, iPoint),
+							cv::Size(manyPointsDistorted[iCam].getRect(iPoint).width, manyPointsDistorted[iCam].getRect(iPoint).height));
+				}
+				// B-spline coefficients of current image are computed once and shared by all subsets,
+				// only in the region the subsets can reach (twice the subset size around the guesses)
+				vector<cv::Rect> icgnRects;
+				for (int iPoint = 0; iPoint < n12 * n23; iPoint++) {
+					cv::Point2f guess = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint);
+					cv::Rect rect = manyPointsDistorted[iCam].getRect(iPoint);
+					if (icgnSubsetIdx[iCam][iPoint] < 0 || std::isnan(guess.x) || std::isnan(guess.y))
+						continue;
+					icgnRects.push_back(cv::Rect((int)(guess.x - rect.width), (int)(guess.y - rect.height),
+						2 * rect.width + 1, 2 * rect.height + 1));
+				}
+				icgn[iCam].setDeformedImage(imgCurr[iCam], unionRect(icgnRects, imgCurr[iCam].size()));
+#pragma omp parallel for 
+				for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
+				{
+					PERF_SCOPE_POINT("wallDisp.icgn", iPoint);
+					cv::Point2f target(std::nanf(""), std::nanf(""));
+					if (icgnSubsetIdx[iCam][iPoint] >= 0) {
+						vector<double> icgnResult(8);
+						int ret = icgn[iCam].match(icgnSubsetIdx[iCam][iPoint],
+							guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint),
+							icgnResult, 
+							icgnShape[iCam].ptr<double>(iPoint));
+						if (ret == 0 || ret == -3) {
+							target = cv::Point2f((float)icgnResult[0], (float)icgnResult[1]);
+							for (int j = 0; j < 4; j++)
+								icgnShape[iCam].at<double>(iPoint, j) = icgnResult[4 + j];
+						}
+					}
+					EccPoints[iCam].set(iStep, iPoint, target);
+				} // end of n12*n23 points 
+				printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+				printf("IC-GN Cam %d completed. ", iCam + 1);
+			}
+			else if (ecc_on > 0)
 			{
 #pragma omp parallel for 
 				for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 				{
+					PERF_SCOPE_POINT("wallDisp.ecc", iPoint);
 					vector<double> eccResult(10);
 					enhancedCorrelationWithReference(imgCurr[iCam], targetsInit[iPoint],
 						refsInit[iPoint].x, refsInit[iPoint].y,
@@ -584,6 +659,7 @@ int FuncWallDisp(int argc, char ** argv)
 			// To OptPoints[iCam]
 			if (opt_on > 0)
 			{
+				PERF_SCOPE("wallDisp.optflow");
 				vector<cv::Point2f> prevPts(n12 * n23), currPts(n12 * n23);
 				vector<uchar> optFlow_status(n12 * n23);
 				vector<float> optFlow_err(n12 * n23);
@@ -596,9 +672,13 @@ int FuncWallDisp(int argc, char ** argv)
 					currPts[iPoint] = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint); 
 				}
 
+				// pyramid of previous photo was built as current photo of previous step
+				vector<cv::Mat> pyrPrev = optPyrs[iCam].get(iStep - 1, PYR_VARIANT_SOBEL, imgPrev[iCam], cv::Size(61, 61), 2);
+				vector<cv::Mat> pyrCurr = optPyrs[iCam].get(iStep, PYR_VARIANT_SOBEL, imgCurr[iCam], cv::Size(61, 61), 2);
+				optPyrs[iCam].release(iStep - 2);
 				calcOpticalFlowPyrLK(
-					imgPrev[iCam], // previous photo
-					imgCurr[iCam],  // current photo
+					pyrPrev, // previous photo
+					pyrCurr,  // current photo
 					prevPts,
 					currPts,
 					optFlow_status,
@@ -686,6 +766,7 @@ int FuncWallDisp(int argc, char ** argv)
 		// Step 11a:     Based on t-match
 		if (tmt_on > 0)
 		{
+			PERF_SCOPE("wallDisp.triangulate");
 			for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 			{
 				leftCamPoints.at<cv::Point2f>(0, iPoint) = TMatchPoints[0].get(iStep, iPoint);
@@ -710,6 +791,7 @@ int FuncWallDisp(int argc, char ** argv)
 		// Step 11b:     Based on ecc
 		if (ecc_on)
 		{
+			PERF_SCOPE("wallDisp.triangulate");
 			for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 			{
 				leftCamPoints.at<cv::Point2f>(0, iPoint) = EccPoints[0].get(iStep, iPoint);
@@ -734,6 +816,7 @@ int FuncWallDisp(int argc, char ** argv)
 		// Step 11c:     Based on optical flow
 		if (opt_on > 0)
 		{
+			PERF_SCOPE("wallDisp.triangulate");
 			for (int iPoint = 0; iPoint < n12 * n23; iPoint++)
 			{
 				leftCamPoints.at<cv::Point2f>(0, iPoint) = OptPoints[0].get(iStep, iPoint);
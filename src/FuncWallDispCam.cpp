@@ -17,6 +17,8 @@
 #include "enhancedCorrelationWithReference.h"
 #include "triangulatepoints2.h"
 #include "impro_util.h"
+#include "FramePyramidCache.h"
+#include "FrameBus.h"
 
 using namespace std;
 
@@ -45,6 +47,12 @@ using namespace std;
 
 
 
+// Options without prompts (defaults are used if not given)
+const cv::String keys =
+"{help          h usage ? |   | print this message   }"
+"{wdrtperiod              | 0 | target frame period (ms) of real-time mode (0 for off, e.g., 500) }"
+;
+
 int FuncWallDispCam(int argc, char ** argv)
 {
 	string leftRight[2]; leftRight[0] = "left"; leftRight[1] = "right";
@@ -387,6 +395,23 @@ int FuncWallDispCam(int argc, char ** argv)
 	int ecc_on = readIntFromCin();
 	int opt_on = readIntFromCin();
 
+	// real-time mode (-wdrtperiod): each step (a photo pair) has a budget of rtPeriodMs. The most recent
+	// frames are processed (older ones are dropped), and refinement (fine t-match levels,
+	// ECC, optical flow) is skipped for points when the budget is about to be exceeded.
+	cv::CommandLineParser parser(argc, argv, keys);
+	int rtPeriodMs = std::max(0, std::min(parser.get<int>("wdrtperiod"), 86400 * 1000));
+	// precision level of each point of current step:
+	// 0: not tracked (position of previous step is kept)
+	// 1: coarse t-match (0.5 pixel)
+	// 2: t-match (0.05 pixel), or ECC / optical flow if t-match is off
+	// 3: t-match and ECC
+	cv::Mat precLevel[2];
+	double optFlowDuration[2] = { 0.0, 0.0 }; // duration (sec.) of last optical flow of each camera
+	FramePyramidCache optPyrs[2]; // optical flow pyramids (frame id: step index, -1 for initial image). Current image is the previous of next step.
+	int optPrevFrame[2] = { -1, -1 }; // frame id of previous image (steps can be skipped in real-time mode)
+	for (int i = 0; i < 2; i++)
+		precLevel[i] = cv::Mat::zeros(1, nPickedPoint + n12 * n23, CV_8U);
+
 	// preparation for loop: declare big data arrays (in usb-webcam case, only current step is stored, so arrays are small)
 	// store 2 steps, initial and current
 	for (int i = 0; i < 2; i++)
@@ -411,10 +436,26 @@ int FuncWallDispCam(int argc, char ** argv)
 		guessedImgPoints[iCam] = cv::Mat(1, nPickedPoint + n12 * n23, CV_32FC2);
 	}
 
+	// frames written below are also published to a frame bus for other processes
+	// on this computer (if environment variable IMPRO_FRAME_BUS_OUT is set)
+	FrameBus frameBusOut;
+	if (FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_OUT").length() > 0)
+		frameBusOut.create(FrameBus::busNameFromEnv("IMPRO_FRAME_BUS_OUT"), 8);
+
 	// Start the major loop
 	for (int iStep = 0; iStep < nStep; iStep++)
 	{
-		//#pragma omp parallel for 
+		double tStepStart = getWallTime();
+		// real-time mode: jump to the most recent photo pair rather than working through a backlog
+		if (rtPeriodMs > 0 && iStep > 0 && fnameImgInit[0].substr(0, 12).compare("VideoCapture") != 0)
+		{
+			int iLast = std::min(fsq[0].findLastCanReadFile(), fsq[1].findLastCanReadFile());
+			if (iLast > iStep) {
+				std::printf("Real-time mode: skipped %d photo pair(s). Jump to Step %d (1-base).\n", iLast - iStep, iLast + 1);
+				iStep = iLast;
+			}
+		}
+		//#pragma omp parallel for
 		for (int iCam = 0; iCam < 2; iCam++)
 		{
 			char buff[1000];
@@ -473,10 +514,23 @@ int FuncWallDispCam(int argc, char ** argv)
 			// Step 9:   Wait for the photos
 			if (fnameImgInit[iCam].substr(0, 12).compare("VideoCapture") == 0)
 			{
-				// wait for 1 sec.
-				std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-				//
-				bool grab_ok = usbCam[iCam].grab(); 
+				bool grab_ok;
+				if (rtPeriodMs <= 0) {
+					// wait for 1 sec.
+					std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+					//
+					grab_ok = usbCam[iCam].grab();
+				}
+				else {
+					// real-time mode: drop frames queued in the driver so that the most recent frame
+					// is processed. A queued frame is grabbed immediately while a new one takes about
+					// a frame interval.
+					for (int k = 0; k < 10; k++) {
+						double tGrab = getWallTime();
+						grab_ok = usbCam[iCam].grab();
+						if (grab_ok == false || getWallTime() - tGrab > 0.005) break;
+					}
+				}
 				if (grab_ok == false)
 				{
 					printf("Error. Cannot grab image from camera %d (1-base) in Step %d (1-base) .\n", iCam + 1, iStep + 1); 
@@ -498,7 +552,20 @@ int FuncWallDispCam(int argc, char ** argv)
 				outputDirectory.c_str(), iStep + 1, iCam + 1);
 		
 
-			cv::imwrite(buff, imgCurr[iCam]);
+			frameBusOut.writeAndPublish(buff, imgCurr[iCam]); // cv::imwrite() if there is no bus
+
+			// real-time mode: time budget of this camera (half of the period each, 10% of the period is
+			// kept for triangulation and output). A point starts fine t-match only in the first half of
+			// the camera budget, coarse t-match until 70%, ECC until 85%.
+			double tCamStart = getWallTime();
+			double tCamDeadline = tStepStart + 0.001 * rtPeriodMs * 0.9 * (iCam + 1) / 2.;
+			double tCamSpan = std::max(tCamDeadline - tCamStart, 0.0);
+			double tFineLimit = tCamStart + 0.50 * tCamSpan;
+			double tCoarseLimit = tCamStart + 0.70 * tCamSpan;
+			double tEccLimit = tCamStart + 0.85 * tCamSpan;
+			bool realTime = (rtPeriodMs > 0 && iStep > 0); // the initial step is always fully refined
+			precLevel[iCam].setTo(0);
+
 			// Step 10:  Track many image points on both cameras
 			// Step 10a:     By t-match
 			// T-match: target tracking 
@@ -518,19 +585,37 @@ int FuncWallDispCam(int argc, char ** argv)
 					double max_r = 0.;
 					double precision_r = 1.;
 					vector<double> tMatchResult(10);
+					// real-time mode: stop at a coarser pyramid level, or keep the guessed (previous)
+					// position, if the budget is running out
+					int level = 2;
+					if (realTime) {
+						double tNow = getWallTime();
+						if (tNow >= tCoarseLimit)
+							level = 0;
+						else if (tNow >= tFineLimit) {
+							level = 1;
+							precision_x = 0.5;
+							precision_y = 0.5;
+						}
+					}
 
 					int tmatchRet;
 					{
-						tmatchRet = matchTemplateWithRotPyr(
-							imgCurr[iCam],
-							targetsInit[iPoint],
-							refsInit[iPoint].x, refsInit[iPoint].y,
-							min_x, max_x, precision_x,
-							min_y, max_y, precision_y,
-							min_r, max_r, precision_r,
-							tMatchResult);
-						float target_x = (float)tMatchResult[0];
-						float target_y = (float)tMatchResult[1];
+						float target_x = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x;
+						float target_y = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y;
+						if (level > 0) {
+							tmatchRet = matchTemplateWithRotPyr(
+								imgCurr[iCam],
+								targetsInit[iPoint],
+								refsInit[iPoint].x, refsInit[iPoint].y,
+								min_x, max_x, precision_x,
+								min_y, max_y, precision_y,
+								min_r, max_r, precision_r,
+								tMatchResult);
+							target_x = (float)tMatchResult[0];
+							target_y = (float)tMatchResult[1];
+						}
+						precLevel[iCam].at<uchar>(0, iPoint) = (uchar)level;
 						TMatchPoints[iCam].set(1 /*iStep*/, iPoint, cv::Point2f(target_x, target_y));
 						if (iStep == 0) // if iStep == 0, set to step index 0 and 1. 0 for calculating disp. 1 for current step 
 						{
@@ -558,16 +643,24 @@ int FuncWallDispCam(int argc, char ** argv)
 				for (int iPoint = 0; iPoint < nPickedPoint + n12 * n23; iPoint++)
 				{
 					vector<double> eccResult(10);
-					enhancedCorrelationWithReference(imgCurr[iCam], targetsInit[iPoint],
-						refsInit[iPoint].x, refsInit[iPoint].y,
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x,
-						guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y,
-						0.0 /* init_rot */,
-						eccResult,
-						cv::MOTION_TRANSLATION,
-						cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.01 /* eps */));
-					float target_x = (float)eccResult[0];
-					float target_y = (float)eccResult[1];
+					float target_x = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x;
+					float target_y = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y;
+					// real-time mode: ECC is skipped (guessed position kept) if the budget is running out
+					if (realTime == false || getWallTime() < tEccLimit)
+					{
+						enhancedCorrelationWithReference(imgCurr[iCam], targetsInit[iPoint],
+							refsInit[iPoint].x, refsInit[iPoint].y,
+							guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).x,
+							guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint).y,
+							0.0 /* init_rot */,
+							eccResult,
+							cv::MOTION_TRANSLATION,
+							cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.01 /* eps */));
+						target_x = (float)eccResult[0];
+						target_y = (float)eccResult[1];
+						uchar & level = precLevel[iCam].at<uchar>(0, iPoint);
+						level = (tmt_on > 0) ? (level == 2 ? 3 : level) : 2;
+					}
 					if (iStep == 0) // if iStep == 0, set to step index 0 and 1. 0 for calculating disp. 1 for current step 
 					{
 						EccPoints[iCam].set(0/*iStep*/, iPoint, cv::Point2f(target_x, target_y));
@@ -606,17 +699,31 @@ int FuncWallDispCam(int argc, char ** argv)
 					currPts[iPoint] = guessedImgPoints[iCam].at<cv::Point2f>(0, iPoint);
 				}
 
-				calcOpticalFlowPyrLK(
-					imgPrev[iCam], // previous photo
-					imgCurr[iCam],  // current photo
-					prevPts,
-					currPts,
-					optFlow_status,
-					optFlow_err,
-					cv::Size(q4WinSize, q4WinSize),
-					2 /* max level */,
-					cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.001 /* eps */)
-				);
+				// real-time mode: optical flow (all points at once) is skipped if the last one
+				// would not end before the deadline. Guessed positions are kept.
+				double tOpt = getWallTime();
+				if (realTime == false || tOpt + optFlowDuration[iCam] < tCamDeadline)
+				{
+					// pyramid of previous photo was built as current photo of previous step
+					vector<cv::Mat> pyrPrev = optPyrs[iCam].get(optPrevFrame[iCam], PYR_VARIANT_SOBEL, imgPrev[iCam], cv::Size(q4WinSize, q4WinSize), 2);
+					vector<cv::Mat> pyrCurr = optPyrs[iCam].get(iStep, PYR_VARIANT_SOBEL, imgCurr[iCam], cv::Size(q4WinSize, q4WinSize), 2);
+					optPyrs[iCam].release(optPrevFrame[iCam]);
+					calcOpticalFlowPyrLK(
+						pyrPrev, // previous photo
+						pyrCurr,  // current photo
+						prevPts,
+						currPts,
+						optFlow_status,
+						optFlow_err,
+						cv::Size(q4WinSize, q4WinSize),
+						2 /* max level */,
+						cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 50 /* ecc max count */, 0.001 /* eps */)
+					);
+					optFlowDuration[iCam] = getWallTime() - tOpt;
+					for (int iPoint = 0; iPoint < nPickedPoint + n12 * n23; iPoint++)
+						if (precLevel[iCam].at<uchar>(0, iPoint) == 0)
+							precLevel[iCam].at<uchar>(0, iPoint) = 2;
+				}
 
 				for (int iPoint = 0; iPoint < nPickedPoint + n12 * n23; iPoint++)
 				{
@@ -642,6 +749,7 @@ int FuncWallDispCam(int argc, char ** argv)
 				std::printf("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
 				std::printf("Optical flow completed.\n");
 			} // opt_on
+			optPrevFrame[iCam] = iStep; // current image is the previous image of next step
 
 		} // end of iCam loop (left and right)
 
@@ -909,6 +1017,31 @@ int FuncWallDispCam(int argc, char ** argv)
 		}
 		fclose(compactTxtFile);
 
+		// real-time mode: precision level of each point (left, right) and latency of this step
+		if (rtPeriodMs > 0)
+		{
+			std::string precTxtFilename(outputDirectory + "compactPrecLevel.txt");
+			FILE * precTxtFile;
+			fopen_s(&precTxtFile, precTxtFilename.c_str(), "w");
+			if (precTxtFile == NULL)
+				printf("Error: Cannot open file %s.\n", precTxtFilename.c_str());
+			else {
+				for (int iPoint = 0; iPoint < nPickedPoint; iPoint++)
+					fprintf(precTxtFile, "%d %d\n",
+						(int)precLevel[0].at<uchar>(0, iPoint), (int)precLevel[1].at<uchar>(0, iPoint));
+				fclose(precTxtFile);
+			}
+			int nLevel[4] = { 0, 0, 0, 0 };
+			for (int iCam = 0; iCam < 2; iCam++)
+				for (int iPoint = 0; iPoint < nPickedPoint + n12 * n23; iPoint++)
+					nLevel[std::min((int)precLevel[iCam].at<uchar>(0, iPoint), 3)]++;
+			double latency = getWallTime() - tStepStart;
+			std::printf("Step %d (1-base): latency %.1f ms (target %d ms). Precision levels (0/1/2/3): %d %d %d %d\n",
+				iStep + 1, latency * 1000., rtPeriodMs, nLevel[0], nLevel[1], nLevel[2], nLevel[3]);
+			// do not start the next step earlier than the period
+			if (latency < 0.001 * rtPeriodMs)
+				std::this_thread::sleep_for(std::chrono::milliseconds((int)(rtPeriodMs - latency * 1000.)));
+		}
 
 		// Step 13: Goto Step 8 until the end of the test 
 	}
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+// HistoryView is a non-owning view of a row (the points of a step) or a column
+// (the history of a point) of a points history matrix (nStep x nPoint, one
+// point per element, e.g., Points2fHistoryData and Points3dHistoryData).
+// Nothing is copied: elements are accessed through a pointer and a stride, and
+// mat() wraps them in a cv::Mat header that shares the data. A view is valid
+// until the history data is resized or re-set.
+//
+// Points2fHistoryData hist;
+// HistoryView<cv::Point2f> step5 = hist.stepView(5);     // points of step 5
+// cv::solvePnP(objPoints, step5.mat(), cmat, dvec, rvec, tvec);
+// HistoryView<cv::Point2f> p3 = hist.pointView(3);       // history of point 3
+// for (HistoryView<cv::Point2f>::iterator it = p3.begin(); it != p3.end(); ++it)
+//     sum += it->x;
+
+template <typename T>
+class HistoryView
+{
+public:
+	class iterator
+	{
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T * pointer;
+		typedef T & reference;
+
+		iterator() : p(0), stride(0) {}
+		iterator(uchar * _p, size_t _stride) : p(_p), stride(_stride) {}
+		T & operator*() const { return *(T *)p; }
+		T * operator->() const { return (T *)p; }
+		T & operator[](difference_type n) const { return *(T *)(p + n * (std::ptrdiff_t)stride); }
+		iterator & operator++() { p += stride; return *this; }
+		iterator operator++(int) { iterator t = *this; p += stride; return t; }
+		iterator & operator--() { p -= stride; return *this; }
+		iterator operator--(int) { iterator t = *this; p -= stride; return t; }
+		iterator & operator+=(difference_type n) { p += n * (std::ptrdiff_t)stride; return *this; }
+		iterator & operator-=(difference_type n) { p -= n * (std::ptrdiff_t)stride; return *this; }
+		iterator operator+(difference_type n) const { iterator t = *this; return t += n; }
+		iterator operator-(difference_type n) const { iterator t = *this; return t -= n; }
+		difference_type operator-(const iterator & b) const { return stride == 0 ? 0 : (p - b.p) / (std::ptrdiff_t)stride; }
+		bool operator==(const iterator & b) const { return p == b.p; }
+		bool operator!=(const iterator & b) const { return p != b.p; }
+		bool operator<(const iterator & b) const { return p < b.p; }
+	private:
+		uchar * p;
+		size_t stride;
+	};
+
+	HistoryView() : data(0), n(0), stride(sizeof(T)) {}
+
+	//! Creates a view of n elements from data, stride (in bytes) between elements
+	HistoryView(T * _data, int _n, size_t _stride) : data((uchar *)_data), n(_n), stride(_stride) {}
+
+	int size() const { return n; }
+	bool empty() const { return n <= 0; }
+	T & operator[](int i) const { return *(T *)(data + i * stride); }
+	iterator begin() const { return iterator(data, stride); }
+	iterator end() const { return iterator(data + n * stride, stride); }
+
+	//! Returns a cv::Mat header (no copy) of the elements: 1 x n for a step, n x 1 for a point history
+	cv::Mat mat() const
+	{
+		if (n <= 0) return cv::Mat();
+		if (stride == sizeof(T))
+			return cv::Mat(1, n, cv::traits::Type<T>::value, data);
+		return cv::Mat(n, 1, cv::traits::Type<T>::value, data, stride);
+	}
+
+	//! Returns a copy of the elements as a vector (for interfaces which need std::vector)
+	std::vector<T> toVector() const
+	{
+		std::vector<T> v(n > 0 ? n : 0);
+		for (int i = 0; i < n; i++) v[i] = (*this)[i];
+		return v;
+	}
+
+private:
+	uchar * data;
+	int n;
+	size_t stride;
+};
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <cmath>
+#include <opencv2/core.hpp>
+#include "IcgnMatcher.h"
+
+using namespace std;
+
+IcgnMatcher::IcgnMatcher()
+{
+}
+
+int IcgnMatcher::setReferenceImage(const cv::Mat & img)
+{
+	if (img.cols <= 0 || img.rows <= 0) {
+		cerr << "IcgnMatcher::setReferenceImage(): Empty image.\n";
+		return -1;
+	}
+	this->refBsp.set(img);
+	this->subsets.clear();
+	return 0;
+}
+
+int IcgnMatcher::addSubset(cv::Point2f point, cv::Size subsetSize)
+{
+	if (this->refBsp.empty()) {
+		cerr << "IcgnMatcher::addSubset(): Reference image is not set.\n";
+		return -1;
+	}
+	Subset s;
+	s.point = point;
+	s.center = cv::Point((int)(point.x + 0.5f), (int)(point.y + 0.5f));
+	int hw = std::max(subsetSize.width / 2, 1), hh = std::max(subsetSize.height / 2, 1);
+	s.halfSize = std::max(hw, hh);
+	cv::Rect refRect = this->refBsp.region();
+	if (s.center.x - hw < refRect.x + 1 || s.center.y - hh < refRect.y + 1 ||
+		s.center.x + hw > refRect.x + refRect.width - 3 || s.center.y + hh > refRect.y + refRect.height - 3)
+		return -2;
+	int n = (2 * hw + 1) * (2 * hh + 1);
+	s.dxy = cv::Mat(n, 2, CV_32F);
+	s.f = cv::Mat(n, 1, CV_64F);
+	s.J = cv::Mat(n, 6, CV_64F);
+	int k = 0;
+	double fMean = 0.0;
+	for (int dy = -hh; dy <= hh; dy++) {
+		for (int dx = -hw; dx <= hw; dx++) {
+			// value and gradients of the B-spline interpolant at the pixel
+			double f, fx, fy;
+			this->refBsp.interpGrad(s.center.x + dx, s.center.y + dy, f, fx, fy);
+			s.dxy.at<float>(k, 0) = (float)dx;
+			s.dxy.at<float>(k, 1) = (float)dy;
+			s.f.at<double>(k, 0) = f;
+			double * J = s.J.ptr<double>(k);
+			J[0] = fx; J[1] = fx * dx; J[2] = fx * dy;
+			J[3] = fy; J[4] = fy * dx; J[5] = fy * dy;
+			fMean += f;
+			k++;
+		}
+	}
+	fMean /= n;
+	s.f -= fMean;
+	s.fNorm = cv::norm(s.f);
+	cv::Mat H = s.J.t() * s.J;
+	if (s.fNorm <= 1e-6 || cv::invert(H, s.invH, cv::DECOMP_CHOLESKY) == 0)
+		return -3;
+	this->subsets.push_back(s);
+	return (int) this->subsets.size() - 1;
+}
+
+void IcgnMatcher::clearSubsets()
+{
+	this->subsets.clear();
+}
+
+int IcgnMatcher::numSubsets() const
+{
+	return (int) this->subsets.size();
+}
+
+int IcgnMatcher::setDeformedImage(const cv::Mat & img, cv::Rect roi)
+{
+	if (img.cols <= 0 || img.rows <= 0) {
+		cerr << "IcgnMatcher::setDeformedImage(): Empty image.\n";
+		return -1;
+	}
+	return this->defBsp.set(img, roi);
+}
+
+int IcgnMatcher::setDeformedImage(const BsplineImage & bimg)
+{
+	if (bimg.empty())
+		return -1;
+	this->defBsp = bimg;
+	return 0;
+}
+
+int IcgnMatcher::match(int iSubset, cv::Point2f guess, std::vector<double> & result,
+	const double * initShape, int maxIter, double eps) const
+{
+	if (iSubset < 0 || iSubset >= (int) this->subsets.size() || this->defBsp.empty())
+		return -1;
+	const Subset & s = this->subsets[iSubset];
+	int n = s.dxy.rows;
+
+	// warp (subset local coordinate --> deformed image coordinate relative to s.center)
+	// W = [1+ux uy u; vx 1+vy v; 0 0 1]
+	double ox = s.point.x - s.center.x, oy = s.point.y - s.center.y;
+	cv::Matx33d W = cv::Matx33d::eye();
+	if (initShape != NULL) {
+		W(0, 0) += initShape[0]; W(0, 1) = initShape[1];
+		W(1, 0) = initShape[2];  W(1, 1) += initShape[3];
+	}
+	// W(ox, oy) should be the guess
+	W(0, 2) = (guess.x - s.center.x) - (W(0, 0) * ox + W(0, 1) * oy);
+	W(1, 2) = (guess.y - s.center.y) - (W(1, 0) * ox + W(1, 1) * oy);
+
+	cv::Mat g(n, 1, CV_64F), err(n, 1, CV_64F);
+	double zncc = 0.0;
+	int iter, ret = -3;
+	for (iter = 1; iter <= maxIter; iter++) {
+		// deformed subset
+		double gMean = 0.0;
+		for (int k = 0; k < n; k++) {
+			double dx = s.dxy.at<float>(k, 0), dy = s.dxy.at<float>(k, 1);
+			double x = s.center.x + W(0, 0) * dx + W(0, 1) * dy + W(0, 2);
+			double y = s.center.y + W(1, 0) * dx + W(1, 1) * dy + W(1, 2);
+			double v;
+			if (this->defBsp.interp(x, y, v) == false) {
+				ret = -2;
+				break;
+			}
+			g.at<double>(k, 0) = v;
+			gMean += v;
+		}
+		if (ret == -2) break;
+		g -= gMean / n;
+		double gNorm = cv::norm(g);
+		if (gNorm <= 1e-6) {
+			ret = -2;
+			break;
+		}
+		zncc = s.f.dot(g) / (s.fNorm * gNorm);
+		// increment
+		err = s.f - (s.fNorm / gNorm) * g;
+		cv::Mat dp = -s.invH * (s.J.t() * err);
+		const double * d = dp.ptr<double>(0);
+		// inverse-compositional update: W <- W * inv(W(dp))
+		cv::Matx33d dW(1 + d[1], d[2], d[0],
+			d[4], 1 + d[5], d[3],
+			0, 0, 1);
+		W = W * dW.inv();
+		// convergence
+		double dpNorm = sqrt(d[0] * d[0] + d[3] * d[3] +
+			(d[1] * d[1] + d[2] * d[2] + d[4] * d[4] + d[5] * d[5]) * s.halfSize * s.halfSize);
+		if (dpNorm < eps) {
+			ret = 0;
+			break;
+		}
+	}
+
+	result.resize(8);
+	result[0] = s.center.x + W(0, 0) * ox + W(0, 1) * oy + W(0, 2);
+	result[1] = s.center.y + W(1, 0) * ox + W(1, 1) * oy + W(1, 2);
+	result[2] = zncc;
+	result[3] = std::min(iter, maxIter);
+	result[4] = W(0, 0) - 1.0;
+	result[5] = W(0, 1);
+	result[6] = W(1, 0);
+	result[7] = W(1, 1) - 1.0;
+	return ret;
+}
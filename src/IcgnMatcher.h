@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+#include <opencv2/core.hpp>
+#include "BsplineImage.h"
+
+// IcgnMatcher tracks many subsets (templates) of a reference image in deformed
+// images by the inverse-compositional Gauss-Newton (IC-GN) algorithm with
+// first-order (affine) shape function, which is the standard subset matching
+// algorithm of digital image correlation (DIC).
+//
+// Everything of a subset that does not depend on the deformed image (template
+// intensities, gradients, steepest descent images, and inverse Hessian) is
+// computed once in addSubset(). The bicubic B-spline coefficients of a
+// deformed image (BsplineImage) are computed once in setDeformedImage() and
+// shared by all subsets. match() is const and can be called by many threads (e.g., OpenMP)
+// for different subsets.
+//
+// IcgnMatcher icgn;
+// icgn.setReferenceImage(imgInit);
+// for each point: icgn.addSubset(point, cv::Size(31, 31));
+// for each step:
+//   icgn.setDeformedImage(imgCurr);
+//   #pragma omp parallel for
+//   for each point: icgn.match(iPoint, guess, result);
+
+class IcgnMatcher
+{
+public:
+	IcgnMatcher();
+
+	//! Sets the reference (undeformed) image
+	/*!
+	\param img reference image (1-channel, 8U or 32F, or 3-channel which is converted to gray)
+	\return 0: success. -1: empty image.
+	*/
+	int setReferenceImage(const cv::Mat & img);
+
+	//! Adds a subset and precomputes everything that does not depend on the deformed image
+	/*!
+	\param point target point in the reference image
+	\param subsetSize subset size. The subset is centered at the pixel nearest to point.
+	\return index of the subset (>= 0). -1: no reference image. -2: subset is out of image.
+	-3: subset has no texture (singular Hessian).
+	*/
+	int addSubset(cv::Point2f point, cv::Size subsetSize);
+
+	//! Removes all subsets
+	void clearSubsets();
+
+	//! Returns number of subsets
+	int numSubsets() const;
+
+	//! Sets the deformed (current) image and computes its B-spline coefficients
+	/*!
+	\param img deformed image (1-channel, 8U or 32F, or 3-channel which is converted to gray)
+	\param roi region where subsets can be (e.g., union of search windows). Empty for whole image.
+	\return 0: success. -1: empty image.
+	*/
+	int setDeformedImage(const cv::Mat & img, cv::Rect roi = cv::Rect());
+
+	//! Sets the deformed image by B-spline coefficients which are already computed (shared)
+	int setDeformedImage(const BsplineImage & bimg);
+
+	//! Finds a subset in the deformed image by IC-GN
+	/*!
+	\param iSubset index of subset
+	\param guess initial guess of the target point in the deformed image
+	\param result result ([0]:x, [1]:y, [2]:ZNCC (1.0 for best), [3]:number of iterations,
+	[4]:du/dx, [5]:du/dy, [6]:dv/dx, [7]:dv/dy)
+	\param initShape if not NULL, initial guess of shape (du/dx, du/dy, dv/dx, dv/dy), e.g.,
+	result[4] ~ result[7] of previous step.
+	\param maxIter maximum number of iterations
+	\param eps convergence criterion. Norm of increment of (u, v, and shape parameters
+	multiplied by subset half size), in pixel.
+	\return 0: converged. -1: invalid subset or no deformed image. -2: subset goes out of
+	deformed image. -3: not converged in maxIter iterations (result is the last iteration).
+	*/
+	int match(int iSubset, cv::Point2f guess, std::vector<double> & result,
+		const double * initShape = NULL,
+		int maxIter = 30, double eps = 1e-3) const;
+
+private:
+	struct Subset {
+		cv::Point2f point;     // target point in reference image
+		cv::Point center;      // subset center (integer pixel)
+		cv::Mat dxy;           // N x 2 (CV_32F), offsets of subset pixels to center
+		cv::Mat f;             // N x 1 (CV_64F), zero-mean intensities of reference subset
+		double fNorm;          // sqrt(sum(f^2))
+		cv::Mat J;             // N x 6 (CV_64F), steepest descent images
+		cv::Mat invH;          // 6 x 6 (CV_64F), inverse of Hessian
+		double halfSize;       // half size of subset (for convergence criterion)
+	};
+	BsplineImage refBsp;       // B-spline coefficients of reference image
+	BsplineImage defBsp;       // B-spline coefficients of deformed image
+	std::vector<Subset> subsets;
+};
@@ -4,6 +4,7 @@
 
 #include "improConsole.h"
 #include "CamMoveCorrector.h"
+#include "PerfTrace.h"
 
 // arguments about general files
 //  -iflist=file, path and file name of list of input photos
@@ -27,6 +28,14 @@
 //  -calbsy=57.15 mm, distance between corners along y, unit: user defined (be consistent) 
 //  -calintrlvl=-1, 0:auto, 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.
 
+// arguments about batch (headless) run
+//  -jobs=file, path and file name of job file (yaml/xml). Runs all jobs and quits (see FuncRunJobs.cpp)
+//  -cmd=command, runs only the command (e.g., -cmd=syncC2) and quits. Exit code is the return value of the command.
+
+// arguments about performance instrumentation
+//  -trace=file, path and file name of Chrome trace-event JSON written at exit (enables PerfTrace).
+//               A summary (percentiles per stage) is written to file + "_summary.txt".
+
 
 int FuncCalibStereoOnSite(int, char**); 
 int FuncCalibInLabOnSite(int, char**);
@@ -59,8 +68,28 @@ int FuncWallDispCam(int argc, char ** argv); // made for SPD test 2019
 
 int FuncTryCamFocusExposure(int argc, char ** argv);
 
+int FuncRunJobs(int argc, char ** argv);
+
+int FuncSynthBenchmark(int argc, char ** argv);
+
+int FuncQ4DenseField(int argc, char ** argv);
+
+int FuncSelfTest(int argc, char ** argv);
+
 int main(int argc, char ** argv)
 {
+	// performance trace
+	std::string fnameTrace;
+	for (int i = 1; i < argc; i++)
+		if (std::string(argv[i]).find("-trace=") == 0)
+			fnameTrace = std::string(argv[i]).substr(7);
+	if (fnameTrace.length() > 0)
+		PerfTrace::writeAtExit(fnameTrace); // also on -jobs and -cmd paths
+
+	// headless batch run
+	for (int i = 1; i < argc; i++)
+		if (std::string(argv[i]).find("-jobs=") == 0)
+			return FuncRunJobs(argc, argv);
 
 	Submenu s(argc, argv);
 	s.addItem("calsite",    "Calibration: Stereo calibration on site               ", FuncCalibStereoOnSite); 
@@ -88,11 +117,23 @@ int main(int argc, char ** argv)
 	s.addItem("drawhouse", "Draw a house allowing tuning intrinsic p.",               FuncDrawHouse); 
 
 	s.addItem("optflow", "Dense (Farneback) optical flow analysis", FuncOptflowSeq); 
+	s.addItem("q4field", "Dense displacement/strain fields from tracked Q4 mesh points", FuncQ4DenseField);
 
 	s.addItem("wallDisp", "Plane wall displacement analysis (online)", FuncWallDisp); 
 	s.addItem("wallDispCam", "Plane wall displacement analysis (online, webcam)", FuncWallDispCam);
 
 	s.addItem("tryCam", "Try the best camera settings of focus and exposure", FuncTryCamFocusExposure); 
+
+	s.addItem("synth", "Benchmark: Synthetic sequence (known motion) and tracking accuracy/throughput", FuncSynthBenchmark);
+	s.addItem("selftest", "Test: Self tests of components (synthetic data, no prompts)", FuncSelfTest);
+
+	s.addItem("jobs", "Batch: Run jobs of a job file (yaml/xml) concurrently, without prompts", FuncRunJobs);
+
+	// single command (e.g., a command of a job), with its return value as exit code
+	for (int i = 1; i < argc; i++)
+		if (std::string(argv[i]).find("-cmd=") == 0)
+			return s.runItem(std::string(argv[i]).substr(5));
+
 	s.run();
 
 	return 0;
@@ -4,6 +4,7 @@
 #include "IntrinsicCalibrator.h"
 
 #include <vector>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
@@ -17,6 +18,12 @@
 //#include "ImProUtil.h"
 #include "impro_util.h"
 #include "ImagePointsPicker.h"
+#include "CornersCache.h"
+#include "AsyncLog.h"
+#include "PerfTrace.h"
+
+#include <omp.h>
+#include <thread>
 
 using namespace std;
 using namespace cv;
@@ -26,8 +33,8 @@ static vector<Point3f> emptyVecPoint3f;
 
 
 vector<double> proj_err_points(
-	const vector<cv::Point2f> imgPoints,
-	const vector<cv::Point3f> objPoints,
+	const vector<cv::Point2f> & imgPoints,
+	const vector<cv::Point3f> & objPoints,
 	const cv::Mat cmat, const cv::Mat dvec,
 	const cv::Mat rvec, const cv::Mat tvec) {
 	// vector err
@@ -36,7 +43,7 @@ vector<double> proj_err_points(
 	if (rvec.cols == 3 && rvec.rows == 3)
 		cv::Rodrigues(rvec, rvec);
 	// run projection
-	vector<Point2f> projectedImgPoints = imgPoints;
+	vector<Point2f> projectedImgPoints;
 	cv::projectPoints(objPoints,
 		rvec, tvec,
 		cmat, dvec, projectedImgPoints);
@@ -51,7 +58,7 @@ vector<double> proj_err_points(
 }
 
 vector<double> proj_err_lines(
-	const vector<cv::Point2f> imgPoints,
+	const vector<cv::Point2f> & imgPoints,
 	const cv::Mat cmat, const cv::Mat dvec) {
 	// vector err
 	vector<double> err(imgPoints.size(), 0);
@@ -87,6 +94,70 @@ vector<double> proj_err_lines(
 	return err;
 }
 
+ProjErrStats proj_err_all(
+	const vector<vector<cv::Point2f> > & imgPoints,
+	const vector<vector<cv::Point3f> > & objPoints,
+	const vector<int> & calTypes,
+	const cv::Mat & cmat, const cv::Mat & dvec,
+	const vector<cv::Vec3d> & rvecs, const vector<cv::Vec3d> & tvecs) {
+	ProjErrStats st;
+	int nView = (int) imgPoints.size();
+	st.errs.resize(nView);
+	st.rmsView.assign(nView, nan(""));
+	st.maxView.assign(nView, nan(""));
+	// errors of each photo (photos are independent)
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < nView; i++) {
+		int calType = i < (int) calTypes.size() ? calTypes[i] : 0;
+		if ((calType == 1 || calType == 2 || calType == 3 || calType == 11) &&
+			i < (int) objPoints.size() && objPoints[i].size() == imgPoints[i].size() &&
+			i < (int) rvecs.size() && i < (int) tvecs.size() && imgPoints[i].size() > 0) {
+			st.errs[i] = proj_err_points(imgPoints[i], objPoints[i],
+				cmat, dvec, cv::Mat(rvecs[i]), cv::Mat(tvecs[i]));
+		}
+		else if (calType == 12 && imgPoints[i].size() > 0) {
+			st.errs[i] = proj_err_lines(imgPoints[i], cmat, dvec);
+		}
+		else {
+			st.errs[i].assign(imgPoints[i].size(), nan(""));
+			continue;
+		}
+		double sum2 = 0.0, emax = 0.0;
+		int count = 0;
+		for (int j = 0; j < (int) st.errs[i].size(); j++) {
+			double e = st.errs[i][j];
+			if (isnan(e)) continue;
+			sum2 += e * e;
+			emax = std::max(emax, e);
+			count++;
+		}
+		if (count > 0) {
+			st.rmsView[i] = sqrt(sum2 / count);
+			st.maxView[i] = emax;
+		}
+	}
+	// overall statistics
+	vector<double> all;
+	for (int i = 0; i < nView; i++)
+		for (int j = 0; j < (int) st.errs[i].size(); j++)
+			if (isnan(st.errs[i][j]) == false)
+				all.push_back(st.errs[i][j]);
+	st.nPoint = (int) all.size();
+	st.rms = st.p50 = st.p90 = st.p95 = st.maxErr = nan("");
+	if (st.nPoint > 0) {
+		double sum2 = 0.0;
+		for (int k = 0; k < st.nPoint; k++)
+			sum2 += all[k] * all[k];
+		st.rms = sqrt(sum2 / st.nPoint);
+		std::sort(all.begin(), all.end());
+		st.p50 = all[(int) (0.50 * (st.nPoint - 1) + 0.5)];
+		st.p90 = all[(int) (0.90 * (st.nPoint - 1) + 0.5)];
+		st.p95 = all[(int) (0.95 * (st.nPoint - 1) + 0.5)];
+		st.maxErr = all[st.nPoint - 1];
+	}
+	return st;
+}
+
 IntrinsicCalibrator::IntrinsicCalibrator()
 {
 	this->init(); 
@@ -127,6 +198,7 @@ void IntrinsicCalibrator::init()
 //	this->need_calibrate = true;
 	this->imgSize = cv::Size(0, 0);
 	this->calib_rms = nanf("");
+	this->projErrStatsCached = false;
 
 	// set log file name 
 	// (as this function is supposed to be called in the very beginning)
@@ -170,6 +242,7 @@ void IntrinsicCalibrator::setCalibrationBoard(int type, int num_corners_along_wi
 
 int IntrinsicCalibrator::setFileSeq(const FileSeq & _imsq)
 {
+	this->invalidateProjErrStats();
 	// When user resets the file sequence of images, this program also resets the 
 	// calibration parameters.
 //	this->need_calibrate = true;
@@ -234,6 +307,7 @@ cv::Size IntrinsicCalibrator::imageSize() const
 
 int IntrinsicCalibrator::addCalibrationPhoto(const cv::Mat & img, const cv::Size bsize_w_h, double square_w, double square_h)
 {
+	this->invalidateProjErrStats();
 	// Check data
 	if (img.cols <= 0 || img.rows <= 0)
 		return -1;
@@ -276,6 +350,71 @@ int IntrinsicCalibrator::addCalibrationPhoto(const cv::Mat & img, const cv::Size
 	return 1;
 }
 
+// finds calibration board corners in an image. 
+// board_type: 1:chessboard, 2.grid(sym), 3.grid(unsym)
+static bool findBoardCorners(cv::Mat img, cv::Size bSize, int board_type, vector<Point2f> & tmp_imgPoints)
+{
+	bool bres = false;
+	if (board_type == 1)
+		bres = findChessboardCornersSubpix(img, bSize, tmp_imgPoints);
+	else if (board_type == 2) {
+		bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+		if (bres == 0) {
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_SYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
+		}
+		if (bres == 0) {
+			bitwise_not(img, img);
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+		}
+		if (bres == 0) {
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_SYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
+		}
+		if (bres == 0) {
+			cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+			if (bres == true)
+				for (int i = 0; i < tmp_imgPoints.size(); i++) {
+					tmp_imgPoints[i].x *= 2.0f;
+					tmp_imgPoints[i].y *= 2.0f;
+				}
+		}
+		if (bres == 0) {
+			cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+			if (bres == true)
+				for (int i = 0; i < tmp_imgPoints.size(); i++) {
+					tmp_imgPoints[i].x *= 4.0f;
+					tmp_imgPoints[i].y *= 4.0f;
+				}
+		}
+		if (bres == 0) {
+			cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+			if (bres == true)
+				for (int i = 0; i < tmp_imgPoints.size(); i++) {
+					tmp_imgPoints[i].x *= 8.0f;
+					tmp_imgPoints[i].y *= 8.0f;
+				}
+		}
+		if (bres == 0) {
+			cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
+			if (bres == true)
+				for (int i = 0; i < tmp_imgPoints.size(); i++) {
+					tmp_imgPoints[i].x *= 16.f;
+					tmp_imgPoints[i].y *= 16.f;
+				}
+		}
+	}
+	else if (board_type == 3) {
+		bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_ASYMMETRIC_GRID);
+		if (bres == 0) {
+			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_ASYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
+		}
+	}
+	return bres;
+}
+
 int IntrinsicCalibrator::findCorners(int idx, cv::Size bSize, 
 	float sqw, float sqh, int board_type)
 {
@@ -283,110 +422,114 @@ int IntrinsicCalibrator::findCorners(int idx, cv::Size bSize,
 	if (idx < 0 || idx >= this->imsq.num_files()) {
 		char buf[1000];
 		snprintf(buf, 1000, " Error: findCorners(): Index %d is out of range (%d).", idx, this->imsq.num_files());
-		this->log(buf); 
+		this->log(buf, ALOG_ERROR); 
 		return -1;
 	}
-	
-//	// save calibration type to board type (chess/grid/grid-unsym)
-//	if (this->cal_types.size() < idx + 1)
-//		this->cal_types.resize(idx + 1, -1); 
-//	this->cal_types[idx] = board_type; 
-
-	// Read file and load image
-	std::string fname = this->imsq.fullPathOfFile(idx); 
-	cv::Mat img = cv::imread(fname, cv::IMREAD_GRAYSCALE); 
-	if (img.rows <= 0 || img.cols <= 0) {
-		char buf[1000];
-		snprintf(buf, 1000, " Error: findCorners(): Cannot load image from file %s.", fname.c_str());
-		this->log(buf); 
+	vector<int> idxs(1, idx);
+	if (this->findCornersOfPhotos(idxs, bSize, sqw, sqh, board_type, 1, false) <= 0)
 		return -1;
-	}
-
-	// prepare for finding corners
-//	int num_corners = this->num_corners_along_width * this->num_corners_along_height; 
-	int num_corners = bSize.width * bSize.height; 
-//	cv::Size bSize(this->num_corners_along_width, this->num_corners_along_height);
-	vector<Point2f> tmp_imgPoints(num_corners);
+	return 0;
+}
 
-	// Check find
-	if (this->findingCornersResult.size() <= idx)
-		this->findingCornersResult.resize((size_t)(idx + 1));
+std::string IntrinsicCalibrator::cornersCacheFile() const
+{
+	std::string dir = this->imsq.directory();
+	if (dir.length() <= 1 && this->imsq.num_files() > 0)
+		dir = directoryOfFullPathFile(this->imsq.fullPathOfFile(0));
+	return dir + "cornersCache.bin";
+}
 
-	// Try to find the corners in the photo. If found, add this photo and corners points. 
-	bool bres = false;
-	// Check if corners have been found before and saved to a file
-	tmp_imgPoints.clear(); 
-	std::string cornersFnameCheck = extFilenameRemoved(fname) + "_corners.xml";
-	cv::FileStorage fsCornersCheck(cornersFnameCheck, cv::FileStorage::READ); 
-	if (fsCornersCheck.isOpened()) {
-		fsCornersCheck["CornersVecPoint2f"] >> tmp_imgPoints;
-		if (tmp_imgPoints.size() == num_corners) bres = true;
-	}
-	// If corners not read from file, find them by corner finder. 
-	if (bres == false) 
-	{
-		if (board_type == 1)
-			bres = findChessboardCornersSubpix(img, bSize, tmp_imgPoints);
-		else if (board_type == 2) {
-			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-			if (bres == 0) {
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_SYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
-			}
-			if (bres == 0) {
-				bitwise_not(img, img);
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-			}
-			if (bres == 0) {
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_SYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
-			}
-			if (bres == 0) {
-				cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-				if (bres == true)
-					for (int i = 0; i < tmp_imgPoints.size(); i++) {
-						tmp_imgPoints[i].x *= 2.0f;
-						tmp_imgPoints[i].y *= 2.0f;
-					}
-			}
-			if (bres == 0) {
-				cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-				if (bres == true)
-					for (int i = 0; i < tmp_imgPoints.size(); i++) {
-						tmp_imgPoints[i].x *= 4.0f;
-						tmp_imgPoints[i].y *= 4.0f;
-					}
-			}
-			if (bres == 0) {
-				cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-				if (bres == true)
-					for (int i = 0; i < tmp_imgPoints.size(); i++) {
-						tmp_imgPoints[i].x *= 8.0f;
-						tmp_imgPoints[i].y *= 8.0f;
-					}
-			}
-			if (bres == 0) {
-				cv::resize(img, img, cv::Size(0, 0), 0.5, 0.5, cv::INTER_LANCZOS4);
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints);
-				if (bres == true)
-					for (int i = 0; i < tmp_imgPoints.size(); i++) {
-						tmp_imgPoints[i].x *= 16.f;
-						tmp_imgPoints[i].y *= 16.f;
-					}
-			}
+int IntrinsicCalibrator::findCornersOfPhotos(const vector<int> & idxs, cv::Size bSize,
+	float sqw, float sqh, int board_type, int nThreads, bool printResult)
+{
+	int n = (int) idxs.size();
+	if (n <= 0)
+		return 0;
+	// corners found before (also in an interrupted run) are in the sidecar file
+	// (shared with other calibrators using the same file, e.g., the other camera of calibrateTwoCameras())
+	std::shared_ptr<CornersCache> cache = CornersCache::shared(this->cornersCacheFile());
+	bool cacheOk = (bool) cache;
+	vector<CornersCache::Entry> res(n);
+	vector<int> readable(n, 1);
+	if (nThreads <= 0)
+		nThreads = omp_get_max_threads();
+#pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+	for (int k = 0; k < n; k++) {
+		std::string fname = this->imsq.fullPathOfFile(idxs[k]);
+		CornersCache::Entry & e = res[k];
+		e.name = this->imsq.filename(idxs[k]);
+		e.fileSize = CornersCache::fileSizeOf(fname);
+		e.mtime = CornersCache::fileMTimeOf(fname);
+		if (cacheOk && cache->find(e.name, e.fileSize, e.mtime, board_type, bSize, e))
+			continue;
+		PERF_SCOPE_POINT("calib.findCorners", idxs[k]);
+		// Read file and load image
+		cv::Mat img = cv::imread(fname, cv::IMREAD_GRAYSCALE); 
+		if (img.rows <= 0 || img.cols <= 0) {
+			readable[k] = 0;
+			continue;
 		}
-		else if (board_type == 3) {
-			bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_ASYMMETRIC_GRID);
-			if (bres == 0) {
-				bres = cv::findCirclesGrid(img, bSize, tmp_imgPoints, CALIB_CB_ASYMMETRIC_GRID | cv::CALIB_CB_CLUSTERING);
-			}
+		e.boardType = board_type;
+		e.bSize = bSize;
+		e.imgSize = img.size();
+		// Check if corners have been saved to a per-photo file (by former versions)
+		bool bres = false;
+		bool fromXml = false;
+		std::string cornersFnameCheck = extFilenameRemoved(fname) + "_corners.xml";
+		cv::FileStorage fsCornersCheck(cornersFnameCheck, cv::FileStorage::READ); 
+		if (fsCornersCheck.isOpened()) {
+			fsCornersCheck["CornersVecPoint2f"] >> e.corners;
+			if (e.corners.size() == bSize.width * bSize.height) bres = fromXml = true;
 		}
+		// If corners not read from file, find them by corner finder. 
+		if (bres == false) 
+			bres = findBoardCorners(img, bSize, board_type, e.corners);
+		e.found = bres ? 1 : 0;
+		if (bres == false)
+			e.corners.clear();
+		// draw corners to file
+		if (bres && fromXml == false) {
+			std::string drawFname = appendSubstringBeforeLastDot(fname, "_cornersDrawn"); 
+			cv::Mat drawImg = cv::imread(fname); 
+			drawChessboardCorners(drawImg, bSize, e.corners, bres);
+			cv::imwrite(drawFname, drawImg, std::vector<int>({ cv::IMWRITE_JPEG_QUALITY, 25 }));
+		}
+		if (cacheOk)
+			cache->append(e);
 	}
-	
-	if (bres == true) {
+	// set results in order of photos
+	int nFound = 0;
+	for (int k = 0; k < n; k++) {
+		int idx = idxs[k];
+		std::string fname = this->imsq.fullPathOfFile(idx);
+		if (readable[k] == 0) {
+			char buf[1000];
+			snprintf(buf, 1000, " Error: findCorners(): Cannot load image from file %s.", fname.c_str());
+			this->log(buf, ALOG_ERROR); 
+		}
+		if (this->setFoundCorners(idx, res[k], readable[k] != 0 && res[k].found != 0, sqw, sqh, board_type) == 0)
+			nFound++;
+		if (printResult) {
+			cout << "   " << this->imsq.filename(idx) << ": ";
+			if (readable[k] != 0 && res[k].found != 0)
+				cout << "Corners found successfully.\n";
+			else
+				cout << "Failed to find corners in this photo.\n";
+		}
+	}
+	return nFound;
+}
+
+int IntrinsicCalibrator::setFoundCorners(int idx, const CornersCache::Entry & e, bool found,
+	float sqw, float sqh, int board_type)
+{
+	this->invalidateProjErrStats();
+	// Check find
+	if (this->findingCornersResult.size() <= idx)
+		this->findingCornersResult.resize((size_t)(idx + 1));
+	if (found) {
 		// set image size
-		this->imgSize = img.size();
+		this->imgSize = e.imgSize;
 
 		if (this->n_calib_imgs <= idx)
 			this->n_calib_imgs = idx + 1;
@@ -394,24 +537,12 @@ int IntrinsicCalibrator::findCorners(int idx, cv::Size bSize,
 		//   Make sure calib_imgPoints has sufficent size
 		if (this->calib_imgPoints.size() <= idx)
 			this->calib_imgPoints.resize((size_t)(idx + 1));
-		this->calib_imgPoints[idx] = tmp_imgPoints;
+		this->calib_imgPoints[idx] = e.corners;
 		// Set result
 		this->findingCornersResult[idx] = 1;
-		this->log(" findCorners(): Found corners in file " + fname);
-		// draw corners to file
-		std::string drawFname = appendSubstringBeforeLastDot(fname, "_cornersDrawn"); 
-		cv::Mat drawImg = cv::imread(fname); 
-		drawChessboardCorners(drawImg, bSize, this->calib_imgPoints[idx], bres);
-		cv::imwrite(drawFname, drawImg, std::vector<int>({ cv::IMWRITE_JPEG_QUALITY, 25 }));
-		// save corners points
-		if (bres) {
-			std::string cornersFname = extFilenameRemoved(fname) + "_corners.xml";
-			cv::FileStorage fsCorners(cornersFname, cv::FileStorage::WRITE);
-			fsCorners << "CornersVecPoint2f" << this->calib_imgPoints[idx];
-			fsCorners.release(); 
-		}
+		this->log(" findCorners(): Found corners in file " + this->imsq.fullPathOfFile(idx));
 		// set object points
-		this->setBoardObjPoints(idx, bSize, sqw, sqh, board_type); 
+		this->setBoardObjPoints(idx, e.bSize, sqw, sqh, board_type); 
 		// save calibration type to board type (chess/grid/grid-unsym)
 		if (this->cal_types.size() < idx + 1)   
 			this->cal_types.resize(idx + 1, 0);
@@ -426,13 +557,12 @@ int IntrinsicCalibrator::findCorners(int idx, cv::Size bSize,
 		this->cal_types[idx] = 0; // set cal type to "not assigned" 
 		return -1;
 	}
-	if (this->findingCornersResult[idx] == -1)
-		return -1;
 	return 0;
 }
 
 vector<int>& IntrinsicCalibrator::calTypes()
 {
+	this->invalidateProjErrStats();
 	return this->cal_types;
 }
 const vector<int>& IntrinsicCalibrator::calTypes() const
@@ -442,6 +572,7 @@ const vector<int>& IntrinsicCalibrator::calTypes() const
 
 vector<vector<Point2f>>& IntrinsicCalibrator::imgPoints()
 {
+	this->invalidateProjErrStats();
 	return this->calib_imgPoints; 
 }
 const vector<vector<Point2f>>& IntrinsicCalibrator::imgPoints() const
@@ -451,6 +582,7 @@ const vector<vector<Point2f>>& IntrinsicCalibrator::imgPoints() const
 
 vector<vector<Point3f>>& IntrinsicCalibrator::objPoints()
 {
+	this->invalidateProjErrStats();
 	return this->calib_objPoints;
 }
 const vector<vector<Point3f>>& IntrinsicCalibrator::objPoints() const
@@ -527,38 +659,24 @@ int IntrinsicCalibrator::writeObjsPointsToFiles()
 }
 
 int IntrinsicCalibrator::findAllCorners(cv::Size bSize, 
-	float sqw, float sqh, int board_type)
+	float sqw, float sqh, int board_type, int nThreads)
 {
-	// try to find corners in add all FileSequence files
-	// If corners are found, add the file into calib_valid_fnames.
+	// try to find corners in all FileSequence files (in parallel)
 	int nfile = imsq.num_files();
 	if (nfile <= 0)
 		return 0;
+	vector<int> idxs(nfile);
 	for (int i = 0; i < nfile; i++)
-	{
-		this->findCorners(i, bSize, sqw, sqh, board_type); 
-//		// read image 
-//		cv::Mat img = cv::imread(imsq.fullPathOfFile(i), IMREAD_GRAYSCALE);
-//		// try to find corners. If found, add corners to calib_objPoints and calib_imgPoints.
-//		int added = this->addCalibrationPhoto(img,
-//			cv::Size(this->num_corners_along_width, this->num_corners_along_height),
-//			this->square_width, this->square_height);
-//		if (added == 1) {
-//			if (this->calib_valid_fnames.size() < n_calib_imgs) {
-//				this->calib_valid_fnames.resize(n_calib_imgs);
-//			}
-//			this->calib_valid_fnames[this->n_calib_imgs - 1] = imsq.filename(i);
-////			this->need_calibrate = true;
-//		}
-	}
-	return (int) this->calib_valid_fnames.size();
+		idxs[i] = i;
+	return this->findCornersOfPhotos(idxs, bSize, sqw, sqh, board_type, nThreads, true);
 }
 
 int IntrinsicCalibrator::setBoardObjPoints(int idx, cv::Size bSize, float sqw, float sqh,
 	int board_type)
 {
+	this->invalidateProjErrStats();
 	if (board_type == 0) {
-		this->log(" IntrinsicCalibrator:Warning: Board type is not set.\n");
+		this->log(" IntrinsicCalibrator:Warning: Board type is not set.\n", ALOG_WARN);
 		return -1;
 	}
 	if (this->calib_objPoints.size() < idx + 1)
@@ -579,7 +697,7 @@ int IntrinsicCalibrator::setBoardObjPoints(int idx, cv::Size bSize, float sqw, f
 						float(i * sqh), 0));
 	}
 	else {
-		this->log(" IntrinsicCalibrator:Warning: Unknown board type when setting obj points.\n");
+		this->log(" IntrinsicCalibrator:Warning: Unknown board type when setting obj points.\n", ALOG_WARN);
 		return -1;
 	}
 	return 0;
@@ -590,6 +708,7 @@ int IntrinsicCalibrator::defineUserPoints(int idx,
 	const vector<cv::Point3f>& objPoints, 
 	cv::Size _imgSize)
 {
+	this->invalidateProjErrStats();
 	if (this->calib_imgPoints.size() <= idx) {
 		this->calib_imgPoints.resize(idx + 1);
 		this->n_calib_imgs = (int) this->calib_imgPoints.size(); 
@@ -635,18 +754,21 @@ int IntrinsicCalibrator::defineUserPoints(int idx,
 
 int IntrinsicCalibrator::setCameraMatrix(const cv::Mat & _cmat)
 {
+	this->invalidateProjErrStats();
 	_cmat.copyTo(this->cmat);
 	return 0;
 }
 
 int IntrinsicCalibrator::setDistortionVector(const cv::Mat & _dvec)
 {
+	this->invalidateProjErrStats();
 	_dvec.copyTo(this->dvec); 
 	return 0;
 }
 
 int IntrinsicCalibrator::solvePnp(int valid_photo_id)
 {
+	this->invalidateProjErrStats();
 	cv::Mat rvec(1,1, CV_64FC3), tvec(1,1, CV_64FC3); 
 	if (this->calib_objPoints.size() <= valid_photo_id || this->calib_imgPoints.size() <= valid_photo_id)
 	{
@@ -810,8 +932,41 @@ int IntrinsicCalibrator::setFlagByAsking()
 	return 0;
 }
 
+bool IntrinsicCalibrator::isValidCalibPhoto(int i) const
+{
+	if (i < 0 || i >= (int) this->cal_types.size())
+		return false;
+	// calibration type is for typical calibration (1, 2, 3, 11)
+	if (this->cal_types[i] != 1 && this->cal_types[i] != 2 &&
+		this->cal_types[i] != 3 && this->cal_types[i] != 11)
+		return false;
+	if (this->calib_objPoints.size() <= i || this->calib_imgPoints.size() <= i)
+		return false;
+	// numbers of points are correct
+	if (this->calib_imgPoints[i].size() <= 0 ||
+		this->calib_objPoints[i].size() <= 0 || 
+		this->calib_imgPoints[i].size() != this->calib_objPoints[i].size())
+		return false;
+	// check each point in this calibration image 
+	for (int j = 0; j < this->calib_imgPoints[i].size(); j++) {
+		if (isnan(this->calib_imgPoints[i][j].x) ||
+			isnan(this->calib_imgPoints[i][j].y) ||
+			isnan(this->calib_objPoints[i][j].x) ||
+			isnan(this->calib_objPoints[i][j].y) ||
+			isnan(this->calib_objPoints[i][j].z) ||
+			this->calib_imgPoints[i][j].x < 0 ||
+			this->calib_imgPoints[i][j].y < 0 ) {
+//			this->calib_imgPoints[i][j].x > this->imgSize.width ||
+//			this->calib_imgPoints[i][j].y > this->imgSize.height) {
+			return false;
+		} // end of if invalid
+	} // end of for-each point of this calibration image
+	return true;
+}
+
 int IntrinsicCalibrator::calibrate(int flagType, int flag)
 {
+	this->invalidateProjErrStats();
 	// check if corners are found
 //	if (this->imsq.num_files() > 0 && this->calib_imgPoints.size() == 0 &&
 //		this->calib_objPoints.size() == 0) {
@@ -832,35 +987,15 @@ int IntrinsicCalibrator::calibrate(int flagType, int flag)
 		if (this->cal_types[i] != 1 && this->cal_types[i] != 2 &&
 			this->cal_types[i] != 3 && this->cal_types[i] != 11)
 			continue;
-		if (this->calib_objPoints.size() <= i || this->calib_imgPoints.size() <= i) {
-			isValid = false; 
-			this->cal_types[i] = 0; 
-			continue; 
-		}
-		// if numbers of points are not correct, skip it.
-		if (this->calib_imgPoints[i].size() <= 0 ||
-			this->calib_objPoints[i].size() <= 0 || 
-			this->calib_imgPoints[i].size() != this->calib_objPoints[i].size()) {
+		// if points are not correct, set it to not assigned and skip it
+		if (this->isValidCalibPhoto(i) == false) {
 			isValid = false;
 			this->cal_types[i] = 0;
 			continue;
 		}
-		// check each point in this calibration image 
-		for (int j = 0; j < this->calib_imgPoints[i].size(); j++) {
-			if (isnan(this->calib_imgPoints[i][j].x) ||
-				isnan(this->calib_imgPoints[i][j].y) ||
-				isnan(this->calib_objPoints[i][j].x) ||
-				isnan(this->calib_objPoints[i][j].y) ||
-				isnan(this->calib_objPoints[i][j].z) ||
-				this->calib_imgPoints[i][j].x < 0 ||
-				this->calib_imgPoints[i][j].y < 0 ) {
-//				this->calib_imgPoints[i][j].x > this->imgSize.width ||
-//				this->calib_imgPoints[i][j].y > this->imgSize.height) {
-				isValid = false;
-				this->cal_types[i] = 0;
-				continue;
-			} // end of if invalid
-		} // end of for-each point of this calibration image
+		// if excluded (by incremental calibration), skip it
+		if (i < (int) this->calib_excluded.size() && this->calib_excluded[i])
+			continue;
 		if (isValid == true) {
 			if (imgPointsValid.size() <= num_valid_calib_img)
 				imgPointsValid.resize(num_valid_calib_img + 1);
@@ -951,6 +1086,7 @@ int IntrinsicCalibrator::calibrate(int flagType, int flag)
 //		flag = flag; // doing nothing, will be optimized away by compiler. 
 	}	
 
+	PERF_SCOPE("calib.calibrate"); // cv::calibrateCamera() and the rest of calibrate()
 	double _calib_rms = cv::calibrateCamera(objPointsValid,
 		imgPointsValid, this->imgSize, this->cmat, this->dvec, 
 		rvecs_dummy, tvecs_dummy,
@@ -972,30 +1108,13 @@ int IntrinsicCalibrator::calibrate(int flagType, int flag)
 	// set root-mean-square (rms) error
 	this->calib_rms = _calib_rms;
 
-	// calculate rms of the added (last) photo
+	// calculate rms of each valid photo (all photos in one pass)
+	const ProjErrStats & errStats = this->projection_error_stats();
+	this->projection_errs = errStats.errs;
 	for (int i = 0; i < num_valid_calib_img; i++) {
-		// reprojection
-		vector<Point2f> projectedImgPoints = this->calib_imgPoints[n2o[i]];
-		cv::projectPoints(this->calib_objPoints[n2o[i]],
-			rvecs_dummy.at<Vec3d>(i, 0), tvecs_dummy.at<Vec3d>(i, 0),
-			this->cmat, this->dvec, projectedImgPoints);
-		// calculate rms
 		if (this->calib_valid_rms.size() < n2o[i] + 1)
 			this->calib_valid_rms.resize(n2o[i] + 1);
-		this->calib_valid_rms[n2o[i]] = 0.0;
-		for (int j = 0; j < projectedImgPoints.size(); j++)
-		{
-			double dx = projectedImgPoints[j].x - this->calib_imgPoints[n2o[i]][j].x;
-			double dy = projectedImgPoints[j].y - this->calib_imgPoints[n2o[i]][j].y;
-			this->calib_valid_rms[n2o[i]] += dx * dx + dy * dy;
-			if (this->projection_errs.size() <= n2o[i])
-				this->projection_errs.resize(n2o[i] + 1); 
-			if (this->projection_errs[n2o[i]].size() <= j)
-				this->projection_errs[n2o[i]].resize(j + 1); 
-			this->projection_errs[n2o[i]][j] = sqrt(dx * dx + dy * dy); 
-		}
-		this->calib_valid_rms[n2o[i]] = 
-			sqrt(this->calib_valid_rms[n2o[i]] / projectedImgPoints.size());
+		this->calib_valid_rms[n2o[i]] = errStats.rmsView[n2o[i]];
 	}
 
 	// set the camera rvec and tvec
@@ -1027,64 +1146,461 @@ int IntrinsicCalibrator::calibrate(int flagType, int flag)
 	return 0;
 }
 
-int IntrinsicCalibrator::calibrateByLevel(int level)
+int IntrinsicCalibrator::calibFlagOfLevel(int level)
 {
 	int theFlag = 0; 
-	if (level == 1) {
+	if (level < 1 || level > 5)
+		return -1;
+	if (level <= 1)
 		theFlag |= cv::CALIB_FIX_ASPECT_RATIO;  // fx = fy
+	if (level <= 2)
 		theFlag |= cv::CALIB_FIX_PRINCIPAL_POINT; // fix cx, cy (to image center)
+	if (level <= 3)
 		theFlag |= cv::CALIB_ZERO_TANGENT_DIST; // p1 = p2 = 0
+	if (level <= 4)
 		theFlag |= cv::CALIB_FIX_K2; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
-		theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
-		this->calibrate(2, theFlag);
-	}
-	else if (level == 2) {
-		theFlag |= cv::CALIB_FIX_PRINCIPAL_POINT; // fix cx, cy (to image center)
-		theFlag |= cv::CALIB_ZERO_TANGENT_DIST; // p1 = p2 = 0
-		theFlag |= cv::CALIB_FIX_K2; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
-		theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
-		this->calibrate(2, theFlag);
-	}
-	else if (level == 3) {
-		theFlag |= cv::CALIB_ZERO_TANGENT_DIST; // p1 = p2 = 0
-		theFlag |= cv::CALIB_FIX_K2; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
-		theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
-		this->calibrate(2, theFlag);
-	}
-	else if (level == 4) {
-		theFlag |= cv::CALIB_FIX_K2; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
-		theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
-		this->calibrate(2, theFlag);
-	}
-	else if (level == 5) {
-		theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
-		theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
-		theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
-		this->calibrate(2, theFlag);
+	theFlag |= cv::CALIB_FIX_K3; // fix kx (to zero)
+	theFlag |= cv::CALIB_FIX_K4; // fix kx (to zero)
+	theFlag |= cv::CALIB_FIX_K5; // fix kx (to zero)
+	theFlag |= cv::CALIB_FIX_K6; // fix kx (to zero)
+	theFlag |= cv::CALIB_USE_INTRINSIC_GUESS;
+	return theFlag;
+}
+
+bool IntrinsicCalibrator::calibLevelAsksFlags(int level)
+{
+	return !((level >= 1 && level <= 6) || (level >= 11 && level <= 15));
+}
+
+int IntrinsicCalibrator::calibrateByLevel(int level, bool askFlags)
+{
+	if (level >= 1 && level <= 5) {
+		this->calibrate(2, calibFlagOfLevel(level));
+	}
+	else if (level == 6) {
+		vector<int> flags = this->sweep_flags;
+		if (flags.size() <= 0)
+			for (int i = 0; i < 5; i++)
+				flags.push_back(calibFlagOfLevel(i + 1));
+		string prefix = this->sweep_prefix;
+		if (prefix.length() <= 0)
+			prefix = this->imsq.directory() + "calibSweep";
+		if (this->calibrateSweep(flags, prefix) < 0)
+			return -1;
+	}
+	else if (level >= 11 && level <= 15) {
+		if (this->calibrateIncremental(calibFlagOfLevel(level - 10)) < 0)
+			return -1;
 	}
 	else {
-		this->setFlagByAsking();
+		if (askFlags)
+			this->setFlagByAsking();
 		this->calibrate();
 	}
 	this->projection_points_vecvec();
+	const ProjErrStats & errStats = this->projection_error_stats();
+	printf("Projection errors (pixel) of %d points: rms %.3f, median %.3f, 90%% %.3f, 95%% %.3f, max %.3f\n",
+		errStats.nPoint, errStats.rms, errStats.p50, errStats.p90, errStats.p95, errStats.maxErr);
+	return 0;
+}
+
+// calibration flags and their short names (for printing and parsing)
+static const int calibFlagVals[] = { cv::CALIB_FIX_ASPECT_RATIO, cv::CALIB_FIX_PRINCIPAL_POINT,
+	cv::CALIB_ZERO_TANGENT_DIST, cv::CALIB_FIX_FOCAL_LENGTH, cv::CALIB_FIX_K1, cv::CALIB_FIX_K2,
+	cv::CALIB_FIX_K3, cv::CALIB_FIX_K4, cv::CALIB_FIX_K5, cv::CALIB_FIX_K6,
+	cv::CALIB_RATIONAL_MODEL, cv::CALIB_THIN_PRISM_MODEL, cv::CALIB_TILTED_MODEL,
+	cv::CALIB_USE_INTRINSIC_GUESS };
+static const char * calibFlagNames[] = { "FixAspect", "FixPP", "ZeroTang", "FixFocal", "FixK1", "FixK2",
+	"FixK3", "FixK4", "FixK5", "FixK6", "Rational", "ThinPrism", "Tilted", "Guess" };
+static const int nCalibFlagNames = (int) (sizeof(calibFlagVals) / sizeof(int));
+
+static string calibFlagsString(int flag)
+{
+	string str;
+	for (int i = 0; i < nCalibFlagNames; i++) {
+		if (calibFlagVals[i] == cv::CALIB_USE_INTRINSIC_GUESS) continue; // always set by levels
+		if ((flag & calibFlagVals[i]) == 0) continue;
+		if (str.length() > 0) str += "|";
+		str += calibFlagNames[i];
+	}
+	return str.length() > 0 ? str : string("(none)");
+}
+
+int IntrinsicCalibrator::calibFlagsFromString(string str)
+{
+	int flag = 0;
+	vector<string> items;
+	size_t start = 0;
+	while (start <= str.length()) {
+		size_t end = str.find_first_of("|+", start);
+		if (end == string::npos) end = str.length();
+		string item = str.substr(start, end - start);
+		// trim spaces
+		item.erase(0, item.find_first_not_of(" \t"));
+		item.erase(item.find_last_not_of(" \t") + 1);
+		if (item.length() > 0)
+			items.push_back(item);
+		start = end + 1;
+	}
+	if (items.size() <= 0)
+		return -1;
+	for (int i = 0; i < (int) items.size(); i++) {
+		// level
+		if (items[i].length() == 1 && items[i][0] >= '1' && items[i][0] <= '5') {
+			flag |= calibFlagOfLevel(items[i][0] - '0');
+			continue;
+		}
+		// flag name (with '-' to clear it)
+		bool clear = items[i][0] == '-';
+		string name = clear ? items[i].substr(1) : items[i];
+		int j;
+		for (j = 0; j < nCalibFlagNames; j++)
+			if (name == calibFlagNames[j]) break;
+		if (j >= nCalibFlagNames) {
+			cerr << "IntrinsicCalibrator::calibFlagsFromString(): Unknown flag " << items[i] << " in " << str << endl;
+			return -1;
+		}
+		if (clear)
+			flag &= ~calibFlagVals[j];
+		else
+			flag |= calibFlagVals[j];
+	}
+	return flag;
+}
+
+int IntrinsicCalibrator::setSweep(string candidates, string candFilePrefix)
+{
+	vector<int> flags;
+	size_t start = 0;
+	while (start < candidates.length()) {
+		size_t end = candidates.find(',', start);
+		if (end == string::npos) end = candidates.length();
+		string cand = candidates.substr(start, end - start);
+		if (cand.find_first_not_of(" \t") != string::npos) {
+			int flag = calibFlagsFromString(cand);
+			if (flag < 0) {
+				cerr << "IntrinsicCalibrator::setSweep(): Candidate " << cand << " is not valid.\n";
+				return -1;
+			}
+			flags.push_back(flag);
+		}
+		start = end + 1;
+	}
+	this->sweep_flags = flags;
+	this->sweep_prefix = candFilePrefix;
+	return (int) flags.size();
+}
+
+int IntrinsicCalibrator::heldOutErrors(int flag, const vector<int> & heldOut, double & sumSq, int & nPoint) const
+{
+	// a copy of this calibrator (cv::Mat members are shared by copies, so they are cloned)
+	IntrinsicCalibrator cal(*this);
+	cal.cmat = this->cmat.clone();
+	cal.dvec = this->dvec.clone();
+	cal.invalidateProjErrStats();
+	cal.logFilename = ""; // copies do not log
+	cal.calib_excluded.assign(this->calib_imgPoints.size(), false);
+	for (int k = 0; k < (int) heldOut.size(); k++)
+		cal.calib_excluded[heldOut[k]] = true;
+	cal.calibrate(2, flag);
+	if (isnan(cal.calib_rms))
+		return -1;
+	for (int k = 0; k < (int) heldOut.size(); k++) {
+		int i = heldOut[k];
+		cv::Mat rvec, tvec;
+		vector<cv::Point2f> prjPoints;
+		cv::solvePnP(this->calib_objPoints[i], this->calib_imgPoints[i], cal.cmat, cal.dvec, rvec, tvec);
+		cv::projectPoints(this->calib_objPoints[i], rvec, tvec, cal.cmat, cal.dvec, prjPoints);
+		for (int j = 0; j < (int) prjPoints.size(); j++) {
+			cv::Point2f d = prjPoints[j] - this->calib_imgPoints[i][j];
+			sumSq += d.x * d.x + d.y * d.y;
+		}
+		nPoint += (int) prjPoints.size();
+	}
+	return 0;
+}
+
+int IntrinsicCalibrator::calibrateSweep(const vector<int> & flags, string candFilePrefix, int nFold)
+{
+	int nCand = (int) flags.size();
+	if (nCand <= 0) {
+		cerr << "IntrinsicCalibrator::calibrateSweep(): No flags are given.\n";
+		return -1;
+	}
+	// folds of cross validation (photos are assigned to folds in turn)
+	vector<int> views;
+	for (int i = 0; i < (int) this->calib_imgPoints.size(); i++)
+		if (this->isValidCalibPhoto(i))
+			views.push_back(i);
+	nFold = std::min(nFold, (int) views.size());
+	if (nFold < 3) {
+		cerr << "IntrinsicCalibrator::calibrateSweep(): Too few photos for cross validation. "
+			"Candidates are compared by rms.\n";
+		nFold = 0;
+	}
+	vector<vector<int> > folds(nFold);
+	for (int k = 0; k < (int) views.size() && nFold > 0; k++)
+		folds[k % nFold].push_back(views[k]);
+
+	// candidates are copies of this calibrator. cv::Mat members are shared
+	// by copies, so parameters are cloned to make candidates independent.
+	vector<IntrinsicCalibrator> cands(nCand, *this);
+	for (int k = 0; k < nCand; k++) {
+		cands[k].cmat = this->cmat.clone();
+		cands[k].dvec = this->dvec.clone();
+		cands[k].calib_flag = flags[k];
+		cands[k].invalidateProjErrStats();
+		cands[k].logFilename = ""; // candidates do not log
+	}
+	// calibrate candidates (with all photos) and folds in parallel (cv::calibrateCamera() is single-threaded)
+	vector<double> foldSumSq(nCand * nFold, 0.0);
+	vector<int> foldNPoint(nCand * nFold, 0), foldRet(nCand * nFold, 0);
+	int nTask = nCand * (nFold + 1);
+	double tStart = getWallTime();
+#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < nTask; t++) {
+		int k = t / (nFold + 1), f = t % (nFold + 1);
+		if (f == nFold)
+			cands[k].calibrate(2, flags[k]);
+		else
+			foldRet[k * nFold + f] = this->heldOutErrors(flags[k], folds[f],
+				foldSumSq[k * nFold + f], foldNPoint[k * nFold + f]);
+	}
+	double tElapsed = getWallTime() - tStart;
+	vector<double> heldOutRms(nCand, nan(""));
+	for (int k = 0; k < nCand && nFold > 0; k++) {
+		double sumSq = 0.0;
+		int nPoint = 0;
+		bool ok = true;
+		for (int f = 0; f < nFold; f++) {
+			ok = ok && foldRet[k * nFold + f] == 0;
+			sumSq += foldSumSq[k * nFold + f];
+			nPoint += foldNPoint[k * nFold + f];
+		}
+		if (ok && nPoint > 0)
+			heldOutRms[k] = sqrt(sumSq / nPoint);
+	}
+
+	// compare candidates (by held-out rms, or by rms if there is no cross validation)
+	int best = -1;
+	vector<double> score(nCand);
+	printf("Calibration sweep: %d candidates calibrated (%d-fold cross validation) in %.1f sec.\n",
+		nCand, nFold, tElapsed);
+	printf("  Cand.      Rms  HeldOut   95%%Err   MaxErr  Worst photo (rms)  Flags\n");
+	for (int k = 0; k < nCand; k++) {
+		const ProjErrStats & st = cands[k].projection_error_stats();
+		int worst = -1;
+		for (int i = 0; i < (int) st.rmsView.size(); i++)
+			if (isnan(st.rmsView[i]) == false && (worst < 0 || st.rmsView[i] > st.rmsView[worst]))
+				worst = i;
+		printf("  %5d %8.4f %8.4f %8.4f %8.4f  %6d (%8.4f)  %s\n", k, cands[k].calib_rms, heldOutRms[k],
+			st.p95, st.maxErr, worst, worst >= 0 ? st.rmsView[worst] : nan(""), calibFlagsString(flags[k]).c_str());
+		score[k] = nFold > 0 ? heldOutRms[k] : cands[k].calib_rms;
+		if (isnan(cands[k].calib_rms) == false && isnan(score[k]) == false && (best < 0 || score[k] < score[best]))
+			best = k;
+	}
+	// write candidates
+	if (candFilePrefix.length() > 0) {
+		for (int k = 0; k < nCand; k++) {
+			char buf[1000];
+			snprintf(buf, 1000, "%s_cand%02d.xml", candFilePrefix.c_str(), k);
+			cands[k].writeToFsFile(string(buf));
+		}
+		printf("  Candidates are written to %s_cand*.xml\n", candFilePrefix.c_str());
+	}
+	if (best < 0) {
+		cerr << "IntrinsicCalibrator::calibrateSweep(): No candidate is calibrated.\n";
+		return -1;
+	}
+	// keep the best
+	printf("  Candidate %d (rms %.4f, held-out rms %.4f) is kept.\n", best, cands[best].calib_rms, heldOutRms[best]);
+	string theLogFilename = this->logFilename;
+	*this = cands[best];
+	this->logFilename = theLogFilename;
+	char msg[1000];
+	snprintf(msg, 1000, "Calibration sweep of %d candidates. Kept candidate %d (rms %f, held-out rms %f, flags %s).",
+		nCand, best, this->calib_rms, heldOutRms[best], calibFlagsString(flags[best]).c_str());
+	this->log(string(msg));
+	return best;
+}
+
+int IntrinsicCalibrator::calibrateIncremental(int flag, int nInit, double minImprove)
+{
+	// valid photos
+	vector<int> views;
+	for (int i = 0; i < (int) this->calib_imgPoints.size(); i++)
+		if (this->isValidCalibPhoto(i))
+			views.push_back(i);
+	int nView = (int) views.size();
+	if (nView <= 0) {
+		cerr << "IntrinsicCalibrator::calibrateIncremental(): No valid calibration photo.\n";
+		return -1;
+	}
+	if (nInit <= 0)
+		nInit = std::max(4, nView / 10);
+	if (nView <= nInit) { // too few photos to select from
+		this->calibrate(2, flag);
+		return nView;
+	}
+	if (this->imgSize.width <= 0 || this->imgSize.height <= 0)
+		this->setImageSize();
+	if (this->imgSize.width <= 0 || this->imgSize.height <= 0) {
+		cerr << "IntrinsicCalibrator::calibrateIncremental(): Image size is unknown.\n";
+		return -1;
+	}
+
+	// rough pose (board normal) and covered grid cells of each photo
+	const int nGrid = 8;
+	cv::Mat cmatGuess = cv::Mat::eye(3, 3, CV_64F);
+	cmatGuess.at<double>(0, 0) = this->imgSize.width * 0.5 / tan((39.6 / 2) / 180 * 3.1416); // same guess as calibrate()
+	cmatGuess.at<double>(1, 1) = cmatGuess.at<double>(0, 0);
+	cmatGuess.at<double>(0, 2) = (this->imgSize.width - 1) / 2.;
+	cmatGuess.at<double>(1, 2) = (this->imgSize.height - 1) / 2.;
+	vector<cv::Vec3d> normals(nView);
+	vector<vector<char> > cells(nView, vector<char>(nGrid * nGrid, 0));
+#pragma omp parallel for schedule(dynamic)
+	for (int k = 0; k < nView; k++) {
+		int i = views[k];
+		cv::Mat rvec, tvec, rmat;
+		cv::solvePnP(this->calib_objPoints[i], this->calib_imgPoints[i], cmatGuess, cv::Mat(), rvec, tvec);
+		cv::Rodrigues(rvec, rmat);
+		normals[k] = cv::Vec3d(rmat.at<double>(0, 2), rmat.at<double>(1, 2), rmat.at<double>(2, 2));
+		for (int j = 0; j < (int) this->calib_imgPoints[i].size(); j++) {
+			int gx = std::min(nGrid - 1, (int) (this->calib_imgPoints[i][j].x * nGrid / this->imgSize.width));
+			int gy = std::min(nGrid - 1, (int) (this->calib_imgPoints[i][j].y * nGrid / this->imgSize.height));
+			cells[k][gy * nGrid + gx] = 1;
+		}
+	}
+
+	// order photos greedily: each next photo adds most uncovered cells and differs most in pose
+	vector<int> order;
+	vector<char> picked(nView, 0), covered(nGrid * nGrid, 0);
+	for (int n = 0; n < nView; n++) {
+		int best = -1;
+		double bestScore = -1.0;
+		for (int k = 0; k < nView; k++) {
+			if (picked[k]) continue;
+			int nNewCell = 0;
+			for (int c = 0; c < nGrid * nGrid; c++)
+				if (cells[k][c] && covered[c] == 0) nNewCell++;
+			double minAngle = 3.1416 / 2; // angle to the closest picked pose
+			for (int m = 0; m < (int) order.size(); m++) {
+				double cosAngle = std::min(1.0, std::abs(normals[k].dot(normals[order[m]])));
+				minAngle = std::min(minAngle, acos(cosAngle));
+			}
+			// new cells (ratio) plus angle (up to 30 degrees counts)
+			double score = nNewCell * 1.0 / (nGrid * nGrid) + std::min(1.0, minAngle / (30. / 180 * 3.1416));
+			if (score > bestScore) {
+				bestScore = score;
+				best = k;
+			}
+		}
+		picked[best] = 1;
+		order.push_back(best);
+		for (int c = 0; c < nGrid * nGrid; c++)
+			if (cells[best][c]) covered[c] = 1;
+	}
+
+	// calibrate with more and more photos until it converges
+	int theCalibFlag = this->calib_flag;
+	int nBatch = std::max(2, nInit / 2);
+	int nUsed = nInit, nNoGain = 0;
+	double rmsAllPrev = nan(""), tStart = getWallTime();
+	this->calib_excluded.assign(this->calib_imgPoints.size(), true);
+	for (int n = 0; n < nInit; n++)
+		this->calib_excluded[views[order[n]]] = false;
+	printf("Incremental calibration of %d valid photos (%d initial, %d per round):\n", nView, nInit, nBatch);
+	for (int iRound = 0; ; iRound++) {
+		double t0 = getWallTime();
+		if (iRound == 0)
+			this->calibrate(2, flag);
+		else {
+			// continue from the current parameters
+			this->calib_flag = flag | cv::CALIB_USE_INTRINSIC_GUESS;
+			this->calibrate(0);
+		}
+		// photos not used get their poses with current intrinsics, so that all photos are evaluated
+		this->rvecs.resize(std::max(this->rvecs.size(), this->calib_imgPoints.size()));
+		this->tvecs.resize(std::max(this->tvecs.size(), this->calib_imgPoints.size()));
+#pragma omp parallel for schedule(dynamic)
+		for (int k = 0; k < nView; k++) {
+			int i = views[k];
+			if (this->calib_excluded[i] == false) continue;
+			cv::Mat rvec, tvec;
+			cv::solvePnP(this->calib_objPoints[i], this->calib_imgPoints[i], this->cmat, this->dvec, rvec, tvec);
+			this->rvecs[i] = cv::Vec3d(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2));
+			this->tvecs[i] = cv::Vec3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+		}
+		this->invalidateProjErrStats();
+		double rmsAll = this->projection_error_stats().rms;
+		printf("  Round %d: %d photos. Rms of used photos: %.4f. Rms of all photos: %.4f. (%.2f sec.)\n",
+			iRound, nUsed, this->calib_rms, rmsAll, getWallTime() - t0);
+		if (isnan(rmsAllPrev) == false && rmsAllPrev - rmsAll < minImprove * rmsAllPrev)
+			nNoGain++;
+		else
+			nNoGain = 0;
+		rmsAllPrev = rmsAll;
+		if (nNoGain >= 2 || nUsed >= nView)
+			break;
+		// add next batch
+		for (int n = nUsed; n < std::min(nView, nUsed + nBatch); n++)
+			this->calib_excluded[views[order[n]]] = false;
+		nUsed = std::min(nView, nUsed + nBatch);
+	}
+	this->calib_excluded.clear();
+	this->calib_flag = theCalibFlag;
+	this->projection_points_vecvec();
+	printf("Incremental calibration %s with %d of %d photos. Rms of all photos: %.4f. (%.2f sec.)\n",
+		nUsed < nView ? "converged" : "used all photos", nUsed, nView, rmsAllPrev, getWallTime() - tStart);
+	char msg[1000];
+	snprintf(msg, 1000, "Incremental calibration with %d of %d photos. Rms of all photos: %f.", nUsed, nView, rmsAllPrev);
+	this->log(string(msg));
+	return nUsed;
+}
+
+// corners finding and calibration of one camera (of calibrateTwoCameras())
+// ret is set to 0 (success) or -2 (an exception is thrown, e.g., by cv::calibrateCamera()). 
+// Exceptions are caught here as this runs in a std::thread (an uncaught one terminates the program). 
+static void calibrateOneCameraPipeline(IntrinsicCalibrator & cal, int iCam, cv::Size bSize,
+	float sqw, float sqh, int board_type, int level, int nThreads, int & nFound, int & ret)
+{
+	ret = 0;
+	try {
+		omp_set_num_threads(nThreads); // limits OpenMP regions of this thread
+		double t0 = getWallTime();
+		cal.setCalibrationBoard(board_type, bSize.width, bSize.height, sqw, sqh);
+		nFound = cal.findAllCorners(bSize, sqw, sqh, board_type, nThreads);
+		printf("Camera %d: Corners found in %d of %d photos. (%.1f sec.)\n", 
+			iCam, nFound, cal.fileSeq().num_files(), getWallTime() - t0);
+		if (nFound <= 0)
+			return;
+		t0 = getWallTime();
+		cal.calibrateByLevel(level, false); // flags of an asking level are set by caller
+		printf("Camera %d: Calibrated. (%.1f sec.)\n", iCam, getWallTime() - t0);
+	}
+	catch (const std::exception & e) {
+		cerr << "calibrateTwoCameras(): Camera " << iCam << " failed: " << e.what() << "\n";
+		ret = -2;
+	}
+}
+
+int calibrateTwoCameras(IntrinsicCalibrator & cal1, IntrinsicCalibrator & cal2,
+	cv::Size bSize, float sqw, float sqh, int board_type, int level1, int level2)
+{
+	int nFound1 = 0, nFound2 = 0, ret1 = 0, ret2 = 0;
+	int nThreadsAll = omp_get_max_threads();
+	int nThreadsEach = std::max(1, nThreadsAll / 2);
+	std::thread cam2(calibrateOneCameraPipeline, std::ref(cal2), 2, bSize, sqw, sqh, board_type,
+		level2, nThreadsEach, std::ref(nFound2), std::ref(ret2));
+	calibrateOneCameraPipeline(cal1, 1, bSize, sqw, sqh, board_type, level1, nThreadsEach, nFound1, ret1);
+	cam2.join();
+	omp_set_num_threads(nThreadsAll);
+	if (ret1 != 0 || ret2 != 0)
+		return -2;
+	if (nFound1 <= 0 || nFound2 <= 0) {
+		cerr << "calibrateTwoCameras(): Corners are not found in any photo of camera " << (nFound1 <= 0 ? 1 : 2) << ".\n";
+		return -1;
+	}
 	return 0;
 }
 
@@ -1110,11 +1626,13 @@ double IntrinsicCalibrator::validCalibrationRms(int index) const
 
 cv::Mat IntrinsicCalibrator::cameraMatrix()
 {
+	this->invalidateProjErrStats(); // the returned matrix shares data, which may be changed by caller
 	return this->cmat;
 }
 
 cv::Mat IntrinsicCalibrator::distortionVector()
 {
+	this->invalidateProjErrStats(); // the returned matrix shares data, which may be changed by caller
 	return this->dvec; 
 }
 
@@ -1132,8 +1650,15 @@ vector<vector<cv::Point2f>> IntrinsicCalibrator::projection_points_vecvec()
 {
 	// resize calib_prjPoints
 	this->calib_prjPoints.resize(this->calib_imgPoints.size());
-	// calculate project points image by image, point by point
-	for (int i = 0; i < this->calib_imgPoints.size(); i++) {
+	// calculate project points image by image (in parallel), point by point
+	int nView = (int) this->calib_imgPoints.size();
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < nView; i++) {
+		if (i >= (int) this->calib_objPoints.size() || i >= (int) this->rvecs.size() ||
+			i >= (int) this->tvecs.size() || this->calib_objPoints[i].size() == 0) {
+			this->calib_prjPoints[i].clear();
+			continue;
+		}
 		// resize points 
 		cv::Mat rvec(1, 3, CV_64FC1), tvec(1, 3, CV_64FC1);
 		rvec.at<double>(0, 0) = this->rvecs[i][0];
@@ -1154,74 +1679,42 @@ vector<vector<cv::Point2f>> IntrinsicCalibrator::projection_points_vecvec()
 
 vector<vector<double>> IntrinsicCalibrator::projection_errors_vecvec()
 {
-	// resize projection_errs
-	this->projection_errs.resize(this->calib_imgPoints.size()); 
-	// calculate error image by image, point by point
-	for (int i = 0; i < this->calib_imgPoints.size(); i++) {
-		// resize points 
-		this->projection_errs[i].resize(this->calib_imgPoints[i].size());
-		cv::Mat rvec(1, 3, CV_64FC1), tvec(1, 3, CV_64FC1);
-		rvec.at<double>(0, 0) = this->rvecs[i][0];
-		rvec.at<double>(0, 1) = this->rvecs[i][1];
-		rvec.at<double>(0, 2) = this->rvecs[i][2];
-		tvec.at<double>(0, 0) = this->tvecs[i][0];
-		tvec.at<double>(0, 1) = this->tvecs[i][1];
-		tvec.at<double>(0, 2) = this->tvecs[i][2];
-		// if it is point-based projection
-		if (this->cal_types[i] == 1 || this->cal_types[i] == 2 ||
-			this->cal_types[i] == 3 || this->cal_types[i] == 11) {
-			this->projection_errs[i] = proj_err_points(
-				this->calib_imgPoints[i], this->calib_objPoints[i],
-				this->cmat, this->dvec, rvec, tvec); 
-		} // end of if it is point based projection
-		// if it is line-based projection
-		if (this->cal_types[i] == 12) {
-			this->projection_errs[i] = proj_err_lines(
-				this->calib_imgPoints[i],
-				this->cmat, this->dvec);
-		} // end of if it is line based projection
-	}
+	this->projection_errs = this->projection_error_stats().errs;
 	return this->projection_errs;
 }
 
 vector<double> IntrinsicCalibrator::projection_errors_vec()
 {
-	vector<vector<double> > errvv = this->projection_errors_vecvec(); 
-	vector<double> errv(errvv.size(), 0.0); 
-	for (int i = 0; i < errvv.size(); i++) {
-		int count = 0; 
-		for (int j = 0; j < errvv[i].size(); j++) {
-			if (isnan(errvv[i][j]) == false) {
-				errv[i] += errvv[i][j] * errvv[i][j];
-				count++;
-			}
-		}
-		if (count > 0) {
-			errv[i] /= count;
-			errv[i] = sqrt(errv[i]);
-		} 
-	}
+	vector<double> errv = this->projection_error_stats().rmsView;
+	// photos without evaluated points are given zero
+	for (int i = 0; i < errv.size(); i++)
+		if (isnan(errv[i]))
+			errv[i] = 0.0;
 	return errv;
 }
 
 double IntrinsicCalibrator::projection_error()
 {
-	vector<vector<double> > errvv = this->projection_errors_vecvec();
-	double err = 0; 
-	int count = 0;
-	for (int i = 0; i < errvv.size(); i++) {
-		for (int j = 0; j < errvv[i].size(); j++) {
-			if (isnan(errvv[i][j]) == false) {
-				err += errvv[i][j] * errvv[i][j];
-				count++;
-			}
-		}
-	}
-	if (count > 0) {
-		err /= count;
-		err = sqrt(err);
+	const ProjErrStats & errStats = this->projection_error_stats();
+	if (errStats.nPoint <= 0)
+		return 0.0;
+	return errStats.rms;
+}
+
+const ProjErrStats & IntrinsicCalibrator::projection_error_stats()
+{
+	// recalculate only if data changed (see invalidateProjErrStats())
+	if (this->projErrStatsCached == false) {
+		this->projErrStats = proj_err_all(this->calib_imgPoints, this->calib_objPoints,
+			this->cal_types, this->cmat, this->dvec, this->rvecs, this->tvecs);
+		this->projErrStatsCached = true;
 	}
-	return err; 
+	return this->projErrStats;
+}
+
+void IntrinsicCalibrator::invalidateProjErrStats()
+{
+	this->projErrStatsCached = false;
 }
 
 int IntrinsicCalibrator::writeIntrinsicParamteresToFile(string filename) const
@@ -1268,6 +1761,7 @@ int IntrinsicCalibrator::writeIntrinsicParamteresToFile(string filename) const
 
 int IntrinsicCalibrator::readIntrinsicParamteresToFile(string fullpathfile)
 {
+	this->invalidateProjErrStats();
 	ifstream ifile(fullpathfile);
 	if (ifile.is_open() == false)
 		return -1;
@@ -1430,6 +1924,7 @@ int IntrinsicCalibrator::writeToFsFile(string filename) const
 
 int IntrinsicCalibrator::readFromFsFile(string fullPathSetting)
 {
+	this->invalidateProjErrStats();
 	FileStorage ifs(fullPathSetting, FileStorage::Mode::READ);
 	if (ifs.isOpened() == false)
 		return -1;
@@ -1526,20 +2021,10 @@ FileSeq IntrinsicCalibrator::getFileSeq() const
 	return this->imsq;
 }
 
-int IntrinsicCalibrator::log(std::string msg) const
+int IntrinsicCalibrator::log(std::string msg, int level) const
 {
-	if (this->imsq.directory().length() <= 1) return -1;
-	ofstream logFile(this->imsq.directory() + this->logFilename, std::ios_base::app);
-	if (logFile.is_open()) {
-		std::time_t t = std::time(0);
-		std::tm* now = std::localtime(&t);
-		char logTime[100];
-		snprintf(logTime, 100, " (%4d-%02d-%02d %02d:%02d:%02d)",
-			now->tm_year + 1900, now->tm_mon + 1, now->tm_mday,
-			now->tm_hour, now->tm_min, now->tm_sec);
-		logFile << msg << logTime << endl;
-		logFile.close();
-	}
+	if (this->imsq.directory().length() <= 1 || this->logFilename.length() <= 0) return -1;
+	AsyncLog::instance().write(this->imsq.directory() + this->logFilename, msg, level);
 	return 0;
 }
 
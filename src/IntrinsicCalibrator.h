@@ -9,6 +9,7 @@ using namespace std;
 using namespace cv;
 
 #include "FileSeq.h"
+#include "CornersCache.h"
 //#include "FileSequence.h"
 
 #define ICAL_CORNERS_FOUND 1
@@ -16,15 +17,46 @@ using namespace cv;
 #define ICAL_CORNERS_UNKNOWN 0
 
 vector<double> proj_err_points(
-	const vector<cv::Point2f> imgPoints,
-	const vector<cv::Point3f> objPoints,
+	const vector<cv::Point2f> & imgPoints,
+	const vector<cv::Point3f> & objPoints,
 	const cv::Mat cmat, const cv::Mat dvec,
 	const cv::Mat rvec, const cv::Mat tvec);
 
 vector<double> proj_err_lines(
-	const vector<cv::Point2f> imgPoints,
+	const vector<cv::Point2f> & imgPoints,
 	const cv::Mat cmat, const cv::Mat dvec);
 
+//! Projection error statistics of all photos (unit: pixel)
+struct ProjErrStats
+{
+	vector<vector<double> > errs; // errs[iimg][ipoint] is error of ipoint of iimg-th photo (nan if not evaluated)
+	vector<double> rmsView;       // rms of each photo (nan if the photo has no evaluated point)
+	vector<double> maxView;       // max of each photo (nan if the photo has no evaluated point)
+	int nPoint;                   // number of evaluated points (of all photos)
+	double rms, p50, p90, p95, maxErr; // over all evaluated points (nan if nPoint is 0)
+};
+
+//! proj_err_all() calculates projection errors of all photos at once (photos in parallel)
+/*!
+\details Point-based photos (calTypes 1, 2, 3, 11) are evaluated by projecting objPoints
+with rvecs/tvecs, line-based photos (calTypes 12) by proj_err_lines(). Other photos, or
+photos without valid rvec/tvec or object points, are not evaluated.
+\param imgPoints image points of each photo
+\param objPoints object points of each photo
+\param calTypes calibration type of each photo
+\param cmat camera matrix
+\param dvec distortion vector
+\param rvecs r-vec of each photo
+\param tvecs t-vec of each photo
+\return errors of each point, rms and max of each photo, and overall statistics
+*/
+ProjErrStats proj_err_all(
+	const vector<vector<cv::Point2f> > & imgPoints,
+	const vector<vector<cv::Point3f> > & objPoints,
+	const vector<int> & calTypes,
+	const cv::Mat & cmat, const cv::Mat & dvec,
+	const vector<cv::Vec3d> & rvecs, const vector<cv::Vec3d> & tvecs);
+
 /*! 
 IntrinsicCalibrator assists the procedures to carry out intrinsic 
 calibration. It needs user to provide a text file that contains 
@@ -105,6 +137,8 @@ public:
 
 	//! findCorners() tries to the calibration board corners in a photo.
 	/*!
+	\details Corners found (or not found) are recorded in a sidecar file (cornersCache.bin, see
+	CornersCache) in the directory of photos, and are read from it next time.
 	\param idx index of photo in the file sequence
 	\param bSize board size (number of points along width and height)
 	\param sqw square size along width
@@ -147,14 +181,17 @@ public:
 
 	// findAllCorners() tries to find the corners. It may take a few seconds of time.
 	/*!
+	\details Photos are searched in parallel. Results are printed and recorded in the 
+	sidecar file as findCorners(), so an interrupted search resumes where it stopped.
 	\param bSize board size(number of points along width and height)
 	\param sqw square size along width
 	\param sqh square size along height
 	\param board_type board type. 1:chessboard, 2.grid(sym), 3.grid(unsym)
-	\return 0: success. - 1 : File is not an image. - 2 : Corners cannot be found.
+	\param nThreads max number of threads (<= 0 for OpenMP default)
+	\return number of photos which corners are found
 	*/
 	int findAllCorners(cv::Size bSize, float sqw, float sqh,
-		int board_type = 1);
+		int board_type = 1, int nThreads = 0);
 
 	//! setBoardObjPoints() sets calibration board object points of a photo
 	/*!
@@ -240,8 +277,77 @@ public:
 	//! calibrateWithGivenLevel() runs intrinsic calibration considering user assigned level
 	/*!
 	 \param level flag level: level 1:fx(=fy),k1, 2:fx,fy,k1, 3:fx,fy,cx,cy,k1, 4:fx,fy,cx,cy,k1,p1,p2, 5:fx,fy,cx,cy,k1,k2,p1,p2.
+	        6: sweep of candidates (see calibrateSweep() and setSweep(). Default: levels 1 to 5),
+	           keeping the one with the lowest held-out rms.
+	        11 to 15: level 1 to 5 with incremental photo selection (see calibrateIncremental()).
+	        Otherwise: flags are asked.
+	 \param askFlags if false, a level that asks flags uses the flags set before (e.g., by
+	        setFlagByAsking()) without asking. 
+	 */
+	int calibrateByLevel(int level, bool askFlags = true);
+
+	//! calibLevelAsksFlags() returns true if calibrateByLevel() asks flags of a level (not 1-6 or 11-15)
+	static bool calibLevelAsksFlags(int level);
+
+	//! calibFlagOfLevel() returns the calibration flag of a level of calibrateByLevel()
+	/*!
+	 \param level flag level 1 to 5
+	 \return calibration flag, or -1 if level is not 1 to 5
 	 */
-	int calibrateByLevel(int level);
+	static int calibFlagOfLevel(int level);
+
+	//! calibFlagsFromString() converts a text of a candidate of sweep to a calibration flag
+	/*!
+	 \param str a level (1 to 5) and/or flag names joined by '|' or '+'. A name with '-' clears the flag.
+	   Names: FixAspect, FixPP, ZeroTang, FixFocal, FixK1 to FixK6, Rational, ThinPrism, Tilted, Guess.
+	   E.g., "5|Rational" (level 5 with rational model), "5|-FixK3" (level 5 and k3)
+	 \return calibration flag, or -1 if str is not valid
+	 */
+	static int calibFlagsFromString(string str);
+
+	//! setSweep() sets candidates and output files of the sweep of calibrateByLevel(6)
+	/*!
+	 \param candidates candidates separated by ',' (see calibFlagsFromString()),
+	   e.g., "3,4,5,5|Rational,5|-FixK3". Empty for levels 1 to 5.
+	 \param candFilePrefix prefix of candidate files (see calibrateSweep()).
+	   Empty for "calibSweep" in the directory of calibration photos.
+	 \return number of candidates, or -1 if candidates are not valid (not changed)
+	 */
+	int setSweep(string candidates, string candFilePrefix = "");
+
+	//! calibrateSweep() calibrates with each of a set of flags in parallel and keeps the best
+	/*!
+	 \details Each flag set is calibrated (calibrate(2, flag)) by a copy of this calibrator on
+	   the already-found corners. As rms of calibrated photos always decreases with more
+	   parameters, candidates are compared by held-out rms (cross validation): photos are
+	   split into nFold folds, each fold is calibrated without its photos, and the photos of
+	   the fold are evaluated (poses by solvePnP) with the intrinsics of the others. All
+	   calibrations run in parallel. Rms, held-out rms and projection errors of each candidate
+	   are printed, and the candidate with the lowest held-out rms replaces this calibrator.
+	   With fewer than 3 valid photos, candidates are compared by rms.
+	 \param flags calibration flags of candidates
+	 \param candFilePrefix if not empty, each candidate is written by writeToFsFile() to
+	   candFilePrefix + "_cand%02d.xml" (index of candidate)
+	 \param nFold number of folds of cross validation (at most number of valid photos)
+	 \return index of the best candidate, or -1 if no candidate is calibrated
+	 */
+	int calibrateSweep(const vector<int> & flags, string candFilePrefix = "", int nFold = 5);
+
+	//! calibrateIncremental() calibrates with a subset of photos, adding photos only while they help
+	/*!
+	 \details Valid photos are ordered greedily by corner coverage (cells of an 8x8 image grid
+	   that are not covered yet) and pose diversity (angle between board normals, from rough
+	   poses by solvePnP with a guessed camera matrix). Calibration starts from the first nInit
+	   photos, and the next photos are added in batches. After each round, all valid photos
+	   (not only the used ones) are evaluated, photos not used get rvec/tvec by solvePnP. It
+	   stops when the rms of all photos improves less than minImprove (ratio) in two rounds
+	   in a row, or all photos are used. Progress of each round is printed.
+	 \param flag calibration flag (as calibrate(2, flag))
+	 \param nInit number of initial photos (<= 0 for auto: 10% of photos, at least 4)
+	 \param minImprove minimum ratio of improvement of rms to continue adding photos
+	 \return number of photos used in calibration, or -1 if failed
+	 */
+	int calibrateIncremental(int flag, int nInit = 0, double minImprove = 0.01);
 
 
 	// numValidPhotos() returns the number of valid photos.
@@ -326,6 +432,16 @@ public:
 	*/
 	double projection_error();
 
+	//! projection_error_stats() returns projection errors of each point, each photo
+	// and overall statistics (rms, percentiles, max), calculated in one pass
+	/*!
+	\details The result is cached. Member functions which change parameters (cmat, dvec,
+	rvecs, tvecs), points or calibration types (including non-const accessors of them)
+	invalidate the cache, and it is recalculated at the next call.
+	\return reference to the cached statistics (valid until next call)
+	*/
+	const ProjErrStats & projection_error_stats();
+
 	// writeIntrinsicParametersToFile() writes intrinsic parameters to a file. 
 	// Output parameters are fx,fy,cx,cy,k1,k2,p1,p2,k3,k4,k5,k6
 	// Input: 
@@ -363,10 +479,11 @@ public:
 	// get FileSequence
 	FileSeq getFileSeq() const;
 
-	//! Writes string to log file
+	//! Writes string to log file (buffered, written by a background thread, see AsyncLog)
 	/*!
+	\param level ALOG_DEBUG, ALOG_INFO, ALOG_WARN, or ALOG_ERROR (defined in AsyncLog.h)
 	*/
-	int log(std::string) const;
+	int log(std::string, int level = ALOG_INFO) const;
 
 	//! Writes a matlab script for visualization
 	//! Runs a sample program
@@ -375,12 +492,37 @@ public:
 	int writeToMscript(std::string) const;
 
 private:
+	//! Returns true if photo i is for typical calibration (cal_types 1, 2, 3, 11) and its points are valid
+	bool isValidCalibPhoto(int i) const;
+
+	//! Marks the cache of projection_error_stats() as out of date (called by functions changing its data)
+	void invalidateProjErrStats();
+
+	//! Calibrates a copy of this calibrator (calibrate(2, flag)) without photos heldOut, and
+	//! adds squared projection errors of photos heldOut (poses by solvePnP) to sumSq and nPoint
+	int heldOutErrors(int flag, const vector<int> & heldOut, double & sumSq, int & nPoint) const;
+
+	//! Returns full path of corners sidecar file (in the directory of photos)
+	std::string cornersCacheFile() const;
+
+	//! Finds corners of photos (in parallel, through the sidecar file), returns number of photos found
+	int findCornersOfPhotos(const vector<int> & idxs, cv::Size bSize, float sqw, float sqh,
+		int board_type, int nThreads, bool printResult);
+
+	//! Sets found corners (or failure) of photo idx to points, object points and cal_types
+	int setFoundCorners(int idx, const CornersCache::Entry & e, bool found, float sqw, float sqh, int board_type);
+
 	FileSeq imsq; // File sequence of calibration photos 
 	int n_calib_imgs;    // number of valid calibration photos (images) 
 	int calib_flag;
 	vector<int> cal_types; // 0:not assigned. 1:chessboard. 2:grid(sym). 3:grid(unsym). 11:user defined points. 12:3-point straight lines
 	double calib_rms;
 	vector<vector<double> > projection_errs; // unit: pixel
+	ProjErrStats projErrStats;                // cache of projection_error_stats()
+	bool projErrStatsCached;                  // false if projErrStats has to be recalculated
+	vector<bool> calib_excluded; // photos excluded by calibrate() (only during calibrateIncremental() and calibrateSweep())
+	vector<int> sweep_flags;     // candidates of calibrateByLevel(6) (empty for levels 1 to 5)
+	string sweep_prefix;         // prefix of candidate files of calibrateByLevel(6)
 	cv::Mat cmat; // cmat is the calibrated camera matrix (3x3).
 	cv::Mat dvec; // dvec is the calibrated distortion coefficients. (1x4, 1x5, 1x8, or 1x12)
 	vector<cv::Vec3d> rvecs; // r-vec of each photo. (only valid for cal_types[i] == 1, 2, 3, 11)
@@ -401,6 +543,24 @@ private:
 	std::string logFilename;
 };
 
-
-
-
+//! calibrateTwoCameras() runs corners finding and calibration (calibrateByLevel()) of two
+// cameras concurrently. 
+/*!
+\details The two cameras are independent until stereo (or extrinsic) calibration, so the
+camera 2 pipeline runs in another thread. Each pipeline is limited to half of OpenMP threads.
+Nothing is asked through console. If a level asks for flags (see calibLevelAsksFlags()),
+flags must be set before (e.g., by setFlagByAsking()), so that user is asked in the order of
+inputs of each camera. Calibrators must have file sequences set.
+\param cal1 calibrator of camera 1
+\param cal2 calibrator of camera 2
+\param bSize board size (number of points along width and height)
+\param sqw square size along width
+\param sqh square size along height
+\param board_type board type. 1:chessboard, 2.grid(sym), 3.grid(unsym)
+\param level1 calibration level of camera 1 (see calibrateByLevel())
+\param level2 calibration level of camera 2 (see calibrateByLevel())
+\return 0: success. -1: corners are not found in any photo of a camera. 
+-2: corners finding or calibration of a camera failed (exception, e.g., too few points per photo)
+*/
+int calibrateTwoCameras(IntrinsicCalibrator & cal1, IntrinsicCalibrator & cal2,
+	cv::Size bSize, float sqw, float sqh, int board_type, int level1, int level2);
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+#include "MotionPredictor.h"
+
+using namespace std;
+
+// extrapolates from history (h[0] is the latest)
+static cv::Point2f extrapolate(const vector<cv::Point2f> & h, int type)
+{
+	if (h.size() == 0)
+		return cv::Point2f(std::nanf(""), std::nanf(""));
+	if (h.size() == 1)
+		return h[0];
+	if (h.size() == 2 || type == MOTION_PREDICT_CONST_VEL)
+		return 2.f * h[0] - h[1];
+	// 2nd order (constant acceleration) extrapolation
+	return 3.f * h[0] - 3.f * h[1] + h[2];
+}
+
+MotionPredictor::MotionPredictor()
+{
+	this->predType = MOTION_PREDICT_CONST_ACC;
+	this->kfProcessNoise = 0.5f;
+	this->kfMeasurementNoise = 0.1f;
+}
+
+int MotionPredictor::init(int nPoint, int type, float processNoise, float measurementNoise)
+{
+	if (nPoint < 0 || type < MOTION_PREDICT_CONST_VEL || type > MOTION_PREDICT_KALMAN) {
+		cerr << "MotionPredictor::init(): Invalid number of points (" << nPoint
+			<< ") or predictor type (" << type << ").\n";
+		return -1;
+	}
+	this->predType = type;
+	this->kfProcessNoise = processNoise;
+	this->kfMeasurementNoise = measurementNoise;
+	this->hist.assign(nPoint, vector<cv::Point2f>());
+	this->nUpdates.assign(nPoint, 0);
+	this->errMeanSq.assign(nPoint, -1.f);
+	this->kfs.clear();
+	if (type == MOTION_PREDICT_KALMAN)
+		this->kfs.resize(nPoint);
+	return 0;
+}
+
+int MotionPredictor::update(int iPoint, const cv::Point2f & measured)
+{
+	if (iPoint < 0 || iPoint >= (int) this->hist.size())
+		return -1;
+	if (std::isnan(measured.x) || std::isnan(measured.y))
+		return -2;
+
+	if (this->predType == MOTION_PREDICT_KALMAN) {
+		cv::KalmanFilter & kf = this->kfs[iPoint];
+		float q2 = this->kfProcessNoise * this->kfProcessNoise;
+		float r2 = this->kfMeasurementNoise * this->kfMeasurementNoise;
+		if (this->nUpdates[iPoint] == 0) {
+			// constant velocity model (x, y, vx, vy), time step is one step
+			kf.init(4, 2, 0, CV_32F);
+			kf.transitionMatrix = (cv::Mat_<float>(4, 4) <<
+				1, 0, 1, 0,
+				0, 1, 0, 1,
+				0, 0, 1, 0,
+				0, 0, 0, 1);
+			kf.measurementMatrix = (cv::Mat_<float>(2, 4) <<
+				1, 0, 0, 0,
+				0, 1, 0, 0);
+			// process noise of piecewise constant acceleration
+			kf.processNoiseCov = (cv::Mat_<float>(4, 4) <<
+				.25f, 0.f, .5f, 0.f,
+				0.f, .25f, 0.f, .5f,
+				.5f, 0.f, 1.f, 0.f,
+				0.f, .5f, 0.f, 1.f);
+			kf.processNoiseCov *= q2;
+			kf.measurementNoiseCov = r2 * cv::Mat::eye(2, 2, CV_32F);
+			kf.statePost = (cv::Mat_<float>(4, 1) << measured.x, measured.y, 0.f, 0.f);
+			// velocity is unknown at the beginning
+			kf.errorCovPost = (cv::Mat_<float>(4, 4) <<
+				r2, 0, 0, 0,
+				0, r2, 0, 0,
+				0, 0, 1e4f, 0,
+				0, 0, 0, 1e4f);
+		}
+		else {
+			kf.predict();
+			kf.correct(cv::Mat(cv::Point2f(measured)));
+		}
+	}
+	else {
+		// running mean square of prediction error
+		if (this->nUpdates[iPoint] > 0) {
+			cv::Point2f e = measured - extrapolate(this->hist[iPoint], this->predType);
+			float e2 = e.x * e.x + e.y * e.y;
+			if (this->errMeanSq[iPoint] < 0.f)
+				this->errMeanSq[iPoint] = e2;
+			else
+				this->errMeanSq[iPoint] = 0.7f * this->errMeanSq[iPoint] + 0.3f * e2;
+		}
+	}
+
+	// history
+	vector<cv::Point2f> & h = this->hist[iPoint];
+	h.insert(h.begin(), measured);
+	if (h.size() > 3)
+		h.resize(3);
+	this->nUpdates[iPoint]++;
+	return 0;
+}
+
+cv::Point2f MotionPredictor::predict(int iPoint, float & uncertainty) const
+{
+	uncertainty = -1.f;
+	if (iPoint < 0 || iPoint >= (int) this->hist.size() || this->nUpdates[iPoint] == 0)
+		return cv::Point2f(std::nanf(""), std::nanf(""));
+
+	if (this->predType == MOTION_PREDICT_KALMAN) {
+		const cv::KalmanFilter & kf = this->kfs[iPoint];
+		cv::Mat x = kf.transitionMatrix * kf.statePost;
+		cv::Mat P = kf.transitionMatrix * kf.errorCovPost * kf.transitionMatrix.t() + kf.processNoiseCov;
+		// innovation covariance (expected difference between prediction and measurement)
+		cv::Mat S = kf.measurementMatrix * P * kf.measurementMatrix.t() + kf.measurementNoiseCov;
+		uncertainty = sqrt(std::max(S.at<float>(0, 0), S.at<float>(1, 1)));
+		return cv::Point2f(x.at<float>(0, 0), x.at<float>(1, 0));
+	}
+
+	if (this->errMeanSq[iPoint] >= 0.f)
+		uncertainty = sqrt(this->errMeanSq[iPoint]);
+	return extrapolate(this->hist[iPoint], this->predType);
+}
+
+int MotionPredictor::numUpdates(int iPoint) const
+{
+	if (iPoint < 0 || iPoint >= (int) this->nUpdates.size())
+		return 0;
+	return this->nUpdates[iPoint];
+}
+
+int MotionPredictor::type() const
+{
+	return this->predType;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#define MOTION_PREDICT_CONST_VEL 1
+#define MOTION_PREDICT_CONST_ACC 2
+#define MOTION_PREDICT_KALMAN    3
+
+// MotionPredictor predicts the image position of each point of the next step
+// according to the positions measured (tracked) in previous steps. It also
+// gives the uncertainty of each prediction, so that trackers can shrink the
+// search window when the prediction is confident.
+//
+// MotionPredictor pred;
+// pred.init(nPoint, MOTION_PREDICT_KALMAN);
+// for each step:
+//   for each point:
+//     float unc;
+//     cv::Point2f guess = pred.predict(iPoint, unc); // unc < 0 if not known yet
+//     ... track the point by guess (and a window according to unc) ...
+//     pred.update(iPoint, trackedPoint);
+
+class MotionPredictor
+{
+public:
+	MotionPredictor();
+
+	//! Initializes the predictor
+	/*!
+	\param nPoint number of points
+	\param type MOTION_PREDICT_CONST_VEL, MOTION_PREDICT_CONST_ACC, or MOTION_PREDICT_KALMAN
+	\param processNoise (Kalman only) standard deviation of acceleration (pixel/step^2)
+	\param measurementNoise (Kalman only) standard deviation of tracked position (pixel)
+	\return 0: success. -1: invalid arguments.
+	*/
+	int init(int nPoint, int type = MOTION_PREDICT_CONST_ACC,
+		float processNoise = 0.5f, float measurementNoise = 0.1f);
+
+	//! Updates the predictor by the measured (tracked) position of a point
+	/*!
+	\details update() has to be called once per step for each point, in step order.
+	Invalid (nan) positions are ignored.
+	\param iPoint index of point
+	\param measured measured position of the point of this step
+	\return 0: success. -1: invalid index. -2: invalid position (ignored).
+	*/
+	int update(int iPoint, const cv::Point2f & measured);
+
+	//! Predicts the position of a point of the next step
+	/*!
+	\param iPoint index of point
+	\param uncertainty output uncertainty (standard deviation, in pixel) of the
+	prediction. Negative if it is not known yet (not enough history).
+	\return predicted position. (nan, nan) if no history at all.
+	*/
+	cv::Point2f predict(int iPoint, float & uncertainty) const;
+
+	//! Returns the number of valid updates of a point
+	int numUpdates(int iPoint) const;
+
+	//! Returns the predictor type
+	int type() const;
+
+private:
+	int predType;
+	float kfProcessNoise, kfMeasurementNoise;
+	std::vector<std::vector<cv::Point2f> > hist; // hist[iPoint][0] is the latest measured position (at most 3)
+	std::vector<int> nUpdates;                   // number of valid updates of each point
+	std::vector<float> errMeanSq;                // running mean square of prediction errors (pixel^2), <0 for unknown
+	std::vector<cv::KalmanFilter> kfs;           // Kalman filters, state: x, y, vx, vy
+};
@@ -0,0 +1,266 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include "PerfTrace.h"
+
+using namespace std;
+
+struct PerfEvent {
+	const char * name;
+	long long ts;      // start (us)
+	long long dur;     // duration (us). Not used by counters.
+	int point;         // point index (-1 if not per-point)
+	double value;      // counter value
+	char type;         // 'X': complete event (scope), 'C': counter
+};
+
+// events of a thread (a ring of at most perfMaxEvents events; next is the
+// slot to overwrite once it is full). Buffers are registered once per thread
+// and never freed (a thread may end before export), so the hot path takes
+// no lock.
+struct PerfThreadBuf {
+	int tid;
+	vector<PerfEvent> events;
+	size_t next;
+	long long nOverwritten;
+};
+
+static std::atomic<bool> perfEnabled(false);
+static std::mutex perfMutex;
+static vector<PerfThreadBuf *> perfBufs;
+static thread_local PerfThreadBuf * perfThisBuf = NULL;
+static std::atomic<int> perfMaxEvents(1 << 18);
+static string perfExitFname;
+static const long long perfT0 = std::chrono::duration_cast<std::chrono::microseconds>(
+	std::chrono::steady_clock::now().time_since_epoch()).count();
+
+static PerfThreadBuf * perfBuf()
+{
+	if (perfThisBuf == NULL) {
+		std::lock_guard<std::mutex> lock(perfMutex);
+		perfThisBuf = new PerfThreadBuf;
+		perfThisBuf->tid = (int)perfBufs.size();
+		perfThisBuf->events.reserve(std::min(4096, (int) perfMaxEvents));
+		perfThisBuf->next = 0;
+		perfThisBuf->nOverwritten = 0;
+		perfBufs.push_back(perfThisBuf);
+	}
+	return perfThisBuf;
+}
+
+static void perfPush(const PerfEvent & e)
+{
+	PerfThreadBuf * b = perfBuf();
+	if (b->events.size() < (size_t) perfMaxEvents) {
+		b->events.push_back(e);
+		return;
+	}
+	// full: overwrite the oldest event
+	if (b->next >= b->events.size()) b->next = 0;
+	b->events[b->next++] = e;
+	b->nOverwritten++;
+}
+
+// i-th oldest event of a thread
+static const PerfEvent & perfEventAt(const PerfThreadBuf * b, size_t i)
+{
+	if (b->nOverwritten <= 0)
+		return b->events[i];
+	return b->events[(b->next + i) % b->events.size()];
+}
+
+static void perfWriteAtExit()
+{
+	if (perfExitFname.length() <= 0) return;
+	PerfTrace::writeChromeTrace(perfExitFname);
+	PerfTrace::writeSummary(perfExitFname + "_summary.txt");
+}
+
+void PerfTrace::enable(bool on)
+{
+	perfEnabled = on;
+}
+
+void PerfTrace::setMaxEventsPerThread(int maxEvents)
+{
+	perfMaxEvents = std::max(maxEvents, 1);
+}
+
+bool PerfTrace::enabled()
+{
+	return perfEnabled.load(std::memory_order_relaxed);
+}
+
+long long PerfTrace::nowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() - perfT0;
+}
+
+void PerfTrace::record(const char * name, long long startUs, long long durUs, int point)
+{
+	if (enabled() == false) return;
+	PerfEvent e;
+	e.name = name; e.ts = startUs; e.dur = durUs; e.point = point; e.value = 0.0; e.type = 'X';
+	perfPush(e);
+}
+
+void PerfTrace::count(const char * name, double value)
+{
+	if (enabled() == false) return;
+	PerfEvent e;
+	e.name = name; e.ts = nowUs(); e.dur = 0; e.point = -1; e.value = value; e.type = 'C';
+	perfPush(e);
+}
+
+void PerfTrace::clear()
+{
+	// Should be called when no instrumented code is running.
+	std::lock_guard<std::mutex> lock(perfMutex);
+	for (size_t i = 0; i < perfBufs.size(); i++) {
+		perfBufs[i]->events.clear();
+		perfBufs[i]->next = 0;
+		perfBufs[i]->nOverwritten = 0;
+	}
+}
+
+static string perfJsonEscape(const char * s)
+{
+	string r;
+	for (; s != NULL && *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') r += '\\';
+		r += *s;
+	}
+	return r;
+}
+
+int PerfTrace::writeChromeTrace(const std::string & fname)
+{
+	ofstream ofs(fname);
+	if (ofs.is_open() == false) {
+		cerr << "PerfTrace::writeChromeTrace(): Cannot write " << fname << endl;
+		return -1;
+	}
+	std::lock_guard<std::mutex> lock(perfMutex);
+	ofs << "{\"traceEvents\":[\n";
+	bool first = true;
+	char buf[512];
+	for (size_t i = 0; i < perfBufs.size(); i++) {
+		const PerfThreadBuf * b = perfBufs[i];
+		for (size_t j = 0; j < b->events.size(); j++) {
+			const PerfEvent & e = perfEventAt(b, j);
+			string name = perfJsonEscape(e.name);
+			if (e.type == 'X') {
+				if (e.point >= 0)
+					snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":0,\"tid\":%d,\"args\":{\"point\":%d}}",
+						name.c_str(), e.ts, e.dur, b->tid, e.point);
+				else
+					snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":0,\"tid\":%d}",
+						name.c_str(), e.ts, e.dur, b->tid);
+			}
+			else
+				snprintf(buf, sizeof(buf), "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%lld,\"pid\":0,\"tid\":%d,\"args\":{\"value\":%.17g}}",
+					name.c_str(), e.ts, b->tid, e.value);
+			ofs << (first ? "" : ",\n") << buf;
+			first = false;
+		}
+	}
+	ofs << "\n]}\n";
+	return 0;
+}
+
+// nearest-rank percentile of sorted data
+static double perfPercentile(const vector<double> & sorted, double p)
+{
+	if (sorted.size() == 0) return 0.0;
+	int k = (int)(p / 100. * sorted.size() + .999999) - 1;
+	k = std::max(0, std::min(k, (int)sorted.size() - 1));
+	return sorted[k];
+}
+
+static void perfPrintRow(ostream & os, const string & label, vector<double> & durMs)
+{
+	std::sort(durMs.begin(), durMs.end());
+	double total = 0.0;
+	for (size_t i = 0; i < durMs.size(); i++) total += durMs[i];
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%-32s %8d %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+		label.c_str(), (int)durMs.size(), total, total / std::max((int)durMs.size(), 1),
+		perfPercentile(durMs, 50.), perfPercentile(durMs, 90.), perfPercentile(durMs, 99.), durMs.back());
+	os << buf;
+}
+
+int PerfTrace::writeSummary(const std::string & fname)
+{
+	ofstream ofs;
+	if (fname.length() > 0) {
+		ofs.open(fname);
+		if (ofs.is_open() == false) {
+			cerr << "PerfTrace::writeSummary(): Cannot write " << fname << endl;
+			return -1;
+		}
+	}
+	ostream & os = (fname.length() > 0) ? ofs : cout;
+
+	// durations (ms) per stage and per (stage, point)
+	map<string, vector<double> > perStage;
+	map<pair<string, int>, vector<double> > perPoint;
+	map<string, double> lastCounter;
+	long long nOverwritten = 0;
+	{
+		std::lock_guard<std::mutex> lock(perfMutex);
+		for (size_t i = 0; i < perfBufs.size(); i++) {
+			const PerfThreadBuf * b = perfBufs[i];
+			nOverwritten += b->nOverwritten;
+			for (size_t j = 0; j < b->events.size(); j++) {
+				const PerfEvent & e = perfEventAt(b, j);
+				if (e.type == 'C') {
+					lastCounter[e.name] = e.value;
+					continue;
+				}
+				perStage[e.name].push_back(e.dur * 1e-3);
+				if (e.point >= 0)
+					perPoint[make_pair(string(e.name), e.point)].push_back(e.dur * 1e-3);
+			}
+		}
+	}
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%-32s %8s %12s %10s %10s %10s %10s %10s\n",
+		"Stage", "Count", "Total(ms)", "Mean(ms)", "P50(ms)", "P90(ms)", "P99(ms)", "Max(ms)");
+	if (nOverwritten > 0)
+		os << "(" << nOverwritten << " oldest events were overwritten and are not counted. See PerfTrace::setMaxEventsPerThread().)\n";
+	os << "Per stage:\n" << buf;
+	for (map<string, vector<double> >::iterator it = perStage.begin(); it != perStage.end(); ++it)
+		perfPrintRow(os, it->first, it->second);
+	if (perPoint.size() > 0) {
+		os << "\nPer stage and point:\n" << buf;
+		for (map<pair<string, int>, vector<double> >::iterator it = perPoint.begin(); it != perPoint.end(); ++it)
+			perfPrintRow(os, it->first.first + " #" + to_string(it->first.second), it->second);
+	}
+	if (lastCounter.size() > 0) {
+		os << "\nCounters (last value):\n";
+		for (map<string, double>::iterator it = lastCounter.begin(); it != lastCounter.end(); ++it)
+			os << "  " << it->first << ": " << it->second << endl;
+	}
+	return 0;
+}
+
+void PerfTrace::writeAtExit(const std::string & fname)
+{
+	static bool registered = false;
+	PerfTrace::enable(true);
+	std::lock_guard<std::mutex> lock(perfMutex);
+	perfExitFname = fname;
+	if (registered == false) {
+		std::atexit(perfWriteAtExit);
+		registered = true;
+	}
+}
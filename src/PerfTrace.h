@@ -0,0 +1,113 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// PerfTrace is a lightweight instrumentation layer: scoped timers and
+// counters recorded into per-thread ring buffers (no lock on the hot path;
+// when a buffer is full the oldest events of the thread are overwritten),
+// exported as Chrome trace-event JSON (chrome://tracing or Perfetto) and as
+// a summary of percentiles per stage and per (stage, point).
+// When tracing is disabled (default), a scope costs one branch on a global
+// flag and nothing is recorded.
+//
+// PerfTrace::enable(true);
+// ...
+// {
+//     PERF_SCOPE("tmatch");                 // times until end of scope
+//     ...
+// }
+// #pragma omp parallel for
+// for (int iPoint = 0; iPoint < n; iPoint++) {
+//     PERF_SCOPE_POINT("ecc", iPoint);      // per-point stage
+//     ...
+// }
+// PerfTrace::count("nFailed", nFailed);
+// PerfTrace::writeChromeTrace("trace.json");
+// PerfTrace::writeSummary("trace_summary.txt");
+// or, to enable recording and write both files when the program exits:
+// PerfTrace::writeAtExit("trace.json");
+
+class PerfTrace
+{
+public:
+	//! Enables or disables recording (default: disabled)
+	static void enable(bool on);
+
+	//! Returns true if recording is enabled
+	static bool enabled();
+
+	//! Sets the maximum number of events kept per thread (default: 262144, about 10 MB per thread)
+	/*!
+	\details Should be called before any event is recorded. Older events of a thread are
+	   overwritten by newer ones when its buffer is full.
+	*/
+	static void setMaxEventsPerThread(int maxEvents);
+
+	//! Returns current time in microseconds (monotonic)
+	static long long nowUs();
+
+	//! Records a complete event (called by PerfScope)
+	/*!
+	\param name stage name. Must be a string literal (or live until export).
+	\param startUs start time (from nowUs())
+	\param durUs duration in microseconds
+	\param point point index (-1 if not a per-point stage)
+	*/
+	static void record(const char * name, long long startUs, long long durUs, int point = -1);
+
+	//! Records a counter value (shown as a counter track in Chrome trace)
+	static void count(const char * name, double value);
+
+	//! Removes all recorded events (of all threads)
+	static void clear();
+
+	//! Writes all events in Chrome trace-event JSON format
+	/*!
+	\return 0: success. -1: cannot write file.
+	*/
+	static int writeChromeTrace(const std::string & fname);
+
+	//! Writes summary (count, total, mean, p50, p90, p99, max in ms) per stage and per (stage, point)
+	/*!
+	\param fname file name. If empty, prints to cout.
+	\return 0: success. -1: cannot write file.
+	*/
+	static int writeSummary(const std::string & fname = std::string(""));
+
+	//! Enables recording and writes the trace (fname) and summary (fname + "_summary.txt") at program exit
+	/*!
+	\details The files are written by a std::atexit() handler, i.e., when main() returns or
+	   exit() is called, whatever path the program takes. Calling it again only changes fname.
+	*/
+	static void writeAtExit(const std::string & fname);
+};
+
+// Scoped timer. Records an event from construction to destruction if tracing is enabled.
+class PerfScope
+{
+public:
+	PerfScope(const char * _name, int _point = -1)
+	{
+		if (PerfTrace::enabled()) {
+			name = _name;
+			point = _point;
+			start = PerfTrace::nowUs();
+		}
+		else
+			name = 0;
+	}
+	~PerfScope()
+	{
+		if (name != 0)
+			PerfTrace::record(name, start, PerfTrace::nowUs() - start, point);
+	}
+private:
+	const char * name;
+	int point;
+	long long start;
+};
+
+#define PERF_CONCAT_(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_(a, b)
+#define PERF_SCOPE(name) PerfScope PERF_CONCAT(perfScope_, __LINE__)(name)
+#define PERF_SCOPE_POINT(name, point) PerfScope PERF_CONCAT(perfScope_, __LINE__)(name, point)
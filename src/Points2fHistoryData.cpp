@@ -412,16 +412,42 @@ int Points2fHistoryData::nPoint()
 
 int Points2fHistoryData::resize(int nStep, int nPoint)
 {
-	// allocate a new Mat
-	cv::Mat tmp = cv::Mat::zeros(nStep, nPoint, CV_32FC2);
+	if (nStep == this->dat.rows && nPoint == this->dat.cols)
+		return 0;
+	// dat can be a top part of a taller buffer (rows reserved for later steps).
+	// If only the number of steps changes, move the bottom of dat within the
+	// buffer without reallocation (unless the buffer is shared with other Mats).
+	if (nPoint == this->dat.cols && nPoint > 0 && this->dat.u != NULL && this->dat.u->refcount == 1)
+	{
+		cv::Size wholeSize;
+		cv::Point ofs;
+		this->dat.locateROI(wholeSize, ofs);
+		if (ofs.x == 0 && ofs.y == 0 && wholeSize.width == nPoint && wholeSize.height >= nStep)
+		{
+			int nStepOld = this->dat.rows;
+			this->dat.adjustROI(0, nStep - nStepOld, 0, 0);
+			if (nStep > nStepOld)
+				this->dat.rowRange(nStepOld, nStep).setTo(cv::Scalar::all(0));
+			return 0;
+		}
+	}
+	// allocate a new buffer. When steps are added, reserve rows geometrically
+	// (at least double) so that appending steps one by one costs amortized O(1).
+	// Rows of a buffer are contiguous, so dat (the top rows) is still continuous.
+	int nStepReserved = nStep;
+	if (nPoint == this->dat.cols && nStep > this->dat.rows)
+		nStepReserved = std::max(nStep, std::max(2 * this->dat.rows, 16));
+	cv::Mat buf = cv::Mat::zeros(nStepReserved, nPoint, CV_32FC2);
+	cv::Mat tmp = buf.rowRange(0, nStep);
 	// copy original data to the new Mat
-	for (int i = 0; i < std::min(this->dat.rows, nStep); i++)
-		for (int j = 0; j < std::min(this->dat.cols, nPoint); j++)
-			tmp.at<cv::Point2f>(i, j) = this->dat.at<cv::Point2f>(i, j); 
+	int nStepCopy = std::min(this->dat.rows, nStep);
+	int nPointCopy = std::min(this->dat.cols, nPoint);
+	if (nStepCopy > 0 && nPointCopy > 0)
+		this->dat(cv::Rect(0, 0, nPointCopy, nStepCopy)).copyTo(tmp(cv::Rect(0, 0, nPointCopy, nStepCopy)));
 	// replace original data with the new Mat
-	tmp.copyTo(this->dat); 
+	this->dat = tmp;
 	// click memory reallocation count
-	this->memoryReallocationClick(); 
+	this->memoryReallocationClick();
 	return 0;
 }
 
@@ -465,14 +491,9 @@ cv::Mat & Points2fHistoryData::getMat()
 vector<cv::Mat> Points2fHistoryData::getVecMat()
 {
 	int nStep = this->dat.rows;
-	int nPoint = this->dat.cols;
 	vector<cv::Mat> vecmat(nStep);
 	for (int iStep = 0; iStep < nStep; iStep++)
-	{
-		vecmat[iStep] = cv::Mat(1, nPoint, CV_32FC2);
-		for (int iPoint = 0; iPoint < nPoint; iPoint++)
-			vecmat[iStep].at<cv::Point2f>(0, iPoint) = this->dat.at<cv::Point2f>(iStep, iPoint);
-	}
+		vecmat[iStep] = this->dat.row(iStep).clone();
 	return vecmat; 
 }
 
@@ -483,13 +504,30 @@ vector<vector<cv::Point2f>> Points2fHistoryData::getVecVec()
 	vector<vector<cv::Point2f> > vecvec(nStep);
 	for (int iStep = 0; iStep < nStep; iStep++) 
 	{
-		vecvec[iStep].resize(nPoint); 
-		for (int iPoint = 0; iPoint < nPoint; iPoint++)
-			vecvec[iStep][iPoint] = this->dat.at<cv::Point2f>(iStep, iPoint);
+		const cv::Point2f * row = this->dat.ptr<cv::Point2f>(iStep);
+		vecvec[iStep].assign(row, row + nPoint);
 	}
 	return vecvec;
 }
 
+HistoryView<cv::Point2f> Points2fHistoryData::stepView(int iStep)
+{
+	if (iStep < 0 || iStep >= this->dat.rows) {
+		cerr << "  Points2fHistoryData::stepView(): Step " << iStep << " is out of range (nStep: " << this->dat.rows << ")\n";
+		return HistoryView<cv::Point2f>();
+	}
+	return HistoryView<cv::Point2f>(this->dat.ptr<cv::Point2f>(iStep), this->dat.cols, sizeof(cv::Point2f));
+}
+
+HistoryView<cv::Point2f> Points2fHistoryData::pointView(int iPoint)
+{
+	if (iPoint < 0 || iPoint >= this->dat.cols) {
+		cerr << "  Points2fHistoryData::pointView(): Point " << iPoint << " is out of range (nPoint: " << this->dat.cols << ")\n";
+		return HistoryView<cv::Point2f>();
+	}
+	return HistoryView<cv::Point2f>(this->dat.ptr<cv::Point2f>(0) + iPoint, this->dat.rows, this->dat.step[0]);
+}
+
 int Points2fHistoryData::set(const cv::Mat & theDat)
 {
 	if (theDat.type() == CV_32FC2)
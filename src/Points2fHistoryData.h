@@ -2,6 +2,7 @@
 #include <opencv2/opencv.hpp>
 
 #include "IoData.h"
+#include "HistoryView.h"
 
 class Points2fHistoryData :
 	public IoData
@@ -35,13 +36,17 @@ public:
 	// get/set size
 	int nStep();
 	int nPoint(); 
-	int resize(int nStep, int nPoint); 
+	int resize(int nStep, int nPoint); // adding steps reserves rows geometrically (amortized O(1) per appended step)
 
 	// access (read)
 	cv::Point2f get(int iStep, int iPoint);
 	cv::Mat & getMat();
 	vector<cv::Mat> getVecMat(); 
 	vector<vector<cv::Point2f> > getVecVec();
+
+	// zero-copy views (valid until data is resized or set). Out of range gives an empty view.
+	HistoryView<cv::Point2f> stepView(int iStep);    // points of step iStep
+	HistoryView<cv::Point2f> pointView(int iPoint);  // history (all steps) of point iPoint
 	cv::Rect getRect(int iPoint) const; 
 
 	// access entire object
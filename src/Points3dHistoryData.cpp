@@ -343,14 +343,40 @@ int Points3dHistoryData::nPoint()
 
 int Points3dHistoryData::resize(int nStep, int nPoint)
 {
-	// allocate a new Mat
-	cv::Mat tmp = cv::Mat::zeros(nStep, nPoint, CV_64FC3);
+	if (nStep == this->dat.rows && nPoint == this->dat.cols)
+		return 0;
+	// dat can be a top part of a taller buffer (rows reserved for later steps).
+	// If only the number of steps changes, move the bottom of dat within the
+	// buffer without reallocation (unless the buffer is shared with other Mats).
+	if (nPoint == this->dat.cols && nPoint > 0 && this->dat.u != NULL && this->dat.u->refcount == 1)
+	{
+		cv::Size wholeSize;
+		cv::Point ofs;
+		this->dat.locateROI(wholeSize, ofs);
+		if (ofs.x == 0 && ofs.y == 0 && wholeSize.width == nPoint && wholeSize.height >= nStep)
+		{
+			int nStepOld = this->dat.rows;
+			this->dat.adjustROI(0, nStep - nStepOld, 0, 0);
+			if (nStep > nStepOld)
+				this->dat.rowRange(nStepOld, nStep).setTo(cv::Scalar::all(0));
+			return 0;
+		}
+	}
+	// allocate a new buffer. When steps are added, reserve rows geometrically
+	// (at least double) so that appending steps one by one costs amortized O(1).
+	// Rows of a buffer are contiguous, so dat (the top rows) is still continuous.
+	int nStepReserved = nStep;
+	if (nPoint == this->dat.cols && nStep > this->dat.rows)
+		nStepReserved = std::max(nStep, std::max(2 * this->dat.rows, 16));
+	cv::Mat buf = cv::Mat::zeros(nStepReserved, nPoint, CV_64FC3);
+	cv::Mat tmp = buf.rowRange(0, nStep);
 	// copy original data to the new Mat
-	for (int i = 0; i < std::min(this->dat.rows, nStep); i++)
-		for (int j = 0; j < std::min(this->dat.cols, nPoint); j++)
-			tmp.at<cv::Point3d>(i, j) = this->dat.at<cv::Point3d>(i, j);
+	int nStepCopy = std::min(this->dat.rows, nStep);
+	int nPointCopy = std::min(this->dat.cols, nPoint);
+	if (nStepCopy > 0 && nPointCopy > 0)
+		this->dat(cv::Rect(0, 0, nPointCopy, nStepCopy)).copyTo(tmp(cv::Rect(0, 0, nPointCopy, nStepCopy)));
 	// replace original data with the new Mat
-	tmp.copyTo(this->dat);
+	this->dat = tmp;
 	// click memory reallocation count
 	this->memoryReallocationClick();
 	return 0;
@@ -388,14 +414,9 @@ cv::Mat & Points3dHistoryData::getMat()
 vector<cv::Mat> Points3dHistoryData::getVecMat()
 {
 	int nStep = this->dat.rows;
-	int nPoint = this->dat.cols;
 	vector<cv::Mat> vecmat(nStep);
 	for (int iStep = 0; iStep < nStep; iStep++)
-	{
-		vecmat[iStep] = cv::Mat(1, nPoint, CV_64FC3);
-		for (int iPoint = 0; iPoint < nPoint; iPoint++)
-			vecmat[iStep].at<cv::Point3d>(0, iPoint) = this->dat.at<cv::Point3d>(iStep, iPoint);
-	}
+		vecmat[iStep] = this->dat.row(iStep).clone();
 	return vecmat;
 }
 
@@ -406,13 +427,30 @@ vector<vector<cv::Point3d>> Points3dHistoryData::getVecVec()
 	vector<vector<cv::Point3d> > vecvec(nStep);
 	for (int iStep = 0; iStep < nStep; iStep++)
 	{
-		vecvec[iStep].resize(nPoint);
-		for (int iPoint = 0; iPoint < nPoint; iPoint++)
-			vecvec[iStep][iPoint] = this->dat.at<cv::Point3d>(iStep, iPoint);
+		const cv::Point3d * row = this->dat.ptr<cv::Point3d>(iStep);
+		vecvec[iStep].assign(row, row + nPoint);
 	}
 	return vecvec;
 }
 
+HistoryView<cv::Point3d> Points3dHistoryData::stepView(int iStep)
+{
+	if (iStep < 0 || iStep >= this->dat.rows) {
+		cerr << "  Points3dHistoryData::stepView(): Step " << iStep << " is out of range (nStep: " << this->dat.rows << ")\n";
+		return HistoryView<cv::Point3d>();
+	}
+	return HistoryView<cv::Point3d>(this->dat.ptr<cv::Point3d>(iStep), this->dat.cols, sizeof(cv::Point3d));
+}
+
+HistoryView<cv::Point3d> Points3dHistoryData::pointView(int iPoint)
+{
+	if (iPoint < 0 || iPoint >= this->dat.cols) {
+		cerr << "  Points3dHistoryData::pointView(): Point " << iPoint << " is out of range (nPoint: " << this->dat.cols << ")\n";
+		return HistoryView<cv::Point3d>();
+	}
+	return HistoryView<cv::Point3d>(this->dat.ptr<cv::Point3d>(0) + iPoint, this->dat.rows, this->dat.step[0]);
+}
+
 int Points3dHistoryData::set(const cv::Mat & theDat)
 {
 	if (theDat.type() == CV_64FC3)
@@ -2,6 +2,7 @@
 #include <opencv2/opencv.hpp>
 
 #include "IoData.h"
+#include "HistoryView.h"
 
 class Points3dHistoryData :
 	public IoData
@@ -34,7 +35,7 @@ public:
 	// get/set size
 	int nStep();
 	int nPoint();
-	int resize(int nStep, int nPoint);
+	int resize(int nStep, int nPoint); // adding steps reserves rows geometrically (amortized O(1) per appended step)
 
 	// access (read)
 	cv::Point3d get(int iStep, int iPoint);
@@ -42,6 +43,10 @@ public:
 	vector<cv::Mat> getVecMat();
 	vector<vector<cv::Point3d> > getVecVec();
 
+	// zero-copy views (valid until data is resized or set). Out of range gives an empty view.
+	HistoryView<cv::Point3d> stepView(int iStep);    // points of step iStep
+	HistoryView<cv::Point3d> pointView(int iPoint);  // history (all steps) of point iPoint
+
 	// access entire object
 	// set theMat to this object
 	int set(int iStep, int iPoint, cv::Point3d p);
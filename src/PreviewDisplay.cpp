@@ -0,0 +1,202 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <chrono>
+#include <algorithm>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/highgui.hpp>
+#include "PreviewDisplay.h"
+
+using namespace std;
+
+static double previewNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PreviewDisplay::PreviewDisplay(int mode, std::string recordPrefix, double recordInterval)
+{
+	this->theMode = mode;
+	if (mode != PREVIEW_ASYNC && mode != PREVIEW_RECORD)
+		this->theMode = PREVIEW_OFF;
+	if (this->theMode == PREVIEW_ASYNC && hasDisplay() == false) {
+		cerr << "PreviewDisplay: No display is available. Preview is turned off.\n";
+		this->theMode = PREVIEW_OFF;
+	}
+	if (this->theMode == PREVIEW_RECORD && recordPrefix.length() <= 0) {
+		cerr << "PreviewDisplay: No file prefix for recording. Preview is turned off.\n";
+		this->theMode = PREVIEW_OFF;
+	}
+	this->recordPrefix = recordPrefix;
+	this->recordInterval = recordInterval;
+	this->maxSize = cv::Size(1280, 720);
+	this->stopping = false;
+	if (this->theMode != PREVIEW_OFF)
+		this->worker = std::thread(&PreviewDisplay::run, this);
+}
+
+PreviewDisplay::~PreviewDisplay()
+{
+	this->close();
+}
+
+int PreviewDisplay::mode() const
+{
+	return this->theMode;
+}
+
+void PreviewDisplay::setMaxSize(cv::Size maxSize)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	this->maxSize = maxSize;
+}
+
+int PreviewDisplay::show(const std::string & winname, const cv::Mat & img)
+{
+	if (this->theMode == PREVIEW_OFF || img.empty())
+		return 1;
+	std::unique_lock<std::mutex> lock(mtx);
+	if (this->stopping || this->theMode == PREVIEW_OFF)
+		return 1;
+	Window & w = this->windows[winname];
+	if (this->theMode == PREVIEW_RECORD) {
+		double t = previewNow();
+		if (w.nSubmitted > 0 && t - w.tLastRecord < this->recordInterval)
+			return 1;
+		w.tLastRecord = t;
+	}
+	// replaces the pending picture if the display thread has not taken it yet
+	// (copyTo re-uses the buffer as pictures are normally of the same size)
+	img.copyTo(w.pending);
+	w.hasPending = true;
+	w.nSubmitted++;
+	lock.unlock();
+	cvWork.notify_one();
+	return 0;
+}
+
+int PreviewDisplay::waitKey(int ms)
+{
+	if (this->theMode != PREVIEW_ASYNC)
+		return -1;
+	std::unique_lock<std::mutex> lock(mtx);
+	cvKey.wait_for(lock, std::chrono::milliseconds(std::max(ms, 1)),
+		[this] { return this->keys.size() > 0 || this->stopping; });
+	if (this->keys.size() <= 0)
+		return -1;
+	int key = this->keys[0];
+	this->keys.erase(this->keys.begin());
+	return key;
+}
+
+void PreviewDisplay::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		this->stopping = true;
+	}
+	cvWork.notify_one();
+	if (this->worker.joinable())
+		this->worker.join();
+}
+
+bool PreviewDisplay::hasDisplay()
+{
+#if defined(_WIN32) || defined(__APPLE__)
+	return true;
+#else
+	return std::getenv("DISPLAY") != NULL || std::getenv("WAYLAND_DISPLAY") != NULL;
+#endif
+}
+
+void PreviewDisplay::render(const std::string & winname, const cv::Mat & img, int count)
+{
+	cv::Mat imgShow = img;
+	cv::Size maxSize;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		maxSize = this->maxSize;
+	}
+	if (maxSize.width > 0 && maxSize.height > 0 && (img.cols > maxSize.width || img.rows > maxSize.height)) {
+		double fac = std::min(maxSize.width * 1.0 / img.cols, maxSize.height * 1.0 / img.rows);
+		cv::resize(img, imgShow, cv::Size(0, 0), fac, fac, cv::INTER_AREA);
+	}
+	if (this->theMode == PREVIEW_ASYNC) {
+		try {
+			cv::imshow(winname, imgShow);
+		}
+		catch (const cv::Exception & e) {
+			cerr << "PreviewDisplay: Cannot show window (" << e.what() << "). Preview is turned off.\n";
+			std::lock_guard<std::mutex> lock(mtx);
+			this->theMode = PREVIEW_OFF;
+		}
+	}
+	else if (this->theMode == PREVIEW_RECORD) {
+		// window name is a part of file name (characters other than letters and digits replaced by '_')
+		string name = winname;
+		for (size_t i = 0; i < name.length(); i++)
+			if (isalnum((unsigned char) name[i]) == 0) name[i] = '_';
+		char buf[100];
+		snprintf(buf, 100, "_%06d.jpg", count);
+		string fname = this->recordPrefix + "_" + name + buf;
+		if (cv::imwrite(fname, imgShow) == false)
+			cerr << "PreviewDisplay: Cannot write " << fname << endl;
+	}
+}
+
+void PreviewDisplay::run()
+{
+	bool anyShown = false; // any window is opened by this thread
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true) {
+		// wait for pictures. If windows are opened, wakes up every 30 ms to handle window events.
+		auto hasWork = [this] {
+			if (this->stopping) return true;
+			for (map<string, Window>::iterator it = this->windows.begin(); it != this->windows.end(); ++it)
+				if (it->second.hasPending) return true;
+			return false;
+		};
+		if (anyShown)
+			cvWork.wait_for(lock, std::chrono::milliseconds(30), hasWork);
+		else
+			cvWork.wait(lock, hasWork);
+		// take pending pictures (swap buffers so that show() can copy the next ones)
+		vector<pair<string, Window *> > todo;
+		for (map<string, Window>::iterator it = this->windows.begin(); it != this->windows.end(); ++it) {
+			if (it->second.hasPending == false) continue;
+			cv::swap(it->second.pending, it->second.shown);
+			it->second.hasPending = false;
+			todo.push_back(pair<string, Window *>(it->first, &it->second));
+		}
+		bool stop = this->stopping;
+		lock.unlock();
+
+		for (size_t i = 0; i < todo.size(); i++) {
+			this->render(todo[i].first, todo[i].second->shown, todo[i].second->nRendered);
+			todo[i].second->nRendered++;
+		}
+		if (this->theMode == PREVIEW_ASYNC) {
+			anyShown = anyShown || todo.size() > 0;
+			if (anyShown) {
+				int key = cv::waitKey(1);
+				if (key >= 0) {
+					std::lock_guard<std::mutex> lk(mtx);
+					this->keys.push_back(key);
+					cvKey.notify_all();
+				}
+			}
+		}
+
+		lock.lock();
+		if (stop)
+			break;
+	}
+	lock.unlock();
+	if (anyShown) {
+		for (map<string, Window>::iterator it = this->windows.begin(); it != this->windows.end(); ++it)
+			if (it->second.nRendered > 0) cv::destroyWindow(it->first);
+	}
+	cvKey.notify_all();
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <opencv2/core.hpp>
+
+#define PREVIEW_OFF    0
+#define PREVIEW_ASYNC  1
+#define PREVIEW_RECORD 2
+
+// PreviewDisplay shows (or records) pictures of a processing loop without
+// blocking the loop on rendering. show() only copies the picture into a
+// per-window buffer and returns; all imshow/waitKey/imwrite calls are made
+// by a display thread.
+//   PREVIEW_OFF:    nothing is shown (show() returns immediately).
+//   PREVIEW_ASYNC:  pictures are shown in windows by the display thread. If the
+//                   thread is still busy, the pending picture is replaced by the
+//                   newer one (frame skipping). Falls back to PREVIEW_OFF if there
+//                   is no display (e.g., headless Linux nodes).
+//   PREVIEW_RECORD: pictures are written to files (prefix_window_%06d.jpg) by the
+//                   display thread, at most one per recordInterval seconds per window.
+// Pictures larger than maxSize are resized (by the display thread).
+//
+// PreviewDisplay disp(PREVIEW_ASYNC);
+// disp.setMaxSize(cv::Size(1280, 720));
+// for (int i = 0; i < nFrame; i++) {
+//     ... process and draw imgBoxed ...
+//     disp.show("Tracked points", imgBoxed);  // does not wait for rendering
+// }
+// disp.close();  // (also called by destructor)
+
+class PreviewDisplay
+{
+public:
+	//! Creates a display (and starts the display thread unless mode is PREVIEW_OFF)
+	/*!
+	\param mode PREVIEW_OFF, PREVIEW_ASYNC, or PREVIEW_RECORD
+	\param recordPrefix file prefix of recorded pictures (PREVIEW_RECORD), e.g., "c:/test/preview"
+	\param recordInterval minimum time (sec.) between recorded pictures of a window (PREVIEW_RECORD)
+	*/
+	PreviewDisplay(int mode = PREVIEW_OFF, std::string recordPrefix = "", double recordInterval = 1.0);
+	~PreviewDisplay();
+
+	//! Returns the mode (PREVIEW_ASYNC may have fallen back to PREVIEW_OFF)
+	int mode() const;
+
+	//! Sets the maximum size of shown or recorded pictures (default 1280 x 720). Size(0, 0) means no resizing.
+	void setMaxSize(cv::Size maxSize);
+
+	//! Submits a picture to show (or record). Never waits for rendering or file writing.
+	/*!
+	\return 0: submitted. 1: skipped (mode is off, or recording interval not reached yet)
+	*/
+	int show(const std::string & winname, const cv::Mat & img);
+
+	//! Waits (at most ms milliseconds) for a key pressed in a preview window
+	/*!
+	\return key code, or -1 if no key is pressed (always -1 unless mode is PREVIEW_ASYNC)
+	*/
+	int waitKey(int ms);
+
+	//! Stops the display thread (pending pictures of PREVIEW_RECORD are written) and closes windows
+	void close();
+
+	//! Returns true if windows can be shown (false on Linux without DISPLAY or WAYLAND_DISPLAY)
+	static bool hasDisplay();
+
+private:
+	PreviewDisplay(const PreviewDisplay &) = delete;
+	PreviewDisplay & operator=(const PreviewDisplay &) = delete;
+	void run();
+	void render(const std::string & winname, const cv::Mat & img, int count);
+
+	struct Window {
+		cv::Mat pending;       // latest submitted picture (not shown yet)
+		cv::Mat shown;         // picture being rendered (buffer swapped with pending)
+		bool hasPending;
+		int nSubmitted;        // number of pictures accepted by show()
+		int nRendered;         // number of pictures shown or recorded (by the display thread)
+		double tLastRecord;    // time (sec.) of last recorded picture
+	};
+	int theMode;
+	std::string recordPrefix;
+	double recordInterval;
+	cv::Size maxSize;
+	std::map<std::string, Window> windows;
+	std::vector<int> keys;     // keys pressed in windows (not taken by waitKey yet)
+	bool stopping;
+	std::mutex mtx;
+	std::condition_variable cvWork, cvKey;
+	std::thread worker;
+};
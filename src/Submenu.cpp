@@ -79,6 +79,17 @@ int Submenu::run()
 	return 0;
 }
 
+// Runs the item of the given command once (without the menu), and returns its return value.
+// Returns -1 if no item has the command.
+int Submenu::runItem(string cmd)
+{
+	for (int i = 0; i < this->items.size(); i++)
+		if (cmd.compare(this->items[i].cmd) == 0)
+			return this->items[i].func(argc, argv);
+	cerr << preStr << "Unknown command: " << cmd << endl;
+	return -1;
+}
+
 Submenu::~Submenu()
 {
 }
@@ -32,6 +32,7 @@ public:
 	int addItem(string cmd, string description, int(*f)(int, char**));
 	int printItems();
 	int run(); 
+	int runItem(string cmd);
 	~Submenu();
 protected:
 	vector<SubmenuItem> items; 
@@ -0,0 +1,142 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "SyntheticSequence.h"
+
+using namespace std;
+
+SyntheticSequence::SyntheticSequence()
+{
+	this->imgSize = cv::Size(800, 600);
+	this->pattern = SYNTH_PATTERN_SPECKLE;
+	this->speckleRadius = 2.0f;
+	this->speckleDensity = 0.5f;
+	this->markerRadius = 15.f;
+	this->markerSpacing = 80.f;
+	this->transPerStep = cv::Point2f(0.f, 0.f);
+	this->rotPerStep = 0.0;
+	this->strainPerStep = cv::Vec3d(0., 0., 0.);
+	this->noiseSigma = 2.0;
+	this->blurSigma = 0.0;
+	this->seed = 12345;
+}
+
+int SyntheticSequence::init()
+{
+	if (imgSize.width <= 0 || imgSize.height <= 0 || speckleRadius <= 0.f ||
+		markerRadius <= 0.f || markerSpacing <= 2.f * markerRadius) {
+		cerr << "SyntheticSequence::init(): Invalid parameters.\n";
+		return -1;
+	}
+	// the pattern covers a region larger than the image so that moved images have no empty border
+	float mx = 0.25f * imgSize.width, my = 0.25f * imgSize.height;
+	this->blobs.clear();
+	if (this->pattern == SYNTH_PATTERN_MARKERS) {
+		for (float y = -my; y < imgSize.height + my; y += markerSpacing)
+			for (float x = -mx; x < imgSize.width + mx; x += markerSpacing)
+				this->blobs.push_back(cv::Vec3f(x + .5f * markerSpacing, y + .5f * markerSpacing, markerRadius));
+	}
+	else {
+		cv::RNG rng(this->seed);
+		double area = (imgSize.width + 2 * mx) * (imgSize.height + 2 * my);
+		int n = (int)(speckleDensity * area / (CV_PI * speckleRadius * speckleRadius));
+		for (int i = 0; i < n; i++) {
+			float r = speckleRadius * (float)rng.uniform(0.7, 1.3);
+			this->blobs.push_back(cv::Vec3f((float)rng.uniform(-mx, imgSize.width + mx),
+				(float)rng.uniform(-my, imgSize.height + my), r));
+		}
+	}
+	return 0;
+}
+
+cv::Matx23d SyntheticSequence::affine(int iStep) const
+{
+	double th = iStep * rotPerStep * CV_PI / 180.;
+	cv::Matx22d R(cos(th), -sin(th), sin(th), cos(th));
+	cv::Matx22d E(1. + iStep * strainPerStep[0], iStep * strainPerStep[2],
+		iStep * strainPerStep[2], 1. + iStep * strainPerStep[1]);
+	cv::Matx22d A = R * E;
+	double cx = .5 * (imgSize.width - 1), cy = .5 * (imgSize.height - 1);
+	double bx = cx - (A(0, 0) * cx + A(0, 1) * cy) + iStep * transPerStep.x;
+	double by = cy - (A(1, 0) * cx + A(1, 1) * cy) + iStep * transPerStep.y;
+	return cv::Matx23d(A(0, 0), A(0, 1), bx, A(1, 0), A(1, 1), by);
+}
+
+cv::Point2f SyntheticSequence::truth(int iStep, cv::Point2f p) const
+{
+	cv::Matx23d M = this->affine(iStep);
+	return cv::Point2f((float)(M(0, 0) * p.x + M(0, 1) * p.y + M(0, 2)),
+		(float)(M(1, 0) * p.x + M(1, 1) * p.y + M(1, 2)));
+}
+
+int SyntheticSequence::render(int iStep, cv::Mat & img) const
+{
+	if (this->blobs.size() == 0) {
+		cerr << "SyntheticSequence::render(): Pattern is not generated (call init()).\n";
+		return -1;
+	}
+	// inverse map (image --> reference)
+	cv::Matx23d M = this->affine(iStep), Minv;
+	cv::invertAffineTransform(M, Minv);
+
+	// grid of blobs (reference coordinate) so that each pixel visits only nearby blobs
+	float maxR = 0.f;
+	for (size_t i = 0; i < blobs.size(); i++) maxR = std::max(maxR, blobs[i][2]);
+	float reach = (pattern == SYNTH_PATTERN_MARKERS) ? maxR + 2.f : 4.f * maxR;
+	float x0 = -0.25f * imgSize.width - reach, y0 = -0.25f * imgSize.height - reach;
+	int gw = (int)((1.5f * imgSize.width + 2 * reach) / reach) + 1;
+	int gh = (int)((1.5f * imgSize.height + 2 * reach) / reach) + 1;
+	vector<vector<int> > grid(gw * gh);
+	for (int i = 0; i < (int)blobs.size(); i++) {
+		int gx = (int)((blobs[i][0] - x0) / reach), gy = (int)((blobs[i][1] - y0) / reach);
+		if (gx >= 0 && gy >= 0 && gx < gw && gy < gh)
+			grid[gy * gw + gx].push_back(i);
+	}
+	// edge width of markers in reference coordinate (one image pixel)
+	double scale = sqrt(fabs(M(0, 0) * M(1, 1) - M(0, 1) * M(1, 0)));
+	double edge = 1.0 / std::max(scale, 1e-6);
+
+	cv::Mat imgF(imgSize, CV_32F);
+#pragma omp parallel for
+	for (int y = 0; y < imgSize.height; y++) {
+		float * row = imgF.ptr<float>(y);
+		for (int x = 0; x < imgSize.width; x++) {
+			double X = Minv(0, 0) * x + Minv(0, 1) * y + Minv(0, 2);
+			double Y = Minv(1, 0) * x + Minv(1, 1) * y + Minv(1, 2);
+			int gx = (int)floor((X - x0) / reach), gy = (int)floor((Y - y0) / reach);
+			double cover = 0.0;
+			for (int jy = gy - 1; jy <= gy + 1; jy++) {
+				if (jy < 0 || jy >= gh) continue;
+				for (int jx = gx - 1; jx <= gx + 1; jx++) {
+					if (jx < 0 || jx >= gw) continue;
+					const vector<int> & cell = grid[jy * gw + jx];
+					for (size_t k = 0; k < cell.size(); k++) {
+						const cv::Vec3f & b = blobs[cell[k]];
+						double dx = X - b[0], dy = Y - b[1];
+						double d2 = dx * dx + dy * dy;
+						if (pattern == SYNTH_PATTERN_MARKERS) {
+							// disc with anti-aliased edge
+							double c = 0.5 + (b[2] - sqrt(d2)) / edge;
+							cover += std::max(0.0, std::min(1.0, c));
+						}
+						else if (d2 < 16. * b[2] * b[2])
+							cover += exp(-d2 / (2. * b[2] * b[2]));
+					}
+				}
+			}
+			row[x] = (float)(230.0 - 200.0 * std::min(cover, 1.0));
+		}
+	}
+	if (this->blurSigma > 0.0)
+		cv::GaussianBlur(imgF, imgF, cv::Size(0, 0), this->blurSigma);
+	if (this->noiseSigma > 0.0) {
+		cv::Mat noise(imgSize, CV_32F);
+		cv::RNG rng(this->seed + 7919u * (unsigned int)(iStep + 1));
+		rng.fill(noise, cv::RNG::NORMAL, 0.0, this->noiseSigma);
+		imgF += noise;
+	}
+	imgF.convertTo(img, CV_8U);
+	return 0;
+}
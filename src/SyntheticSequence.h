@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <opencv2/core.hpp>
+
+#define SYNTH_PATTERN_SPECKLE 1
+#define SYNTH_PATTERN_MARKERS 2
+
+// SyntheticSequence renders an image sequence of a pattern (random speckles
+// or a grid of circular markers) under a known motion, so that trackers can
+// be checked against exact (sub-pixel) ground truth.
+//
+// The pattern is defined analytically in the reference (step 0) coordinate
+// and every step is rendered by evaluating it at the mapped coordinates, so
+// the ground truth has no interpolation bias. The motion of step k is an
+// affine map about the image center c:
+//   x = c + R(k * rotPerStep) * (I + k * strainPerStep) * (X - c) + k * transPerStep
+// Gaussian noise and blur are added after rendering.
+//
+// SyntheticSequence seq;
+// seq.imgSize = cv::Size(1000, 800);
+// seq.transPerStep = cv::Point2f(0.37f, -0.21f);
+// seq.init();
+// cv::Mat img;
+// seq.render(5, img);
+// cv::Point2f truth = seq.truth(5, cv::Point2f(300.f, 200.f));
+
+class SyntheticSequence
+{
+public:
+	SyntheticSequence();
+
+	//! Generates the pattern (speckles or markers) by the parameters below
+	/*!
+	\return 0: success. -1: invalid parameters.
+	*/
+	int init();
+
+	//! Renders the image (CV_8U) of a step
+	int render(int iStep, cv::Mat & img) const;
+
+	//! Returns the position of a reference point at a step (ground truth)
+	cv::Point2f truth(int iStep, cv::Point2f refPoint) const;
+
+	//! Returns the 2x3 affine map (reference --> step) of a step
+	cv::Matx23d affine(int iStep) const;
+
+	// parameters (set before init())
+	cv::Size imgSize;           // image size (default: 800 x 600)
+	int pattern;                // SYNTH_PATTERN_SPECKLE or SYNTH_PATTERN_MARKERS
+	float speckleRadius;        // speckle radius (sigma of gaussian blob) in pixel (default: 2.0)
+	float speckleDensity;       // area covered by speckles (default: 0.5)
+	float markerRadius;         // marker radius in pixel (default: 15)
+	float markerSpacing;        // distance between markers in pixel (default: 80)
+	cv::Point2f transPerStep;   // translation per step (pixel)
+	double rotPerStep;          // rotation per step (degree)
+	cv::Vec3d strainPerStep;    // strain per step (exx, eyy, exy)
+	double noiseSigma;          // sigma of gaussian noise (gray level, default: 2.0)
+	double blurSigma;           // sigma of gaussian blur (pixel, 0 for none)
+	unsigned int seed;          // random seed
+
+private:
+	std::vector<cv::Vec3f> blobs;   // (x, y, radius) of speckles or markers in reference coordinate
+};
@@ -12,6 +12,7 @@
 
 #include "matchTemplateWithRotPyr.h"
 #include "enhancedCorrelationWithReference.h"
+#include "FramePyramidCache.h"
 
 using namespace std;
 using namespace cv; 
@@ -540,6 +541,71 @@ cv::Rect getTmpltRectFromImage(
 	return tmplt_rect;
 }
 
+cv::Rect unionRect(const std::vector<cv::Rect> & rects, cv::Size imgSize)
+{
+	cv::Rect u;
+	if (rects.size() <= 0)
+		return u;
+	u = rects[0];
+	for (int i = 1; i < (int)rects.size(); i++)
+		u |= rects[i];
+	if (imgSize.width > 0 && imgSize.height > 0)
+		u &= cv::Rect(0, 0, imgSize.width, imgSize.height);
+	return u;
+}
+
+int imreadRoi(const std::string & fname, const std::vector<cv::Rect> & rects,
+	cv::Mat & imgRoi, cv::Rect & roi,
+	int imread_flag, int reduce)
+{
+	// select decoding flag
+	int flag = imread_flag;
+	if (reduce != 2 && reduce != 4 && reduce != 8)
+		reduce = 1;
+	if (reduce > 1) {
+		if (imread_flag == cv::IMREAD_GRAYSCALE)
+			flag = (reduce == 2) ? cv::IMREAD_REDUCED_GRAYSCALE_2 :
+			       (reduce == 4) ? cv::IMREAD_REDUCED_GRAYSCALE_4 : cv::IMREAD_REDUCED_GRAYSCALE_8;
+		else if (imread_flag == cv::IMREAD_COLOR)
+			flag = (reduce == 2) ? cv::IMREAD_REDUCED_COLOR_2 :
+			       (reduce == 4) ? cv::IMREAD_REDUCED_COLOR_4 : cv::IMREAD_REDUCED_COLOR_8;
+		else
+			reduce = 1;
+	}
+	// decode
+	cv::Mat img = cv::imread(fname, flag);
+	if (img.cols <= 0 || img.rows <= 0) {
+		cerr << "imreadRoi: Cannot read image " << fname << ".\n";
+		imgRoi.release();
+		return -1;
+	}
+	// union of rects in full-image coordinate
+	cv::Size fullSize(img.cols * reduce, img.rows * reduce);
+	if (rects.size() > 0)
+		roi = unionRect(rects, fullSize);
+	else
+		roi = cv::Rect(0, 0, fullSize.width, fullSize.height);
+	// align roi to reduction factor so that roi maps to whole pixels of img
+	if (reduce > 1) {
+		int x1 = roi.x / reduce, y1 = roi.y / reduce;
+		int x2 = min((roi.x + roi.width + reduce - 1) / reduce, img.cols);
+		int y2 = min((roi.y + roi.height + reduce - 1) / reduce, img.rows);
+		roi = cv::Rect(x1 * reduce, y1 * reduce, (x2 - x1) * reduce, (y2 - y1) * reduce);
+	}
+	if (roi.width <= 0 || roi.height <= 0) {
+		cerr << "imreadRoi: Region is empty.\n";
+		imgRoi = cv::Mat();
+		return -2;
+	}
+	// keep a compact copy of the region only (releases the full-size buffer)
+	cv::Rect roiReduced(roi.x / reduce, roi.y / reduce, roi.width / reduce, roi.height / reduce);
+	if (roiReduced.width == img.cols && roiReduced.height == img.rows)
+		imgRoi = img;
+	else
+		img(roiReduced).copyTo(imgRoi);
+	return 0;
+}
+
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 std::string uigetfile(void)
@@ -1045,7 +1111,10 @@ int mtm_opfs(cv::Mat imgInit, cv::Mat imgSrch,
 	cv::Size winSize,
 	int maxLevel,
 	cv::TermCriteria criteria,
-	int flags)
+	int flags,
+	FramePyramidCache * pyrCache,
+	int initFrameId,
+	int srchFrameId)
 {
 	double totalCpusTime = getCpusTime();
 	double totalWallTime = getWallTime();
@@ -1261,10 +1330,30 @@ int mtm_opfs(cv::Mat imgInit, cv::Mat imgSrch,
 		tPointsSrchValid2f[iPoint].y = tPointsSrchValid[iPoint].y;
 	}
 	// optical flow 
-	cv::calcOpticalFlowPyrLK(imgInit_gray, imgSrch_gray,
-		tPointsInitValid, tPointsSrchValid2f, statusValid, errorValid,
-		rotWinSize, maxLevel,
-		criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+	if (pyrCache != NULL) {
+		// pyramids of images (e.g., imgInit) shared by calls are built once. They are keyed on the
+		// caller's images (imgInit_gray and imgSrch_gray are new buffers of every call if converted
+		// from color or cloned). If templates are rotated, imgInit_gray differs from imgInit and
+		// its pyramid is built for this call only.
+		bool anyRotated = false;
+		for (int iPoint = 0; iPoint < tPointsSrchValid.size(); iPoint++)
+			if (abs(tPointsSrchValid[iPoint].z) > 1e-3) anyRotated = true;
+		vector<cv::Mat> pyrInit;
+		if (anyRotated)
+			cv::buildOpticalFlowPyramid(imgInit_gray, pyrInit, rotWinSize, maxLevel);
+		else
+			pyrInit = pyrCache->get(initFrameId, PYR_VARIANT_RAW, imgInit, rotWinSize, maxLevel, imgInit_gray);
+		vector<cv::Mat> pyrSrch = pyrCache->get(srchFrameId, PYR_VARIANT_RAW, imgSrch, rotWinSize, maxLevel, imgSrch_gray);
+		cv::calcOpticalFlowPyrLK(pyrInit, pyrSrch,
+			tPointsInitValid, tPointsSrchValid2f, statusValid, errorValid,
+			rotWinSize, maxLevel,
+			criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+	}
+	else
+		cv::calcOpticalFlowPyrLK(imgInit_gray, imgSrch_gray,
+			tPointsInitValid, tPointsSrchValid2f, statusValid, errorValid,
+			rotWinSize, maxLevel,
+			criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
 	for (int iPoint = 0; iPoint < tPointsSrchValid.size(); iPoint++) {
 		tPointsSrchValid[iPoint].x = tPointsSrchValid2f[iPoint].x;
 		tPointsSrchValid[iPoint].y = tPointsSrchValid2f[iPoint].y;
@@ -1923,40 +2012,109 @@ int uToStrain(const cv::Mat & u, cv::Mat & exx, cv::Mat & eyy, cv::Mat & exy)
 	return 0;
 }
 
+//! sobelXyGray8u() is the fused kernel of sobel_xy() for 8-bit gray images. 
+// For each row, a vertical pass computes the smoothing (1 2 1) and the difference
+// (-1 0 1) of the three source rows into two small row buffers, then a horizontal
+// pass computes both derivatives, their saturated absolute values and the average,
+// so no full-size intermediate matrix is allocated. Rows are processed in bands
+// in parallel. The result is the same as Sobel(CV_16S) + convertScaleAbs() +
+// addWeighted(0.5, 0.5) with BORDER_DEFAULT.
+static void sobelXyGray8u(const cv::Mat & gray, cv::Rect roi, cv::Mat & dst)
+{
+	const int rows = gray.rows, cols = gray.cols, w = roi.width;
+	// columns of roi and their left/right neighbors (reflected at image border)
+	std::vector<int> xs(w + 2);
+	for (int i = 0; i < w + 2; i++)
+		xs[i] = cv::borderInterpolate(roi.x - 1 + i, cols, cv::BORDER_DEFAULT);
+	const bool contiguous = (roi.x >= 1 && roi.x + w < cols);
+	const int bandRows = 32;
+	const int nBand = (roi.height + bandRows - 1) / bandRows;
+#pragma omp parallel for if (nBand > 1 && roi.area() >= 65536)
+	for (int iBand = 0; iBand < nBand; iBand++) {
+		std::vector<short> vs(w + 2), vd(w + 2);
+		int y1 = min((iBand + 1) * bandRows, roi.height);
+		for (int y = iBand * bandRows; y < y1; y++) {
+			int yy = roi.y + y;
+			const uchar * pm = gray.ptr<uchar>(cv::borderInterpolate(yy - 1, rows, cv::BORDER_DEFAULT));
+			const uchar * p0 = gray.ptr<uchar>(yy);
+			const uchar * pp = gray.ptr<uchar>(cv::borderInterpolate(yy + 1, rows, cv::BORDER_DEFAULT));
+			// vertical pass
+			if (contiguous) {
+				const uchar * qm = pm + roi.x - 1, * q0 = p0 + roi.x - 1, * qp = pp + roi.x - 1;
+				for (int i = 0; i < w + 2; i++) {
+					vs[i] = (short)(qm[i] + 2 * q0[i] + qp[i]);
+					vd[i] = (short)(qp[i] - qm[i]);
+				}
+			}
+			else {
+				for (int i = 0; i < w + 2; i++) {
+					vs[i] = (short)(pm[xs[i]] + 2 * p0[xs[i]] + pp[xs[i]]);
+					vd[i] = (short)(pp[xs[i]] - pm[xs[i]]);
+				}
+			}
+			// horizontal pass
+			uchar * d = dst.ptr<uchar>(y);
+			for (int x = 0; x < w; x++) {
+				int gx = vs[x + 2] - vs[x];
+				int gy = vd[x] + 2 * vd[x + 1] + vd[x + 2];
+				int s = min(std::abs(gx), 255) + min(std::abs(gy), 255);
+				d[x] = (uchar)((s + ((s >> 1) & 1)) >> 1); // s / 2 rounded half to even, as addWeighted()
+			}
+		}
+	}
+}
+
 cv::Mat sobel_xy(const cv::Mat & src)
 {
-	cv::Mat src_gray;
-	cv::Mat grad;
-	int scale = 1;
-	int delta = 0;
-	int ddepth = CV_16S;
+	return sobel_xy(src, cv::Rect(0, 0, src.cols, src.rows));
+}
 
+cv::Mat sobel_xy(const cv::Mat & src, cv::Rect roi)
+{
 	if (!src.data)
 	{
 		return cv::Mat();
 	}
-
-	/// Convert it to gray
+	roi &= cv::Rect(0, 0, src.cols, src.rows);
+	if (roi.width <= 0 || roi.height <= 0)
+		return cv::Mat();
+	cv::Mat grad(roi.size(), CV_8U);
+
+	if (src.type() == CV_8UC1) {
+		// neighbors of roi are taken from src, or from its parent matrix if src is 
+		// a sub-matrix (as cv::Sobel() does), so sobel_xy(img, roi) == sobel_xy(img(roi))
+		cv::Size wholeSize;
+		cv::Point ofs;
+		src.locateROI(wholeSize, ofs);
+		cv::Mat whole = src;
+		whole.adjustROI(ofs.y, wholeSize.height - ofs.y - src.rows, ofs.x, wholeSize.width - ofs.x - src.cols);
+		sobelXyGray8u(whole, roi + ofs, grad);
+		return grad;
+	}
+	if (src.depth() == CV_8U && (src.channels() == 3 || src.channels() == 4)) {
+		// convert only roi (and its 1-pixel margin) to gray
+		cv::Rect ext = cv::Rect(roi.x - 1, roi.y - 1, roi.width + 2, roi.height + 2) & cv::Rect(0, 0, src.cols, src.rows);
+		cv::Mat src_gray;
+		cv::cvtColor(src(ext), src_gray, cv::COLOR_BGR2GRAY);
+		sobelXyGray8u(src_gray, roi - ext.tl(), grad);
+		return grad;
+	}
+
+	// other types: separate Sobel() calls
+	cv::Mat src_gray;
+	int scale = 1;
+	int delta = 0;
+	int ddepth = CV_16S;
 	if (src.channels() > 1)
-		cv::cvtColor(src, src_gray, cv::COLOR_BGR2GRAY);
+		cv::cvtColor(src(roi), src_gray, cv::COLOR_BGR2GRAY);
 	else
-		src_gray = src;
-
-	/// Generate grad_x and grad_y
+		src_gray = src(roi);
 	cv::Mat grad_x, grad_y;
 	cv::Mat abs_grad_x, abs_grad_y;
-
-	/// Gradient X
-	//Scharr( src_gray, grad_x, ddepth, 1, 0, scale, delta, BORDER_DEFAULT );
 	cv::Sobel(src_gray, grad_x, ddepth, 1, 0, 3, scale, delta, BORDER_DEFAULT);
 	convertScaleAbs(grad_x, abs_grad_x);
-
-	/// Gradient Y
-	//Scharr( src_gray, grad_y, ddepth, 0, 1, scale, delta, BORDER_DEFAULT );
 	Sobel(src_gray, grad_y, ddepth, 0, 1, 3, scale, delta, BORDER_DEFAULT);
 	convertScaleAbs(grad_y, abs_grad_y);
-
-	/// Total Gradient (approximate)
 	addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, grad);
 	return grad;
 }
@@ -5,9 +5,12 @@
 #include "opencv2/core.hpp"
 #include "opencv2/calib3d.hpp"
 #include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
 #include "opencv2/video.hpp"
 #include "opencv2/objdetect.hpp"
 
+class FramePyramidCache;
+
 #define M_PI 3.141592653589793238462643383279502884
 //#define M_PIl 3.141592653589793238462643383279502884L
 
@@ -103,6 +106,35 @@ cv::Rect getTmpltRectFromImageSizeWithPreferredRef(
 	const cv::Size      &    tmpltSize,
 	cv::Point2f   &    ref); // Preferred reference point, which does not need to be at the center of template. If template is not near border of full image, ref will remain. 
 
+//! unionRect() returns the bounding box of all given rectangles, clipped by the image size.
+/*!
+\param rects rectangles (e.g., search windows of all points of a step)
+\param imgSize image size. If width or height is not positive, the union is not clipped.
+\return the union rectangle. An empty rectangle if rects is empty.
+*/
+cv::Rect unionRect(const std::vector<cv::Rect> & rects, cv::Size imgSize = cv::Size(0, 0));
+
+//! imreadRoi() reads an image file and only keeps the region that covers all given rectangles.
+/*!
+\details imreadRoi() is for trackers whose search windows only cover a small part of a
+large photo. The region (roi) is the union bounding box of all rects. Only the region is
+kept (a compact copy, not a view of the full image) so that the full-size buffer is released
+right after decoding and all later processing (color conversion, filtering) only touches
+the region. If reduce is 2, 4, or 8, the file is decoded by cv::IMREAD_REDUCED_* (the jpeg
+decoder scales in DCT domain, which is significantly faster than decoding full size).
+A point (x, y) in imgRoi is at (roi.x + x * reduce, roi.y + y * reduce) of the full image.
+\param fname full path of the image file
+\param rects rectangles in full-image coordinate that must be covered (e.g., search windows)
+\param imgRoi output image of the region (in reduced size if reduce > 1)
+\param roi output region in full-image coordinate
+\param imread_flag cv::IMREAD_GRAYSCALE or cv::IMREAD_COLOR
+\param reduce reduction factor. 1 (default), 2, 4, or 8.
+\return 0: success. -1: cannot read image. -2: region is empty. imgRoi is empty if not 0.
+*/
+int imreadRoi(const std::string & fname, const std::vector<cv::Rect> & rects,
+	cv::Mat & imgRoi, cv::Rect & roi,
+	int imread_flag = cv::IMREAD_GRAYSCALE, int reduce = 1);
+
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32) && !defined(__CYGWIN__)
 std::string              uigetfile(void);
 std::vector<std::string> uigetfiles(void);
@@ -191,6 +223,10 @@ running optical flow. The function interface is similar to calcOpticalFlowPyrLK(
 \param maxLevel For mtm: size factor of winSize in rough matching (step 1). For optical flow, maximum pyramid level number. 0:same size, 1:double (x2), 2:(x4), 3:(x8)
 \param criteria specifying the termination criteria of the iterative search algorithm
 \param flags OPTFLOW_USE_INITIAL_FLOW, OPTFLOW_LK_GET_MIN_EIGENVALS. 
+\param pyrCache if not NULL, optical flow pyramids of both images are taken from (or built into) this cache, 
+       so that an image used by many calls (e.g., the initial image) is built once. 
+\param initFrameId frame id of imgInit in pyrCache
+\param srchFrameId frame id of imgSrch in pyrCache
 \return 0:success. -1:empry image(s). -2:no valid initial point. 
 */
 int mtm_opfs(cv::Mat imgInit, cv::Mat imgSrch,
@@ -203,7 +239,10 @@ int mtm_opfs(cv::Mat imgInit, cv::Mat imgSrch,
 	cv::Size winSize = cv::Size(25, 25), 
 	int maxLevel = 3,
 	cv::TermCriteria criteria = cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01),
-	int flags = cv::OPTFLOW_USE_INITIAL_FLOW);
+	int flags = cv::OPTFLOW_USE_INITIAL_FLOW,
+	FramePyramidCache * pyrCache = NULL,
+	int initFrameId = 0,
+	int srchFrameId = 1);
 
 int points2fVecValid(const std::vector<cv::Point2f> & oldVec,
 	std::vector<cv::Point2f> & newVec,
@@ -369,7 +408,17 @@ The displacement fields are normally analyzed by template match, ECC, optical fl
 */
 int uToStrain(const cv::Mat & u, cv::Mat & exx, cv::Mat & eyy, cv::Mat & exy);
 
+//! sobel_xy() returns 8-bit gradient image (|dI/dx| + |dI/dy|) / 2 (each saturated to 255)
+/*!
+\details For 8-bit gray or color images the derivatives, absolute values and average are 
+computed in a single fused pass, parallel over row bands, without full-size intermediate 
+matrices. 
+\param src source image (8-bit gray or BGR is the fast path)
+\param roi region to compute. Neighbors outside roi (if any) are used for the border pixels.
+\return gradient image of roi size, CV_8U.
+*/
 cv::Mat sobel_xy(const cv::Mat & src);
+cv::Mat sobel_xy(const cv::Mat & src, cv::Rect roi);
 
 void imshow_resize(std::string winname, cv::Mat img, double factor); 
 
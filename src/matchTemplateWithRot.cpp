@@ -37,6 +37,10 @@
 //            replaced resize() with remap() when scaling search image,
 //              so that ranges do not need to be integer before
 //              scaling, making ranges smaller and saving computin time.
+// Modifed: 2026-10-18
+//            replaced remap() with warpAffine() as the map is linear
+//              (no map generation for every call)
+//            method TM_SQDIFF and TM_SQDIFF_NORMED: minimum is the best match
 //
 
 #include "matchTemplateWithRot.h"
@@ -271,19 +275,17 @@ int matchTemplateWithRot(
   if (scaledSearchImgHeight < scaledSize.height) scaledSearchImgHeight = scaledSize.height; 
 																						// generate map coordinates
   tStart2 = getCpusTime();
-  cv::Mat mapx(scaledSearchImgHeight, scaledSearchImgWidth, CV_32FC1);
-  cv::Mat mapy(scaledSearchImgHeight, scaledSearchImgWidth, CV_32FC1);
-  double _y, dx, dy;
+  // The map is linear (x = x0 + j * dx, y = y0 + i * dy), so the resampling
+  // is an inverse affine warp. warpAffine gives the same result as remap()
+  // with mapx/mapy, without building the maps pixel by pixel.
+  double dx, dy;
   dx = 1.0 / scaleFactorX;
   dy = 1.0 / scaleFactorY;
-  for (int i = 0; i < scaledSearchImgHeight; i++) {
-      _y = searchRect_y0 + i * dy;
-      for (int j = 0; j < scaledSearchImgWidth; j++) {
-          mapx.at<float>(i,j) = (float) (searchRect_x0 + j * dx);
-          mapy.at<float>(i,j) = (float) (_y);
-      }
-  }
-  cv::remap(searchMat, searchResampled, mapx, mapy, cv::INTER_CUBIC);
+  cv::Mat scaleShift = (cv::Mat_<double>(2, 3) << dx, 0., searchRect_x0, 
+                                                  0., dy, searchRect_y0);
+  cv::warpAffine(searchMat, searchResampled, scaleShift, 
+                 cv::Size(scaledSearchImgWidth, scaledSearchImgHeight),
+                 cv::INTER_CUBIC | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT);
   tEnd2 =   getCpusTime(); tResize += tEnd2 - tStart2; 
 
   // Step 5:  For each rotation
@@ -412,6 +414,10 @@ int matchTemplateWithRot(
 //    cv::imshow("template", squareTmpltRotatedCroppedScaled); cv::waitKey(-1);
     cv::matchTemplate(searchResampled, squareTmpltRotatedCroppedScaled, 
 	                  matchResult, method);
+    // For square-difference methods the best match is the minimum. 
+    // Negate so that the peak search below works for all methods. 
+    if (method == cv::TM_SQDIFF || method == cv::TM_SQDIFF_NORMED)
+      matchResult = -matchResult;
     //cv::imshow("searchScaled", searchScaled); 
     //cv::imshow("squareTmpltRotatedCroppedScaled", squareTmpltRotatedCroppedScaled); 
     //cv::imshow("matchResult", matchResult); cv::waitKey(); 
@@ -479,6 +485,8 @@ int matchTemplateWithRot(
   result[1] = best_matched_y;
   result[2] = best_matched_theta;
   result[3] = best_matched_value; 
+  if (method == cv::TM_SQDIFF || method == cv::TM_SQDIFF_NORMED)
+    result[3] = -best_matched_value; 
   result[4] = tTotal; 
   result[5] = tResize;
   result[6] = tRotate;
@@ -33,6 +33,7 @@
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include <cmath>
 
 #include "matchTemplateWithRot.h"
 #include "matchTemplateWithRotPyr.h"
@@ -45,7 +46,9 @@ int matchTemplateWithRotPyr(
        double _min_rot, double _max_rot, double _precision_rot, 
        vector<double> &  result, 
        int method, 
-       double _init_prec_x, double _init_prec_y, double _init_prec_rot)
+       double _init_prec_x, double _init_prec_y, double _init_prec_rot, 
+       bool early_termination, 
+       vector<double> * levelResult)
 {
   cv::Mat search = _image.getMat(); 
   cv::Mat tmplt  = _tmplt.getMat(); 
@@ -78,7 +81,7 @@ int matchTemplateWithRotPyr(
   if (_precision_y > 0) 
     precision_y = _precision_y; 
   else 
-    precision_x = 1.0; 
+    precision_y = 1.0; 
   if (_precision_rot > 0) 
     precision_rot = _precision_rot; 
   else 
@@ -87,11 +90,11 @@ int matchTemplateWithRotPyr(
   if (_init_prec_x > 0) 
     this_prec_x = _init_prec_x; 
   else
-    this_prec_x = tmplt.cols / 32. ; 
+    this_prec_x = max(precision_x, min(tmplt.cols / 32., (max_x - min_x) / 4.)); 
   if (_init_prec_y > 0) 
     this_prec_y = _init_prec_y; 
   else
-    this_prec_y = tmplt.rows / 32.; 
+    this_prec_y = max(precision_y, min(tmplt.rows / 32., (max_y - min_y) / 4.)); 
   if (_init_prec_rot > 0) 
     this_prec_rot = _init_prec_rot; 
   else 
@@ -103,6 +106,10 @@ int matchTemplateWithRotPyr(
 
   // timing data for accumulation
   double timing[] = {0, 0, 0, 0}; 
+  // result of previous level (for early termination)
+  double prev_x = 0, prev_y = 0, prev_rot = 0, prev_value = 0; 
+  bool   converged = false; 
+  int    iLevel = 0; 
   while (true) {
     //printf("matching x:%7.3f~%7.3f(%7.3f) y:%7.3f~%7.3f(%7.3f) rot:%7.3f~%7.3f(%7.3f)...\n", 
     //        min_x,   max_x,   this_prec_x, 
@@ -113,25 +120,57 @@ int matchTemplateWithRotPyr(
                                    min_x,   max_x,   this_prec_x, 
                                    min_y,   max_y,   this_prec_y,
                                    min_rot, max_rot, this_prec_rot, 
-                                   result, CV_TM_CCORR_NORMED); 
+                                   result, method); 
     // accumulating timing data.
     timing[0] += result[4]; 
     timing[1] += result[5]; 
     timing[2] += result[6]; 
     timing[3] += result[7]; 
+    // per-level result
+    if (levelResult != NULL) {
+      levelResult->push_back(this_prec_x);
+      levelResult->push_back(this_prec_y);
+      levelResult->push_back(this_prec_rot);
+      levelResult->push_back(result[0]);
+      levelResult->push_back(result[1]);
+      levelResult->push_back(result[2]);
+      levelResult->push_back(result[3]);
+      levelResult->push_back(result[4]);
+    }
+    // early termination: location, rotation, and value converge. 
+    // A coarse level gives its result on a coarse grid, so the search stops only 
+    // at the target precision. Before that, convergence narrows the windows of 
+    // the remaining levels. 
+    if (early_termination && iLevel > 0 
+      && fabs(result[0] - prev_x) <= this_prec_x 
+      && fabs(result[1] - prev_y) <= this_prec_y 
+      && fabs(result[2] - prev_rot) <= this_prec_rot 
+      && fabs(result[3] - prev_value) <= 1e-4 * max(1.0, fabs(result[3]))) {
+      if (this_prec_x <= precision_x && this_prec_y <= precision_y 
+       && this_prec_rot <= precision_rot)
+        break;
+      converged = true; 
+    }
+    prev_x = result[0]; 
+    prev_y = result[1]; 
+    prev_rot = result[2]; 
+    prev_value = result[3]; 
+    iLevel++; 
     // printf("match x:%7.3f y:%7.3f rot:%7.3f value:%9.7f\n",
     //         result[0], result[1], result[2], result[3]);
     // printf("CPU Time: Total:%9.3f Resize:%9.3f Rotate:%9.3f  Match%9.3f\n",
     //   result[4], result[5], result[6], result[7]);
 
-    min_x   = max(min_x,   result[0] - 3.0 * this_prec_x);
-    max_x   = min(max_x,   result[0] + 3.0 * this_prec_x); 
+    double win_xy  = converged ? 1.0 : 3.0; // window (in steps of this level) of next level
+    double win_rot = converged ? 1.0 : 2.0; 
+    min_x   = max(min_x,   result[0] - win_xy * this_prec_x);
+    max_x   = min(max_x,   result[0] + win_xy * this_prec_x); 
     max_x   = max(min_x,   max_x); 
-    min_y   = max(min_y,   result[1] - 3.0 * this_prec_y); 
-    max_y   = min(max_y,   result[1] + 3.0 * this_prec_y); 
+    min_y   = max(min_y,   result[1] - win_xy * this_prec_y); 
+    max_y   = min(max_y,   result[1] + win_xy * this_prec_y); 
     max_y   = max(min_y,   max_y); 
-    min_rot = max(min_rot, result[2] - 2.0 * this_prec_rot); 
-    max_rot = min(max_rot, result[2] + 2.0 * this_prec_rot); 
+    min_rot = max(min_rot, result[2] - win_rot * this_prec_rot); 
+    max_rot = min(max_rot, result[2] + win_rot * this_prec_rot); 
     max_rot = max(min_rot, max_rot); 
     if (this_prec_x <= precision_x && this_prec_y <= precision_y 
 	 && this_prec_rot <= precision_rot )
@@ -71,6 +71,27 @@
 //       result[6]:  cpu time on image rotating (cv::getRotationMatrix2D and cv::warpAffine)
 //       result[7]:  cpu time on template match (cv::matchTemplate)
 //   
+//   int                     method
+//     method of cv::matchTemplate. For TM_SQDIFF and TM_SQDIFF_NORMED, the minimum 
+//     is the best match. 
+//
+//   double                  init_prec_x, init_prec_y, init_prec_rot
+//     precision of the first (coarsest) level. If not positive, it is template size / 32, 
+//     but not coarser than a quarter of the search range (so that small search ranges
+//     do not waste levels). 
+//
+//   bool                    early_termination
+//     if true, once two consecutive levels give the same location and rotation 
+//     (difference within the step of the level) and the matched value does not 
+//     change (relative difference < 1e-4), the following levels search only one 
+//     step (instead of three) around the result. The pyramid still goes down to 
+//     the target precision (precision_x, precision_y, precision_rot); if it 
+//     converges at the target precision, it stops there. 
+//
+//   vector<double>        * levelResult
+//     if not NULL, 8 values are appended for each level:  
+//       precision x, precision y, precision rot, px, py, rotation, matched value, cpu time
+//   
 //   int                     return value
 //      0: done successfully
 //     -1: unsuccessfully
@@ -85,6 +106,11 @@
 //        2014-05-20  bug fixed: BUG: min_x   = max(min_x,   result[0] - 1.0 * precision_x); 
 //                               FIX: min_x   = max(min_x,   result[0] - 1.0 * this_prec_x);  
 //                               and so on.
+//        2026-10-18  method is passed to matchTemplateWithRot() (it was always CV_TM_CCORR_NORMED)
+//                    bug fixed: default precision_y was not set (precision_x was set instead)
+//                    added early termination and per-level result
+//                    initial precision is not coarser than a quarter of the search range
+//                    bug fixed: early termination returned results of a coarse level
 //
 
 #ifndef _matchTemplateWithRotPyr_
@@ -104,6 +130,8 @@ int matchTemplateWithRotPyr(InputArray _image, InputArray _tmplt,
                                    double min_rot, double max_rot, double precision_rot, 
                                    vector<double> &  result, 
                                    int method = cv::TM_CCORR_NORMED,
-                                   double _init_prec_x = -1, double _init_prec_y = -1, double _init_prec_rot = -1); 
+                                   double _init_prec_x = -1, double _init_prec_y = -1, double _init_prec_rot = -1, 
+                                   bool early_termination = false, 
+                                   vector<double> * levelResult = NULL); 
 
 #endif 